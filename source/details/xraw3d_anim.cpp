@@ -38,6 +38,7 @@ anim& anim::operator =( const anim& Src )
     m_Name          = Src.m_Name;
 
     m_Bone          = Src.m_Bone;
+    m_BoneIndex.Invalidate();
     m_KeyFrame      = Src.m_KeyFrame;
     m_Event         = Src.m_Event;
     m_SuperEvent    = Src.m_SuperEvent;
@@ -231,11 +232,20 @@ void anim::Serialize
 , xtextfile::file_type          FileType
 )
 {
+    // Chunk files are recognized by their header so callers do not need to know the format
+    if( isRead && details::chunk_reader::isChunkFile( FileName ) )
+    {
+        SerializeChunked( true, FileName );
+        return;
+    }
+
     xtextfile::stream File;
 
     if( auto Err = File.Open(isRead, FileName, FileType ); Err )
         throw(std::runtime_error( std::string(Err.getMessage()) ));
 
+    if( isRead ) m_BoneIndex.Invalidate();
+
     if( auto Err = File.Record
         ( "AnimInfo"
         , [&]( std::size_t, xerr& Err )
@@ -301,6 +311,127 @@ void anim::Serialize
       ; Err ) throw(std::runtime_error(std::string(Err.getMessage())));
 }
 
+//--------------------------------------------------------------------------
+// Layout of the anim chunk file. The key frames are stored as they are in memory, one contiguous
+// chunk with the bones in the columns and the frames in the rows, so loading them is one memcpy.
+//--------------------------------------------------------------------------
+namespace details
+{
+    struct anim_chunk
+    {
+        static constexpr std::uint32_t file_type_v  = MakeChunkID( "ANIM" );
+        static constexpr std::uint32_t info_v       = MakeChunkID( "INFO" );
+        static constexpr std::uint32_t bones_v      = MakeChunkID( "BONE" );
+        static constexpr std::uint32_t key_frames_v = MakeChunkID( "KEYS" );
+
+        struct info
+        {
+            chunk_string                                    m_Name;
+            std::int32_t                                    m_FPS;
+            std::int32_t                                    m_nFrames;
+        };
+
+        struct bone
+        {
+            enum flags : std::uint32_t
+            { SCALE_KEYS        = 1 << 0
+            , ROTATION_KEYS     = 1 << 1
+            , TRANSLATION_KEYS  = 1 << 2
+            , MASKED            = 1 << 3
+            };
+
+            chunk_string                                    m_Name;
+            std::int32_t                                    m_nChildren;
+            std::int32_t                                    m_iParent;
+            std::array<float, 3>                            m_Scale;
+            std::array<float, 4>                            m_Rotation;
+            std::array<float, 3>                            m_Translation;
+            std::uint32_t                                   m_Flags;
+        };
+    };
+}
+
+//--------------------------------------------------------------------------
+
+void anim::SerializeChunked( bool isRead, std::wstring_view FileName, bool bCompress )
+{
+    using chunk = details::anim_chunk;
+
+    if( isRead == false )
+    {
+        details::chunk_writer Writer;
+        Writer.setCompression( bCompress );
+
+        Writer.Add( chunk::info_v, std::vector<chunk::info>{ { Writer.AddString( m_Name ), m_FPS, m_nFrames } } );
+
+        std::vector<chunk::bone> Bones( m_Bone.size() );
+        for( std::size_t i = 0; i < m_Bone.size(); ++i )
+        {
+            const auto& Bone = m_Bone[i];
+            Bones[i].m_Name         = Writer.AddString( Bone.m_Name );
+            Bones[i].m_nChildren    = Bone.m_nChildren;
+            Bones[i].m_iParent      = Bone.m_iParent;
+            Bones[i].m_Scale        = { Bone.m_BindScale.m_X,       Bone.m_BindScale.m_Y,       Bone.m_BindScale.m_Z };
+            Bones[i].m_Rotation     = { Bone.m_BindRotation.m_X,    Bone.m_BindRotation.m_Y,    Bone.m_BindRotation.m_Z, Bone.m_BindRotation.m_W };
+            Bones[i].m_Translation  = { Bone.m_BindTranslation.m_X, Bone.m_BindTranslation.m_Y, Bone.m_BindTranslation.m_Z };
+            Bones[i].m_Flags        = ( Bone.m_bScaleKeys       ? chunk::bone::SCALE_KEYS       : 0u )
+                                    | ( Bone.m_bRotationKeys    ? chunk::bone::ROTATION_KEYS    : 0u )
+                                    | ( Bone.m_bTranslationKeys ? chunk::bone::TRANSLATION_KEYS : 0u )
+                                    | ( Bone.m_bIsMasked        ? chunk::bone::MASKED           : 0u );
+        }
+        Writer.Add( chunk::bones_v, std::move(Bones) );
+
+        // Each key is coded against the same bone in the previous frame, which is where they look alike
+        Writer.Add( chunk::key_frames_v, std::span<const key_frame>{ m_KeyFrame }, details::chunk_encoding::DELTA, static_cast<std::uint32_t>( std::max<std::size_t>( 1, m_Bone.size() ) ) );
+
+        Writer.Save( FileName, chunk::file_type_v );
+        return;
+    }
+
+    details::chunk_reader Reader;
+    Reader.Open( FileName, chunk::file_type_v );
+
+    m_BoneIndex.Invalidate();
+
+    const auto Info = Reader.get<chunk::info>( chunk::info_v );
+    if( Info.size() != 1 ) throw(std::runtime_error( "The chunk file has no AnimInfo" ));
+
+    m_Name      = Reader.getString( Info[0].m_Name );
+    m_FPS       = Info[0].m_FPS;
+    m_nFrames   = Info[0].m_nFrames;
+
+    const auto Bones = Reader.get<chunk::bone>( chunk::bones_v );
+    m_Bone.resize( Bones.size() );
+    for( std::size_t i = 0; i < Bones.size(); ++i )
+    {
+        const auto& Src  = Bones[i];
+        auto&       Bone = m_Bone[i];
+        Bone.m_Name                 = Reader.getString( Src.m_Name );
+        Bone.m_nChildren            = Src.m_nChildren;
+        Bone.m_iParent              = Src.m_iParent;
+        Bone.m_BindScale            = xmath::fvec3( Src.m_Scale[0], Src.m_Scale[1], Src.m_Scale[2] );
+        Bone.m_BindRotation.m_X     = Src.m_Rotation[0];
+        Bone.m_BindRotation.m_Y     = Src.m_Rotation[1];
+        Bone.m_BindRotation.m_Z     = Src.m_Rotation[2];
+        Bone.m_BindRotation.m_W     = Src.m_Rotation[3];
+        Bone.m_BindTranslation      = xmath::fvec3( Src.m_Translation[0], Src.m_Translation[1], Src.m_Translation[2] );
+        Bone.m_bScaleKeys           = ( Src.m_Flags & chunk::bone::SCALE_KEYS       ) != 0;
+        Bone.m_bRotationKeys        = ( Src.m_Flags & chunk::bone::ROTATION_KEYS    ) != 0;
+        Bone.m_bTranslationKeys     = ( Src.m_Flags & chunk::bone::TRANSLATION_KEYS ) != 0;
+        Bone.m_bIsMasked            = ( Src.m_Flags & chunk::bone::MASKED           ) != 0;
+
+        if( Bone.m_iParent < -1 || Bone.m_iParent >= static_cast<std::int32_t>( Bones.size() ) )
+            throw(std::runtime_error( "The chunk file has a bone with an invalid parent" ));
+    }
+
+    // The whole clip in one copy
+    Reader.Read( chunk::key_frames_v, m_KeyFrame );
+
+    // The frame accessors index m_KeyFrame[ iFrame * nBones ] for every iFrame < m_nFrames
+    if( m_nFrames < 0 || m_KeyFrame.size() != static_cast<std::size_t>( m_nFrames ) * m_Bone.size() )
+        throw(std::runtime_error( "The chunk file has key frames that do not match the skeleton and frame count" ));
+}
+
 //--------------------------------------------------------------------------
 
 void anim::ComputeBonesL2W( std::span<xmath::fmat4> Matrix, float Frame ) const
@@ -506,11 +637,14 @@ void anim::ComputeBoneKeys( std::span<xmath::fquat> Q, std::span<xmath::fvec3> S
 
 std::int32_t anim::GetBoneIDFromName( std::string_view BoneName ) const
 {
-    std::int32_t i;
-    for( i=0; i<m_Bone.size(); i++ )
-    if( xstrtool::CompareI( BoneName, m_Bone[i].m_Name ) == 0 )
-        return i;
-    return -1;
+    return m_BoneIndex.find( m_Bone, BoneName );
+}
+
+//--------------------------------------------------------------------------
+
+void anim::InvalidateBoneIndex( void ) noexcept
+{
+    m_BoneIndex.Invalidate();
 }
 
 //--------------------------------------------------------------------------
@@ -844,6 +978,7 @@ void anim::DeleteBone( std::int32_t iBone )
 
     m_Bone     = std::move(NewBone);
     m_KeyFrame = std::move(NewFrame);
+    m_BoneIndex.Invalidate();
 }
 
 //--------------------------------------------------------------------------
@@ -951,6 +1086,7 @@ bool anim::ApplyNewSkeleton( const anim& BindAnim )
     
     m_Bone      = std::move(NewBone);
     m_KeyFrame  = std::move(NewFrame);
+    m_BoneIndex.Invalidate();
 
     return !Problem;
 }
@@ -1102,6 +1238,7 @@ void anim::setNewRoot( std::int32_t Index )
     // set the new data
     m_Bone      = std::move(NewBone);
     m_KeyFrame  = std::move(NewFrame);
+    m_BoneIndex.Invalidate();
 }
 
 
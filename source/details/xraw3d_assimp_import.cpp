@@ -105,6 +105,9 @@ struct importer
                     }
                 }
             }
+
+            // The facets come without planes, they are computed when someone asks for them (UpdateFacetPlanes)
+            m_RawGeom.InvalidateFacetPlanes();
         }
 
         //
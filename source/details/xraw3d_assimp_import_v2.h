@@ -388,6 +388,7 @@ namespace xraw3d::assimp_v2
                     // Assume for now, no invBind in bone, perhaps computed on fly or not needed yet.
                 }
             }
+            m_pGeom->InvalidateBoneIndex();
 
             // Normalization: Find root, apply root bind to invBinds if applicable
             // But since no invBind in bone, skip or add if needed.
@@ -715,17 +716,13 @@ namespace xraw3d::assimp_v2
                     F.m_iVertex[1]  = part.m_Indices[i + 1] + vertBase;
                     F.m_iVertex[2]  = part.m_Indices[i + 2] + vertBase;
                     F.m_iMaterialInstance = part.m_iMaterialInstance;
-
-                    // Compute plane
-                    const auto& p0 = m_pGeom->m_Vertex[F.m_iVertex[0]].m_Position;
-                    const auto& p1 = m_pGeom->m_Vertex[F.m_iVertex[1]].m_Position;
-                    const auto& p2 = m_pGeom->m_Vertex[F.m_iVertex[2]].m_Position;
-                    xmath::fvec3 normal = (p1 - p0).Cross(p2 - p0).Normalize();
-                    F.m_Plane = xmath::fplane(normal, -normal.Dot(p0));
                     m_pGeom->m_Facet.push_back(F);
                 }
             }
 
+            // Planes are computed in one batch when someone asks for them (UpdateFacetPlanes)
+            m_pGeom->InvalidateFacetPlanes();
+
             // Optional: sort facets by mesh/material if wanted
             // m_pGeom->SortFacetsByMeshMaterialBone();
         }
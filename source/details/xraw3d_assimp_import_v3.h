@@ -875,16 +875,11 @@ namespace xraw3d::assimp_v3
                     f.m_iVertex[1]  = E.m_Indices[k + 1] + baseVertex;
                     f.m_iVertex[2]  = E.m_Indices[k + 2] + baseVertex;
                     f.m_iMaterialInstance = E.m_iMaterialInstance; // Will be remapped in ImportMaterials
-
-                    // Compute plane
-                    const auto&     p0      = m_pGeom->m_Vertex[f.m_iVertex[0]].m_Position;
-                    const auto&     p1      = m_pGeom->m_Vertex[f.m_iVertex[1]].m_Position;
-                    const auto&     p2      = m_pGeom->m_Vertex[f.m_iVertex[2]].m_Position;
-                    xmath::fvec3    normal  = (p1 - p0).Cross(p2 - p0).NormalizeSafe();
-                    const float     d       = -normal.Dot(p0);
-                    f.m_Plane = xmath::fplane(normal.m_X, normal.m_Y, normal.m_Z, d);
                 }
             }
+
+            // Planes are computed in one batch when someone asks for them (UpdateFacetPlanes)
+            m_pGeom->InvalidateFacetPlanes();
         }
 
         //------------------------------------------------------------------------------------------------------
@@ -1366,6 +1361,7 @@ namespace xraw3d::assimp_v3
                     gbone.m_Position    = m_InternalBones[idx].pos;
                     gbone.m_BBox        = xmath::fbbox(); // Empty
                 }
+                m_pGeom->InvalidateBoneIndex();
             }
 
             // Fill pSkeleton if requested
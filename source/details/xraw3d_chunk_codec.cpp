@@ -0,0 +1,396 @@
+#include <array>
+#include <cstring>
+#include <numeric>
+
+namespace xraw3d::details {
+
+//--------------------------------------------------------------------------
+// Packed chunk:    u32 ElementsPerBlock, u32 nBlocks, u32 PackedSize[nBlocks] and the blocks
+// Packed block:    one plane per byte of the element, plane k holds byte k of every element of the block
+// Packed plane:    u8 Mode followed by
+//                  plane_raw_v     the bytes as they are, used when coding them does not pay off
+//                  plane_rans_v    u8 Used[32] (bitmap of the symbols), u16 Freq per used symbol,
+//                                  u32 nBytes and the rANS bytes, they start with the final state of
+//                                  the two interleaved coders (even and odd elements)
+//--------------------------------------------------------------------------
+namespace codec
+{
+    constexpr std::size_t       block_size_v    = 256 * 1024;
+    constexpr std::uint32_t     scale_bits_v    = 12;
+    constexpr std::uint32_t     scale_v         = 1u << scale_bits_v;
+    constexpr std::uint32_t     rans_low_v      = 1u << 23;
+    constexpr std::uint8_t      plane_raw_v     = 0;
+    constexpr std::uint8_t      plane_rans_v    = 1;
+
+    // Reads a packed buffer, running out of bytes means the file is corrupted
+    struct cursor
+    {
+        const std::byte*    m_pData;
+        const std::byte*    m_pEnd;
+
+        const std::byte* Take( std::size_t Size )
+        {
+            if( static_cast<std::size_t>( m_pEnd - m_pData ) < Size )
+                throw(std::runtime_error( "The chunk file has a corrupted compressed chunk" ));
+
+            const std::byte* pData = m_pData;
+            m_pData += Size;
+            return pData;
+        }
+
+        template< typename T >
+        T Read( void )
+        {
+            T Value;
+            std::memcpy( &Value, Take( sizeof(T) ), sizeof(T) );
+            return Value;
+        }
+    };
+
+    template< typename T >
+    void Write( std::vector<std::byte>& Out, const T& Value )
+    {
+        const auto* pData = reinterpret_cast<const std::byte*>( &Value );
+        Out.insert( Out.end(), pData, pData + sizeof(T) );
+    }
+
+    template< typename T >
+    T Load( const std::byte* pData ) noexcept
+    {
+        T Value;
+        std::memcpy( &Value, pData, sizeof(T) );
+        return Value;
+    }
+
+    template< typename T >
+    void Store( std::byte* pData, T Value ) noexcept
+    {
+        std::memcpy( pData, &Value, sizeof(T) );
+    }
+
+    // Small negative and positive differences both end up as small unsigned numbers
+    template< typename T > constexpr T ZigZag  ( T Value ) noexcept { return static_cast<T>( ( Value << 1 ) ^ ( 0u - ( Value >> ( sizeof(T) * 8 - 1 ) ) ) ); }
+    template< typename T > constexpr T UnZigZag( T Value ) noexcept { return static_cast<T>( ( Value >> 1 ) ^ ( 0u - ( Value & 1u ) ) ); }
+
+    //--------------------------------------------------------------------------
+    // Distance is in bytes. The encoder runs backwards so it can work in place.
+
+    template< typename T >
+    void DeltaEncode( std::span<std::byte> Data, std::size_t Distance ) noexcept
+    {
+        for( std::size_t i = Data.size(); i >= sizeof(T); )
+        {
+            i -= sizeof(T);
+            T Value = Load<T>( &Data[i] );
+            if( i >= Distance ) Value = static_cast<T>( Value - Load<T>( &Data[i - Distance] ) );
+            Store( &Data[i], ZigZag( Value ) );
+        }
+    }
+
+    template< typename T >
+    void DeltaDecode( std::span<std::byte> Data, std::size_t Distance ) noexcept
+    {
+        for( std::size_t i = 0; i + sizeof(T) <= Data.size(); i += sizeof(T) )
+        {
+            T Value = UnZigZag( Load<T>( &Data[i] ) );
+            if( i >= Distance ) Value = static_cast<T>( Value + Load<T>( &Data[i - Distance] ) );
+            Store( &Data[i], Value );
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    // Scales the symbol counts to frequencies that add up to scale_v, every used symbol keeps at least 1
+
+    inline std::array<std::uint32_t,256> NormalizeFrequencies( const std::array<std::uint32_t,256>& Counts, std::size_t Total )
+    {
+        std::array<std::uint32_t,256> Freq{};
+        std::uint32_t                 Sum = 0;
+        for( std::size_t s = 0; s < Counts.size(); ++s )
+        {
+            if( Counts[s] == 0 ) continue;
+            Freq[s] = std::max<std::uint32_t>( 1, static_cast<std::uint32_t>( std::uint64_t{ Counts[s] } * scale_v / Total ) );
+            Sum    += Freq[s];
+        }
+
+        // The rounding leaves the sum a bit off, the most frequent symbols absorb the difference
+        while( Sum != scale_v )
+        {
+            auto& Max = *std::max_element( Freq.begin(), Freq.end() );
+            if( Sum < scale_v )
+            {
+                Max += scale_v - Sum;
+                Sum  = scale_v;
+            }
+            else
+            {
+                const std::uint32_t Take = std::min( Sum - scale_v, Max - 1 );
+                Max -= Take;
+                Sum -= Take;
+            }
+        }
+
+        return Freq;
+    }
+
+    //--------------------------------------------------------------------------
+
+    inline void EncodePlane( std::span<const std::uint8_t> Plane, std::vector<std::uint8_t>& Scratch, std::vector<std::byte>& Out )
+    {
+        std::array<std::uint32_t,256> Counts{};
+        for( const std::uint8_t Symbol : Plane ) ++Counts[Symbol];
+
+        const auto                    Freq = NormalizeFrequencies( Counts, Plane.size() );
+        std::array<std::uint32_t,256> Start;
+        std::exclusive_scan( Freq.begin(), Freq.end(), Start.begin(), 0u );
+
+        // rANS codes backwards, the bytes get reversed at the end so the decoder reads them forward.
+        // Two coders take turns so the decoder has two independent dependency chains.
+        Scratch.clear();
+        std::array<std::uint32_t,2> X{ rans_low_v, rans_low_v };
+        for( std::size_t i = Plane.size(); i--; )
+        {
+            std::uint32_t&      State = X[ i & 1 ];
+            const std::uint32_t F     = Freq[ Plane[i] ];
+            const std::uint32_t XMax  = ( ( rans_low_v >> scale_bits_v ) << 8 ) * F;
+            while( State >= XMax )
+            {
+                Scratch.push_back( static_cast<std::uint8_t>( State ) );
+                State >>= 8;
+            }
+            State = ( ( State / F ) << scale_bits_v ) + ( State % F ) + Start[ Plane[i] ];
+        }
+        for( std::int32_t i = 0; i < 4; ++i, X[1] >>= 8 ) Scratch.push_back( static_cast<std::uint8_t>( X[1] ) );
+        for( std::int32_t i = 0; i < 4; ++i, X[0] >>= 8 ) Scratch.push_back( static_cast<std::uint8_t>( X[0] ) );
+        std::reverse( Scratch.begin(), Scratch.end() );
+
+        std::array<std::uint8_t,32> Used{};
+        std::size_t                 nUsed = 0;
+        for( std::size_t s = 0; s < Counts.size(); ++s )
+        {
+            if( Counts[s] == 0 ) continue;
+            Used[s >> 3] |= static_cast<std::uint8_t>( 1u << ( s & 7 ) );
+            ++nUsed;
+        }
+
+        if( Used.size() + nUsed * sizeof(std::uint16_t) + sizeof(std::uint32_t) + Scratch.size() >= Plane.size() )
+        {
+            Out.push_back( std::byte{ plane_raw_v } );
+            Out.insert( Out.end(), reinterpret_cast<const std::byte*>( Plane.data() ), reinterpret_cast<const std::byte*>( Plane.data() + Plane.size() ) );
+            return;
+        }
+
+        Out.push_back( std::byte{ plane_rans_v } );
+        Out.insert( Out.end(), reinterpret_cast<const std::byte*>( Used.data() ), reinterpret_cast<const std::byte*>( Used.data() + Used.size() ) );
+        for( std::size_t s = 0; s < Counts.size(); ++s )
+            if( Counts[s] ) Write( Out, static_cast<std::uint16_t>( Freq[s] ) );
+        Write( Out, static_cast<std::uint32_t>( Scratch.size() ) );
+        Out.insert( Out.end(), reinterpret_cast<const std::byte*>( Scratch.data() ), reinterpret_cast<const std::byte*>( Scratch.data() + Scratch.size() ) );
+    }
+
+    //--------------------------------------------------------------------------
+    // Decodes nElements bytes into pOut, one every ElementSize bytes
+
+    inline void DecodePlane( cursor& Cursor, std::size_t nElements, std::size_t ElementSize, std::byte* pOut )
+    {
+        const auto Mode = Cursor.Read<std::uint8_t>();
+        if( Mode == plane_raw_v )
+        {
+            const std::byte* pData = Cursor.Take( nElements );
+            for( std::size_t i = 0; i < nElements; ++i ) pOut[ i * ElementSize ] = pData[i];
+            return;
+        }
+
+        if( Mode != plane_rans_v )
+            throw(std::runtime_error( "The chunk file has a corrupted compressed chunk" ));
+
+        // One entry per slot so decoding a symbol is a single lookup
+        struct slot
+        {
+            std::uint16_t   m_Freq;
+            std::uint16_t   m_Bias;         // Slot - Start of the symbol
+            std::uint8_t    m_Symbol;
+        };
+
+        const std::byte*            pUsed = Cursor.Take( 32 );
+        std::array<slot,scale_v>    Slots;
+        std::uint32_t               Sum   = 0;
+        std::uint32_t               nUsed = 0;
+        for( std::uint32_t s = 0; s < 256; ++s )
+        {
+            if( ( std::to_integer<std::uint32_t>( pUsed[s >> 3] ) & ( 1u << ( s & 7 ) ) ) == 0 ) continue;
+
+            const std::uint32_t F = Cursor.Read<std::uint16_t>();
+            if( F == 0 || F > scale_v - Sum )
+                throw(std::runtime_error( "The chunk file has a corrupted compressed chunk" ));
+
+            for( std::uint32_t i = 0; i < F; ++i )
+                Slots[ Sum + i ] = { static_cast<std::uint16_t>( F ), static_cast<std::uint16_t>( i ), static_cast<std::uint8_t>( s ) };
+            Sum += F;
+            ++nUsed;
+        }
+
+        const auto nBytes = Cursor.Read<std::uint32_t>();
+        if( Sum != scale_v || nBytes < 8 )
+            throw(std::runtime_error( "The chunk file has a corrupted compressed chunk" ));
+
+        const auto* pData = reinterpret_cast<const std::uint8_t*>( Cursor.Take( nBytes ) );
+        const auto* pEnd  = pData + nBytes;
+
+        std::array<std::uint32_t,2> X;
+        for( auto& State : X )
+        {
+            State  = std::uint32_t{ pData[0] } << 24 | std::uint32_t{ pData[1] } << 16 | std::uint32_t{ pData[2] } << 8 | pData[3];
+            pData += 4;
+        }
+
+        // A plane with a single value (padding, high bytes of small deltas...) has nothing else to decode
+        if( nUsed == 1 )
+        {
+            for( std::size_t i = 0; i < nElements; ++i ) pOut[ i * ElementSize ] = std::byte{ Slots[0].m_Symbol };
+        }
+        else for( std::size_t i = 0; i < nElements; ++i )
+        {
+            std::uint32_t&  State = X[ i & 1 ];
+            const slot      Slot  = Slots[ State & ( scale_v - 1 ) ];
+
+            State = Slot.m_Freq * ( State >> scale_bits_v ) + Slot.m_Bias;
+            while( State < rans_low_v )
+            {
+                if( pData == pEnd ) throw(std::runtime_error( "The chunk file has a corrupted compressed chunk" ));
+                State = ( State << 8 ) | *pData++;
+            }
+
+            pOut[ i * ElementSize ] = std::byte{ Slot.m_Symbol };
+        }
+
+        // The encoder started from rans_low_v so a good stream ends there with all its bytes used
+        if( X[0] != rans_low_v || X[1] != rans_low_v || pData != pEnd )
+            throw(std::runtime_error( "The chunk file has a corrupted compressed chunk" ));
+    }
+
+    //--------------------------------------------------------------------------
+
+    inline std::size_t ElementsPerBlock( std::size_t ElementSize, std::uint32_t Stride ) noexcept
+    {
+        // Big enough for the deltas to have something to look back at
+        return std::max<std::size_t>( { 1, block_size_v / ElementSize, std::size_t{ Stride } * 16 } );
+    }
+}
+
+//--------------------------------------------------------------------------
+
+void EncodeChunk( chunk_encoding Encoding, std::uint32_t Stride, std::span<const std::byte> Data, std::size_t ElementSize, std::vector<std::byte>& Packed )
+{
+    if( Encoding == chunk_encoding::RAW || static_cast<std::uint32_t>( Encoding ) >= chunk_encoding_count_v || ElementSize == 0 || ( Encoding == chunk_encoding::DELTA && Stride == 0 ) )
+        throw(std::runtime_error( "Invalid chunk encoding" ));
+
+    const std::size_t nElements = Data.size() / ElementSize;
+    const std::size_t nPerBlock = codec::ElementsPerBlock( ElementSize, Stride );
+    const std::size_t nBlocks   = ( nElements + nPerBlock - 1 ) / nPerBlock;
+
+    if( nPerBlock > std::numeric_limits<std::uint32_t>::max() || nBlocks > std::numeric_limits<std::uint32_t>::max() )
+        throw(std::runtime_error( "The chunk is too big to be compressed" ));
+
+    //
+    // Every block is coded on its own
+    //
+    std::vector<std::vector<std::byte>> Blocks( nBlocks );
+    ParallelFor( nBlocks, 1, [&]( std::size_t iBegin, std::size_t iEnd )
+    {
+        std::vector<std::byte>      Work;
+        std::vector<std::uint8_t>   Plane;
+        std::vector<std::uint8_t>   Scratch;
+
+        for( std::size_t iBlock = iBegin; iBlock < iEnd; ++iBlock )
+        {
+            const std::size_t nBlockElements = std::min( nPerBlock, nElements - iBlock * nPerBlock );
+            const auto        Block          = Data.subspan( iBlock * nPerBlock * ElementSize, nBlockElements * ElementSize );
+
+            Work.assign( Block.begin(), Block.end() );
+            if( Encoding == chunk_encoding::DELTA )
+            {
+                if( ElementSize % 4 == 0 ) codec::DeltaEncode<std::uint32_t>( Work, Stride * ElementSize );
+                else                       codec::DeltaEncode<std::uint8_t> ( Work, Stride * ElementSize );
+            }
+
+            Plane.resize( nBlockElements );
+            for( std::size_t k = 0; k < ElementSize; ++k )
+            {
+                for( std::size_t i = 0; i < nBlockElements; ++i ) Plane[i] = std::to_integer<std::uint8_t>( Work[ i * ElementSize + k ] );
+                codec::EncodePlane( Plane, Scratch, Blocks[iBlock] );
+            }
+        }
+    });
+
+    //
+    // Put them together
+    //
+    Packed.clear();
+    codec::Write( Packed, static_cast<std::uint32_t>( nPerBlock ) );
+    codec::Write( Packed, static_cast<std::uint32_t>( nBlocks ) );
+    for( const auto& Block : Blocks ) codec::Write( Packed, static_cast<std::uint32_t>( Block.size() ) );
+    for( const auto& Block : Blocks ) Packed.insert( Packed.end(), Block.begin(), Block.end() );
+}
+
+//--------------------------------------------------------------------------
+
+packed_chunk ParsePackedChunk( std::span<const std::byte> Packed, std::size_t nElements )
+{
+    codec::cursor     Cursor{ Packed.data(), Packed.data() + Packed.size() };
+    const std::size_t nPerBlock = Cursor.Read<std::uint32_t>();
+    const std::size_t nBlocks   = Cursor.Read<std::uint32_t>();
+
+    if( nPerBlock == 0 || nBlocks != ( nElements + nPerBlock - 1 ) / nPerBlock )
+        throw(std::runtime_error( "The chunk file has a corrupted compressed chunk" ));
+
+    packed_chunk                Chunk{ nPerBlock, std::vector<std::span<const std::byte>>( nBlocks ) };
+    std::vector<std::uint32_t>  Sizes( nBlocks );
+    for( auto& Size : Sizes ) Size = Cursor.Read<std::uint32_t>();
+    for( std::size_t i = 0; i < nBlocks; ++i ) Chunk.m_Blocks[i] = { Cursor.Take( Sizes[i] ), Sizes[i] };
+
+    return Chunk;
+}
+
+//--------------------------------------------------------------------------
+
+void DecodeChunkBlock( chunk_encoding Encoding, std::uint32_t Stride, std::span<const std::byte> Block, std::size_t ElementSize, std::span<std::byte> Data )
+{
+    if( Encoding == chunk_encoding::RAW || static_cast<std::uint32_t>( Encoding ) >= chunk_encoding_count_v || ElementSize == 0 || ( Encoding == chunk_encoding::DELTA && Stride == 0 ) )
+        throw(std::runtime_error( "The chunk file has a chunk with an unknown encoding" ));
+
+    const std::size_t nElements = Data.size() / ElementSize;
+    codec::cursor     Cursor{ Block.data(), Block.data() + Block.size() };
+    for( std::size_t k = 0; k < ElementSize; ++k )
+        codec::DecodePlane( Cursor, nElements, ElementSize, Data.data() + k );
+
+    if( Cursor.m_pData != Cursor.m_pEnd )
+        throw(std::runtime_error( "The chunk file has a corrupted compressed chunk" ));
+
+    if( Encoding == chunk_encoding::DELTA )
+    {
+        if( ElementSize % 4 == 0 ) codec::DeltaDecode<std::uint32_t>( Data, Stride * ElementSize );
+        else                       codec::DeltaDecode<std::uint8_t> ( Data, Stride * ElementSize );
+    }
+}
+
+//--------------------------------------------------------------------------
+
+void DecodeChunk( chunk_encoding Encoding, std::uint32_t Stride, std::span<const std::byte> Packed, std::size_t ElementSize, std::span<std::byte> Data )
+{
+    if( ElementSize == 0 )
+        throw(std::runtime_error( "The chunk file has a chunk with an unknown encoding" ));
+
+    const std::size_t   nElements = Data.size() / ElementSize;
+    const packed_chunk  Chunk     = ParsePackedChunk( Packed, nElements );
+
+    ParallelFor( Chunk.m_Blocks.size(), 1, [&]( std::size_t iBegin, std::size_t iEnd )
+    {
+        for( std::size_t iBlock = iBegin; iBlock < iEnd; ++iBlock )
+        {
+            const std::size_t nBlockElements = std::min( Chunk.m_nPerBlock, nElements - iBlock * Chunk.m_nPerBlock );
+            DecodeChunkBlock( Encoding, Stride, Chunk.m_Blocks[iBlock], ElementSize, Data.subspan( iBlock * Chunk.m_nPerBlock * ElementSize, nBlockElements * ElementSize ) );
+        }
+    });
+}
+
+} // namespace xraw3d::details
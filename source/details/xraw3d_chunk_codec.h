@@ -0,0 +1,59 @@
+#ifndef XRAW3D_CHUNK_CODEC_H
+#define XRAW3D_CHUNK_CODEC_H
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace xraw3d::details
+{
+    // How a chunk is stored in a chunk file, it goes in chunk_entry::m_Flags. The encodings are lossless
+    // and split the chunk in blocks that are coded on their own so they can be decoded by all the cores.
+    // Inside a block every byte of the element is a separate stream (byte plane) with its own rANS model,
+    // so the bytes that barely change (high bytes of indices, exponents of floats) cost almost nothing.
+    enum class chunk_encoding : std::uint32_t
+    { RAW           = 0     // The elements as they are in memory
+    , ENTROPY       = 1     // Byte planes + rANS, for records and strings
+    , DELTA         = 2     // Every element minus the one Stride elements before, in 32 bit lanes (8 bit lanes when
+                            // the element size is not a multiple of 4), zigzag coded, then as ENTROPY
+    };
+
+    constexpr std::uint32_t chunk_encoding_count_v = 3;
+
+    // Largest decoded size / packed size of a chunk. Chunks that would go past it are stored raw,
+    // which lets a reader bound what it allocates for a chunk by its size in the file.
+    constexpr std::uint64_t chunk_max_ratio_v = 1u << 16;
+
+    // Where the blocks of a compressed chunk are, every block holds m_nPerBlock elements (the last one
+    // may have less) and decodes on its own, so a reader that needs a few elements only decodes their blocks
+    struct packed_chunk
+    {
+        std::size_t                                 m_nPerBlock;
+        std::vector<std::span<const std::byte>>     m_Blocks;
+    };
+
+    void EncodeChunk                ( chunk_encoding                Encoding
+                                    , std::uint32_t                 Stride
+                                    , std::span<const std::byte>    Data
+                                    , std::size_t                   ElementSize
+                                    , std::vector<std::byte>&       Packed
+                                    );
+    void DecodeChunk                ( chunk_encoding                Encoding
+                                    , std::uint32_t                 Stride
+                                    , std::span<const std::byte>    Packed
+                                    , std::size_t                   ElementSize
+                                    , std::span<std::byte>          Data            // Already sized to the decoded chunk
+                                    );
+    packed_chunk ParsePackedChunk   ( std::span<const std::byte>    Packed
+                                    , std::size_t                   nElements
+                                    );
+    void DecodeChunkBlock           ( chunk_encoding                Encoding
+                                    , std::uint32_t                 Stride
+                                    , std::span<const std::byte>    Block
+                                    , std::size_t                   ElementSize
+                                    , std::span<std::byte>          Data            // The elements of the block
+                                    );
+}
+
+#endif
@@ -0,0 +1,477 @@
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+
+#if defined(_WIN32)
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace xraw3d::details {
+
+//--------------------------------------------------------------------------
+
+// Path for the error messages, path::string() throws in windows when the name is not in the code page
+inline std::string PathToString( const std::filesystem::path& Path )
+{
+    const auto Name = Path.generic_u8string();
+    return { reinterpret_cast<const char*>( Name.data() ), Name.size() };
+}
+
+//--------------------------------------------------------------------------
+
+void mapped_file::Open( std::wstring_view FileName )
+{
+    Close();
+
+    const std::filesystem::path Path{ FileName };
+
+#if defined(_WIN32)
+    HANDLE hFile = CreateFileW( Path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+    if( hFile == INVALID_HANDLE_VALUE )
+        throw(std::runtime_error( std::format( "Unable to open the file {}", PathToString( Path ) ) ));
+
+    LARGE_INTEGER Size;
+    if( GetFileSizeEx( hFile, &Size ) == FALSE )
+    {
+        CloseHandle( hFile );
+        throw(std::runtime_error( std::format( "Unable to get the size of the file {}", PathToString( Path ) ) ));
+    }
+
+    m_hFile = hFile;
+    m_Size  = static_cast<std::size_t>( Size.QuadPart );
+    if( m_Size == 0 ) return;
+
+    m_hMapping = CreateFileMappingW( hFile, nullptr, PAGE_READONLY, 0, 0, nullptr );
+    if( m_hMapping ) m_pData = static_cast<const std::byte*>( MapViewOfFile( m_hMapping, FILE_MAP_READ, 0, 0, 0 ) );
+#else
+    const int Handle = open( Path.c_str(), O_RDONLY );
+    if( Handle == -1 )
+        throw(std::runtime_error( std::format( "Unable to open the file {}", PathToString( Path ) ) ));
+
+    struct stat Stat;
+    if( fstat( Handle, &Stat ) != 0 )
+    {
+        close( Handle );
+        throw(std::runtime_error( std::format( "Unable to get the size of the file {}", PathToString( Path ) ) ));
+    }
+
+    m_Size = static_cast<std::size_t>( Stat.st_size );
+    if( m_Size == 0 )
+    {
+        close( Handle );
+        return;
+    }
+
+    // The mapping keeps the file alive so the handle is no longer needed
+    void* pData = mmap( nullptr, m_Size, PROT_READ, MAP_PRIVATE, Handle, 0 );
+    close( Handle );
+    if( pData != MAP_FAILED ) m_pData = static_cast<const std::byte*>( pData );
+#endif
+
+    if( m_pData == nullptr )
+    {
+        Close();
+        throw(std::runtime_error( std::format( "Unable to map the file {}", PathToString( Path ) ) ));
+    }
+}
+
+//--------------------------------------------------------------------------
+
+void mapped_file::Close( void ) noexcept
+{
+#if defined(_WIN32)
+    if( m_pData    ) UnmapViewOfFile( m_pData );
+    if( m_hMapping ) CloseHandle( m_hMapping );
+    if( m_hFile    ) CloseHandle( m_hFile );
+#else
+    if( m_pData    ) munmap( const_cast<std::byte*>( m_pData ), m_Size );
+#endif
+
+    m_pData     = nullptr;
+    m_Size      = 0;
+    m_hFile     = nullptr;
+    m_hMapping  = nullptr;
+}
+
+//--------------------------------------------------------------------------
+
+template< typename T >
+void chunk_writer::Add( std::uint32_t ID, std::span<const T> Data, chunk_encoding Encoding, std::uint32_t Stride )
+{
+    static_assert( std::is_trivially_copyable_v<T> );
+
+    chunk& Chunk = m_Chunks.emplace_back();
+    Chunk.m_Entry               = chunk_entry{};
+    Chunk.m_Entry.m_ID          = ID;
+    Chunk.m_Entry.m_ElementSize = sizeof(T);
+    Chunk.m_Entry.m_Flags       = static_cast<std::uint32_t>( Encoding );
+    Chunk.m_Entry.m_Param       = Stride;
+    Chunk.m_Entry.m_Count       = Data.size();
+    Chunk.m_Entry.m_Size        = Data.size_bytes();
+    Chunk.m_pData               = reinterpret_cast<const std::byte*>( Data.data() );
+}
+
+//--------------------------------------------------------------------------
+
+template< typename T >
+void chunk_writer::Add( std::uint32_t ID, std::vector<T>&& Data, chunk_encoding Encoding, std::uint32_t Stride )
+{
+    static_assert( std::is_trivially_copyable_v<T> );
+
+    chunk& Chunk = m_Chunks.emplace_back();
+    Chunk.m_Entry               = chunk_entry{};
+    Chunk.m_Entry.m_ID          = ID;
+    Chunk.m_Entry.m_ElementSize = sizeof(T);
+    Chunk.m_Entry.m_Flags       = static_cast<std::uint32_t>( Encoding );
+    Chunk.m_Entry.m_Param       = Stride;
+    Chunk.m_Entry.m_Count       = Data.size();
+    Chunk.m_Entry.m_Size        = Data.size() * sizeof(T);
+    Chunk.m_Owned.resize( Chunk.m_Entry.m_Size );
+    if( Data.empty() == false ) std::memcpy( Chunk.m_Owned.data(), Data.data(), Chunk.m_Entry.m_Size );
+    Chunk.m_pData               = nullptr;
+}
+
+//--------------------------------------------------------------------------
+
+chunk_string chunk_writer::AddString( std::string_view String )
+{
+    if( m_Strings.size() + String.size() > std::numeric_limits<std::uint32_t>::max() )
+        throw(std::runtime_error( "Too many strings for a chunk file" ));
+
+    const chunk_string Ref{ static_cast<std::uint32_t>( m_Strings.size() ), static_cast<std::uint32_t>( String.size() ) };
+    m_Strings.insert( m_Strings.end(), String.begin(), String.end() );
+    return Ref;
+}
+
+//--------------------------------------------------------------------------
+
+void chunk_writer::Save( std::wstring_view FileName, std::uint32_t Type )
+{
+    auto Align = []( std::uint64_t Offset ) { return ( Offset + chunk_align_v - 1 ) & ~( chunk_align_v - 1 ); };
+
+    //
+    // The entries that go in the file are worked out here so the chunks stay as they were added and
+    // Save can be called again. The strings go in one more chunk at the end
+    //
+    const std::size_t                   nChunks = m_Chunks.size() + 1;
+    std::vector<chunk_entry>            Entries ( nChunks );
+    std::vector<const std::byte*>       Data    ( nChunks );
+    std::vector<std::vector<std::byte>> Packed  ( nChunks );
+
+    for( std::size_t i = 0; i < m_Chunks.size(); ++i )
+    {
+        Entries[i] = m_Chunks[i].m_Entry;
+        Data[i]    = m_Chunks[i].m_Owned.empty() ? m_Chunks[i].m_pData : m_Chunks[i].m_Owned.data();
+    }
+
+    Entries.back()               = chunk_entry{};
+    Entries.back().m_ID          = chunk_strings_id_v;
+    Entries.back().m_ElementSize = sizeof(char);
+    Entries.back().m_Flags       = static_cast<std::uint32_t>( chunk_encoding::ENTROPY );
+    Entries.back().m_Param       = 1;
+    Entries.back().m_Count       = m_Strings.size();
+    Entries.back().m_Size        = m_Strings.size();
+    Data.back()                  = reinterpret_cast<const std::byte*>( m_Strings.data() );
+
+    //
+    // Compress the chunks, the ones that do not get smaller are stored raw
+    //
+    for( std::size_t i = 0; i < nChunks; ++i )
+    {
+        chunk_entry& Entry = Entries[i];
+
+        if( m_bCompress && Entry.m_Flags && Entry.m_Size )
+        {
+            EncodeChunk( static_cast<chunk_encoding>( Entry.m_Flags ), Entry.m_Param, { Data[i], static_cast<std::size_t>( Entry.m_Size ) }, Entry.m_ElementSize, Packed[i] );
+
+            if( Packed[i].size() < Entry.m_Size && Entry.m_Size <= Packed[i].size() * chunk_max_ratio_v )
+            {
+                Entry.m_Size = Packed[i].size();
+                Data[i]      = Packed[i].data();
+                continue;
+            }
+        }
+
+        Entry.m_Flags = static_cast<std::uint32_t>( chunk_encoding::RAW );
+        Entry.m_Param = 0;
+        std::vector<std::byte>().swap( Packed[i] );
+    }
+
+    //
+    // Lay out the file
+    //
+    chunk_file_header Header{};
+    Header.m_Magic      = chunk_file_header::magic_v;
+    Header.m_Version    = chunk_file_header::version_v;
+    Header.m_ByteOrder  = chunk_file_header::byte_order_v;
+    Header.m_Type       = Type;
+    Header.m_nChunks    = static_cast<std::uint32_t>( nChunks );
+
+    std::uint64_t Offset = sizeof(chunk_file_header) + nChunks * sizeof(chunk_entry);
+    for( chunk_entry& Entry : Entries )
+    {
+        Offset          = Align( Offset );
+        Entry.m_Offset  = Offset;
+        Offset         += Entry.m_Size;
+    }
+    Header.m_FileSize = Offset;
+
+    //
+    // Write it
+    //
+    const std::filesystem::path Path{ FileName };
+    std::ofstream               File( Path, std::ios::binary | std::ios::trunc );
+    if( File.is_open() == false )
+        throw(std::runtime_error( std::format( "Unable to open the file {} for writing", PathToString( Path ) ) ));
+
+    File.write( reinterpret_cast<const char*>( &Header ), sizeof(Header) );
+    File.write( reinterpret_cast<const char*>( Entries.data() ), static_cast<std::streamsize>( nChunks * sizeof(chunk_entry) ) );
+
+    static constexpr std::array<char, chunk_align_v> zeros_v{};
+    std::uint64_t Position = sizeof(chunk_file_header) + nChunks * sizeof(chunk_entry);
+    for( std::size_t i = 0; i < nChunks; ++i )
+    {
+        const chunk_entry& Entry = Entries[i];
+        File.write( zeros_v.data(), static_cast<std::streamsize>( Entry.m_Offset - Position ) );
+        if( Entry.m_Size ) File.write( reinterpret_cast<const char*>( Data[i] ), static_cast<std::streamsize>( Entry.m_Size ) );
+        Position = Entry.m_Offset + Entry.m_Size;
+    }
+
+    if( File.good() == false )
+        throw(std::runtime_error( std::format( "Failed to write the file {}", PathToString( Path ) ) ));
+}
+
+//--------------------------------------------------------------------------
+
+bool chunk_reader::isChunkFile( std::wstring_view FileName )
+{
+    std::ifstream File( std::filesystem::path{ FileName }, std::ios::binary );
+    if( File.is_open() == false ) return false;
+
+    std::uint32_t Magic = 0;
+    File.read( reinterpret_cast<char*>( &Magic ), sizeof(Magic) );
+    return File.good() && Magic == chunk_file_header::magic_v;
+}
+
+//--------------------------------------------------------------------------
+
+void chunk_reader::Open( std::wstring_view FileName, std::uint32_t Type )
+{
+    m_Decoded.clear();
+    m_File.Open( FileName );
+
+    if( m_File.size() < sizeof(chunk_file_header) )
+        throw(std::runtime_error( "The file is too small to be a chunk file" ));
+
+    chunk_file_header Header;
+    std::memcpy( &Header, m_File.data(), sizeof(Header) );
+
+    if( Header.m_Magic     != chunk_file_header::magic_v      ) throw(std::runtime_error( "The file is not a chunk file" ));
+    if( Header.m_ByteOrder != chunk_file_header::byte_order_v ) throw(std::runtime_error( "The chunk file was written with a different byte order" ));
+    if( Header.m_Version   != chunk_file_header::version_v    ) throw(std::runtime_error( std::format( "Unsupported chunk file version {}", Header.m_Version ) ));
+    if( Header.m_Type      != Type                            ) throw(std::runtime_error( "The chunk file holds a different type of data" ));
+    if( Header.m_FileSize  != m_File.size()                   ) throw(std::runtime_error( "The chunk file is truncated" ));
+
+    if( ( m_File.size() - sizeof(chunk_file_header) ) / sizeof(chunk_entry) < Header.m_nChunks )
+        throw(std::runtime_error( "The chunk file is truncated" ));
+
+    m_Entries = { reinterpret_cast<const chunk_entry*>( m_File.data() + sizeof(chunk_file_header) ), Header.m_nChunks };
+    m_Decoded.resize( m_Entries.size() );
+
+    for( const chunk_entry& Entry : m_Entries )
+    {
+        if( Entry.m_Offset % chunk_align_v
+         || Entry.m_Offset > m_File.size()
+         || Entry.m_Size   > m_File.size() - Entry.m_Offset
+         || Entry.m_ElementSize == 0
+         || ( Entry.m_Flags == 0 && ( Entry.m_Count > Entry.m_Size / Entry.m_ElementSize || Entry.m_Size != Entry.m_Count * Entry.m_ElementSize ) )
+         || ( Entry.m_Flags != 0 && ( Entry.m_Flags >= chunk_encoding_count_v || Entry.m_Count > Entry.m_Size * chunk_max_ratio_v / Entry.m_ElementSize ) ) )
+            throw(std::runtime_error( "The chunk file has a corrupted table of contents" ));
+    }
+
+    const auto Strings = get<char>( chunk_strings_id_v );
+    m_Strings = { Strings.data(), Strings.size() };
+}
+
+//--------------------------------------------------------------------------
+
+const chunk_entry* chunk_reader::find( std::uint32_t ID ) const noexcept
+{
+    for( const chunk_entry& Entry : m_Entries )
+        if( Entry.m_ID == ID ) return &Entry;
+    return nullptr;
+}
+
+//--------------------------------------------------------------------------
+
+template< typename T >
+const chunk_entry* chunk_reader::findElements( std::uint32_t ID ) const
+{
+    static_assert( std::is_trivially_copyable_v<T> );
+
+    const chunk_entry* pEntry = find( ID );
+    if( pEntry && pEntry->m_ElementSize != sizeof(T) )
+        throw(std::runtime_error( "The chunk file was written with a different data layout" ));
+
+    return pEntry;
+}
+
+//--------------------------------------------------------------------------
+
+template< typename T >
+std::span<const T> chunk_reader::get( std::uint32_t ID ) const
+{
+    const chunk_entry* pEntry = findElements<T>( ID );
+    if( pEntry == nullptr ) return {};
+
+    return { reinterpret_cast<const T*>( getData( *pEntry, {}, true ) ), static_cast<std::size_t>( pEntry->m_Count ) };
+}
+
+//--------------------------------------------------------------------------
+
+template< typename T >
+std::span<const T> chunk_reader::get( std::uint32_t ID, std::span<const element_range> Ranges ) const
+{
+    const chunk_entry* pEntry = findElements<T>( ID );
+    if( pEntry == nullptr ) return {};
+
+    return { reinterpret_cast<const T*>( getData( *pEntry, Ranges, false ) ), static_cast<std::size_t>( pEntry->m_Count ) };
+}
+
+//--------------------------------------------------------------------------
+
+void chunk_reader::Prefetch( std::span<const std::uint32_t> IDs, std::span<const element_range> Ranges ) const
+{
+    std::vector<const chunk_entry*> Entries;
+    for( const std::uint32_t ID : IDs )
+        if( const chunk_entry* pEntry = find( ID ); pEntry && std::find( Entries.begin(), Entries.end(), pEntry ) == Entries.end() ) Entries.push_back( pEntry );
+
+    Decode( Entries, Ranges, false );
+}
+
+//--------------------------------------------------------------------------
+
+void chunk_reader::PrefetchAll( void ) const
+{
+    std::vector<const chunk_entry*> Entries;
+    for( const chunk_entry& Entry : m_Entries ) Entries.push_back( &Entry );
+
+    Decode( Entries, {}, true );
+}
+
+//--------------------------------------------------------------------------
+
+void chunk_reader::Decode( std::span<const chunk_entry* const> Entries, std::span<const element_range> Ranges, bool bWhole ) const
+{
+    for( const chunk_entry* pEntry : Entries )
+        for( const element_range& Range : Ranges )
+            if( bWhole == false && ( Range.m_iBegin > Range.m_iEnd || Range.m_iEnd > pEntry->m_Count ) )
+                throw(std::runtime_error( "The chunk file has a corrupted table of contents" ));
+
+    // The decoded blocks are shared by every caller, one decode at a time (each one runs on all the cores)
+    std::scoped_lock Lock( m_DecodeLock );
+
+    //
+    // The blocks that hold the ranges and are not decoded yet, from all the chunks
+    //
+    struct job
+    {
+        const chunk_entry*      m_pEntry;
+        decoded_chunk*          m_pDecoded;
+        std::size_t             m_iBlock;
+    };
+
+    std::vector<job> Jobs;
+    for( const chunk_entry* pEntry : Entries )
+    {
+        if( pEntry->m_Flags == static_cast<std::uint32_t>( chunk_encoding::RAW ) ) continue;
+
+        const std::size_t nElements = static_cast<std::size_t>( pEntry->m_Count );
+        decoded_chunk&    Decoded   = m_Decoded[ pEntry - m_Entries.data() ];
+        if( Decoded.m_pData == nullptr )
+        {
+            Decoded.m_Packed  = ParsePackedChunk( { m_File.data() + pEntry->m_Offset, static_cast<std::size_t>( pEntry->m_Size ) }, nElements );
+            Decoded.m_pData   = std::make_unique_for_overwrite<std::byte[]>( nElements * pEntry->m_ElementSize );
+            Decoded.m_bDecoded.assign( Decoded.m_Packed.m_Blocks.size(), false );
+        }
+
+        // The ranges are sorted so a block is only listed once
+        const element_range     All{ 0, pEntry->m_Count };
+        const std::size_t       nPerBlock = Decoded.m_Packed.m_nPerBlock;
+        const std::size_t       iFirstJob = Jobs.size();
+        for( const element_range& Range : bWhole ? std::span<const element_range>{ &All, 1 } : Ranges )
+        {
+            if( Range.m_iBegin == Range.m_iEnd ) continue;
+
+            for( std::size_t iBlock = static_cast<std::size_t>( Range.m_iBegin / nPerBlock ), iLast = static_cast<std::size_t>( ( Range.m_iEnd - 1 ) / nPerBlock ); iBlock <= iLast; ++iBlock )
+            {
+                if( Decoded.m_bDecoded[iBlock] || ( Jobs.size() > iFirstJob && Jobs.back().m_iBlock >= iBlock ) ) continue;
+                Jobs.push_back( { pEntry, &Decoded, iBlock } );
+            }
+        }
+    }
+
+    ParallelFor( Jobs.size(), 1, [&]( std::size_t iBegin, std::size_t iEnd )
+    {
+        for( std::size_t i = iBegin; i < iEnd; ++i )
+        {
+            const chunk_entry&  Entry          = *Jobs[i].m_pEntry;
+            decoded_chunk&      Decoded        = *Jobs[i].m_pDecoded;
+            const std::size_t   nPerBlock      = Decoded.m_Packed.m_nPerBlock;
+            const std::size_t   iBlock         = Jobs[i].m_iBlock;
+            const std::size_t   nBlockElements = std::min( nPerBlock, static_cast<std::size_t>( Entry.m_Count ) - iBlock * nPerBlock );
+
+            DecodeChunkBlock( static_cast<chunk_encoding>( Entry.m_Flags ), Entry.m_Param, Decoded.m_Packed.m_Blocks[iBlock], Entry.m_ElementSize
+                            , { Decoded.m_pData.get() + iBlock * nPerBlock * Entry.m_ElementSize, nBlockElements * Entry.m_ElementSize } );
+        }
+    });
+
+    for( const job& Job : Jobs ) Job.m_pDecoded->m_bDecoded[ Job.m_iBlock ] = true;
+}
+
+//--------------------------------------------------------------------------
+
+const std::byte* chunk_reader::getData( const chunk_entry& Entry, std::span<const element_range> Ranges, bool bWhole ) const
+{
+    const chunk_entry* pEntry = &Entry;
+    Decode( { &pEntry, 1 }, Ranges, bWhole );
+
+    if( Entry.m_Flags == static_cast<std::uint32_t>( chunk_encoding::RAW ) ) return m_File.data() + Entry.m_Offset;
+
+    std::scoped_lock Lock( m_DecodeLock );
+    return m_Decoded[ &Entry - m_Entries.data() ].m_pData.get();
+}
+
+//--------------------------------------------------------------------------
+
+template< typename T >
+void chunk_reader::Read( std::uint32_t ID, std::vector<T>& Data ) const
+{
+    const auto Chunk = get<T>( ID );
+    Data.resize( Chunk.size() );
+    if( Chunk.empty() == false ) std::memcpy( Data.data(), Chunk.data(), Chunk.size_bytes() );
+}
+
+//--------------------------------------------------------------------------
+
+std::string chunk_reader::getString( const chunk_string& String ) const
+{
+    if( String.m_Offset > m_Strings.size() || String.m_Length > m_Strings.size() - String.m_Offset )
+        throw(std::runtime_error( "The chunk file has a corrupted string" ));
+
+    return std::string( m_Strings.data() + String.m_Offset, String.m_Length );
+}
+
+} // namespace xraw3d::details
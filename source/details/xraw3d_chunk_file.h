@@ -0,0 +1,221 @@
+#ifndef XRAW3D_CHUNK_FILE_H
+#define XRAW3D_CHUNK_FILE_H
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace xraw3d::details
+{
+    // Four character code of a chunk, the first character goes in the lowest byte
+    constexpr std::uint32_t MakeChunkID( const char (&Code)[5] ) noexcept
+    {
+        return static_cast<std::uint32_t>( static_cast<unsigned char>(Code[0]) )
+             | static_cast<std::uint32_t>( static_cast<unsigned char>(Code[1]) ) << 8
+             | static_cast<std::uint32_t>( static_cast<unsigned char>(Code[2]) ) << 16
+             | static_cast<std::uint32_t>( static_cast<unsigned char>(Code[3]) ) << 24;
+    }
+
+    // ID of the channel iChannel of a family of chunks such "VUV0", "VUV1", ...
+    constexpr std::uint32_t MakeChannelChunkID( std::uint32_t BaseID, std::int32_t iChannel ) noexcept
+    {
+        return BaseID + ( static_cast<std::uint32_t>(iChannel) << 24 );
+    }
+
+    // Chunked binary container used by geom and anim. A file is a chunk_file_header, the table of
+    // contents (one chunk_entry per chunk) and then the chunks. Every chunk is an array of fixed size
+    // elements that starts at a chunk_align_v boundary so it can be used in place from a mapped file.
+    // Everything is stored in native byte order and every entry records the size of its elements,
+    // so a file written by a build with a different struct layout is rejected instead of misread.
+    // Chunks may be compressed (see chunk_encoding), m_Size is then the packed size.
+    struct chunk_file_header
+    {
+        static constexpr std::uint32_t  magic_v         = MakeChunkID( "XR3D" );
+        static constexpr std::uint16_t  version_v       = 1;
+        static constexpr std::uint16_t  byte_order_v    = 0x0102;
+
+        std::uint32_t                                       m_Magic;
+        std::uint16_t                                       m_Version;
+        std::uint16_t                                       m_ByteOrder;
+        std::uint32_t                                       m_Type;         // What the file holds, ex: MakeChunkID("GEOM")
+        std::uint32_t                                       m_nChunks;
+        std::uint64_t                                       m_FileSize;
+    };
+
+    struct chunk_entry
+    {
+        std::uint32_t                                       m_ID;
+        std::uint32_t                                       m_ElementSize;
+        std::uint32_t                                       m_Flags;        // chunk_encoding, 0 is a raw array
+        std::uint32_t                                       m_Param;        // Parameter of the encoding, the delta stride in elements
+        std::uint64_t                                       m_Count;        // Elements
+        std::uint64_t                                       m_Offset;       // From the start of the file
+        std::uint64_t                                       m_Size;         // Bytes stored in the file
+    };
+
+    constexpr std::uint64_t chunk_align_v = 64;
+
+    // Strings live in a single char chunk and the records point into it
+    struct chunk_string
+    {
+        std::uint32_t                                       m_Offset;
+        std::uint32_t                                       m_Length;
+    };
+
+    //--------------------------------------------------------------------------
+    // Read only view of a whole file, mapped by the OS so only the pages that are touched get read
+    //--------------------------------------------------------------------------
+    class mapped_file
+    {
+    public:
+
+                                mapped_file                 ( void ) = default;
+                                mapped_file                 ( const mapped_file& ) = delete;
+        mapped_file&            operator =                  ( const mapped_file& ) = delete;
+                               ~mapped_file                 ( void ) noexcept { Close(); }
+
+        void                    Open                        ( std::wstring_view             FileName
+                                                            );
+        void                    Close                       ( void
+                                                            ) noexcept;
+        const std::byte*        data                        ( void ) const noexcept { return m_pData; }
+        std::size_t             size                        ( void ) const noexcept { return m_Size; }
+
+    protected:
+
+        const std::byte*                                    m_pData     = nullptr;
+        std::size_t                                         m_Size      = 0;
+        void*                                               m_hFile     = nullptr;  // Only used in windows
+        void*                                               m_hMapping  = nullptr;  // Only used in windows
+    };
+
+    //--------------------------------------------------------------------------
+    // Collects the chunks of a file and writes them in one go. Add with a span only keeps a reference
+    // so the data must stay alive until Save, Add with a vector takes ownership of it. The encoding
+    // given to Add is only used when compression is on, chunks that do not shrink are stored raw.
+    // Save does not change what was added, so the same chunks can be saved more than once.
+    //--------------------------------------------------------------------------
+    class chunk_writer
+    {
+    public:
+
+        template< typename T >
+        void                    Add                         ( std::uint32_t                 ID
+                                                            , std::span<const T>            Data
+                                                            , chunk_encoding                Encoding    = chunk_encoding::ENTROPY
+                                                            , std::uint32_t                 Stride      = 1
+                                                            );
+        template< typename T >
+        void                    Add                         ( std::uint32_t                 ID
+                                                            , std::vector<T>&&              Data
+                                                            , chunk_encoding                Encoding    = chunk_encoding::ENTROPY
+                                                            , std::uint32_t                 Stride      = 1
+                                                            );
+        void                    setCompression              ( bool                          bCompress
+                                                            ) noexcept { m_bCompress = bCompress; }
+        chunk_string            AddString                   ( std::string_view              String
+                                                            );
+        void                    Save                        ( std::wstring_view             FileName
+                                                            , std::uint32_t                 Type
+                                                            );
+
+    protected:
+
+        struct chunk
+        {
+            chunk_entry                                     m_Entry;
+            const std::byte*                                m_pData;
+            std::vector<std::byte>                          m_Owned;
+        };
+
+        std::vector<chunk>                                  m_Chunks;
+        std::vector<char>                                   m_Strings;
+        bool                                                m_bCompress = false;
+    };
+
+    // Elements [m_iBegin, m_iEnd) of a chunk
+    struct element_range
+    {
+        std::uint64_t                                       m_iBegin;
+        std::uint64_t                                       m_iEnd;
+    };
+
+    //--------------------------------------------------------------------------
+    // Validates a mapped chunk file and hands out its chunks. Missing chunks read as empty. Raw chunks
+    // are used in place from the mapped file, compressed ones are decoded once and kept by the reader.
+    // Compressed chunks are decoded a block at a time (see packed_chunk), a get with ranges only decodes
+    // the blocks that hold them and only those elements of the returned span can be used.
+    // A get decodes the blocks of one chunk in parallel, Prefetch decodes the blocks of several chunks
+    // in a single parallel pass so the small chunks do not leave the cores idle. It is safe to call
+    // get and Prefetch from several threads.
+    //--------------------------------------------------------------------------
+    class chunk_reader
+    {
+    public:
+
+        static bool             isChunkFile                 ( std::wstring_view             FileName
+                                                            );
+        void                    Open                        ( std::wstring_view             FileName
+                                                            , std::uint32_t                 Type
+                                                            );
+        const chunk_entry*      find                        ( std::uint32_t                 ID
+                                                            ) const noexcept;
+        template< typename T >
+        std::span<const T>      get                         ( std::uint32_t                 ID
+                                                            ) const;
+        template< typename T >
+        std::span<const T>      get                         ( std::uint32_t                 ID
+                                                            , std::span<const element_range> Ranges     // Sorted
+                                                            ) const;
+        void                    Prefetch                    ( std::span<const std::uint32_t> IDs        // Missing chunks are skipped
+                                                            , std::span<const element_range> Ranges     // Sorted
+                                                            ) const;
+        void                    PrefetchAll                 ( void
+                                                            ) const;
+        template< typename T >
+        void                    Read                        ( std::uint32_t                 ID
+                                                            , std::vector<T>&               Data
+                                                            ) const;
+        std::string             getString                   ( const chunk_string&           String
+                                                            ) const;
+
+    protected:
+
+        struct decoded_chunk
+        {
+            std::unique_ptr<std::byte[]>                    m_pData;        // Filled one block at a time
+            packed_chunk                                    m_Packed;
+            std::vector<bool>                               m_bDecoded;     // One per block
+        };
+
+        template< typename T >
+        const chunk_entry*      findElements                ( std::uint32_t                 ID
+                                                            ) const;
+        void                    Decode                      ( std::span<const chunk_entry* const> Entries
+                                                            , std::span<const element_range> Ranges
+                                                            , bool                          bWhole      // Ignore Ranges, decode the chunks whole
+                                                            ) const;
+        const std::byte*        getData                     ( const chunk_entry&            Entry
+                                                            , std::span<const element_range> Ranges
+                                                            , bool                          bWhole
+                                                            ) const;
+
+        mapped_file                                         m_File;
+        std::span<const chunk_entry>                        m_Entries;
+        std::span<const char>                               m_Strings;
+        mutable std::vector<decoded_chunk>                  m_Decoded;      // One per entry, only used by compressed chunks
+        mutable std::mutex                                  m_DecodeLock;
+    };
+
+    constexpr std::uint32_t chunk_strings_id_v = MakeChunkID( "STRS" );
+}
+
+#endif
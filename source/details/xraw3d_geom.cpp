@@ -6,629 +6,2857 @@
 #endif
 
 #include <unordered_set>
+#include <numeric>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <chrono>
+#include <bit>
+#include <limits>
+#include <emmintrin.h>
 #include "dependencies/MikkTSpace/mikktspace.h"
 
 namespace xraw3d {
 
 //--------------------------------------------------------------------------
+// Uniform access to the vertices of a geom for both layouts (m_Vertex and m_Streams)
+// so the algorithms that must run directly on either one are only written once.
+// T is the container type and may be const, in which case only the readers can be used.
+//--------------------------------------------------------------------------
+namespace details
+{
+    template< typename T >
+    void CompactStream( std::vector<T>& Stream, std::span<const std::int32_t> Keep )
+    {
+        if( Stream.empty() ) return;
 
-void geom::Kill(void)
+        // Keep is sorted so every element moves down (or stays) and we can do it in place
+        for( std::size_t i = 0; i < Keep.size(); ++i )
+        {
+            assert( i == 0 || Keep[i] > Keep[i-1] );
+            if( static_cast<std::size_t>(Keep[i]) != i ) Stream[i] = std::move( Stream[ Keep[i] ] );
+        }
+        Stream.resize( Keep.size() );
+    }
+
+    //--------------------------------------------------------------------------
+
+    template< typename T >
+    struct vertex_array_view
+    {
+        T& m_Vertex;
+
+        std::size_t     size        ( void )                                const noexcept { return m_Vertex.size(); }
+        auto&           Position    ( std::size_t i )                       const noexcept { return m_Vertex[i].m_Position; }
+        std::int32_t    iFrame      ( std::size_t i )                       const noexcept { return m_Vertex[i].m_iFrame; }
+        std::int32_t    nWeights    ( std::size_t i )                       const noexcept { return m_Vertex[i].m_nWeights; }
+        std::int32_t    nNormals    ( std::size_t i )                       const noexcept { return m_Vertex[i].m_nNormals; }
+        std::int32_t    nTangents   ( std::size_t i )                       const noexcept { return m_Vertex[i].m_nTangents; }
+        std::int32_t    nBinormals  ( std::size_t i )                       const noexcept { return m_Vertex[i].m_nBinormals; }
+        std::int32_t    nUVs        ( std::size_t i )                       const noexcept { return m_Vertex[i].m_nUVs; }
+        std::int32_t    nColors     ( std::size_t i )                       const noexcept { return m_Vertex[i].m_nColors; }
+        auto&           Weight      ( std::size_t i, std::int32_t k )       const noexcept { return m_Vertex[i].m_Weight[k]; }
+        auto&           BTN         ( std::size_t i, std::int32_t k )       const noexcept { return m_Vertex[i].m_BTN[k]; }
+        auto&           UV          ( std::size_t i, std::int32_t k )       const noexcept { return m_Vertex[i].m_UV[k]; }
+        auto&           Color       ( std::size_t i, std::int32_t k )       const noexcept { return m_Vertex[i].m_Color[k]; }
+
+        void getVertex( std::size_t i, geom::vertex& Vertex ) const
+        {
+            Vertex = m_Vertex[i];
+        }
+
+        geom::vertex_counts Counts( std::size_t i ) const noexcept
+        {
+            const auto& V = m_Vertex[i];
+            geom::vertex_counts C;
+            C.m_nWeights    = static_cast<std::uint8_t>( V.m_nWeights   );
+            C.m_nNormals    = static_cast<std::uint8_t>( V.m_nNormals   );
+            C.m_nTangents   = static_cast<std::uint8_t>( V.m_nTangents  );
+            C.m_nBinormals  = static_cast<std::uint8_t>( V.m_nBinormals );
+            C.m_nUVs        = static_cast<std::uint8_t>( V.m_nUVs       );
+            C.m_nColors     = static_cast<std::uint8_t>( V.m_nColors    );
+            return C;
+        }
+
+        void setFrame( std::size_t i, std::int32_t iFrame ) const noexcept
+        {
+            m_Vertex[i].m_iFrame = iFrame;
+        }
+
+        void setCounts( std::size_t i, const geom::vertex_counts& Counts ) const noexcept
+        {
+            auto& V = m_Vertex[i];
+            V.m_nWeights    = Counts.m_nWeights;
+            V.m_nNormals    = Counts.m_nNormals;
+            V.m_nTangents   = Counts.m_nTangents;
+            V.m_nBinormals  = Counts.m_nBinormals;
+            V.m_nUVs        = Counts.m_nUVs;
+            V.m_nColors     = Counts.m_nColors;
+        }
+
+        void resize( std::size_t nVertices ) const
+        {
+            m_Vertex.resize( nVertices );
+            std::memset( m_Vertex.data(), 0, m_Vertex.size() * sizeof(m_Vertex[0]) );
+        }
+
+        void AllocateChannels( std::int32_t nUVs, std::int32_t nColors, std::int32_t nBTNs, std::int32_t nWeights ) const
+        {
+            // The vertex has all the channels already, we just need to make sure we fit
+            if( nUVs     > geom::vertex_max_uv_v      ) throw(std::runtime_error( "Too many UV sets for a vertex" ));
+            if( nColors  > geom::vertex_max_colors_v  ) throw(std::runtime_error( "Too many colors for a vertex" ));
+            if( nBTNs    > geom::vertex_max_normals_v ) throw(std::runtime_error( "Too many BTNs for a vertex" ));
+            if( nWeights > geom::vertex_max_weights_v ) throw(std::runtime_error( "Too many weights for a vertex" ));
+        }
+
+        void Compact( std::span<const std::int32_t> Keep ) const
+        {
+            CompactStream( m_Vertex, Keep );
+        }
+    };
+
+    //--------------------------------------------------------------------------
+
+    template< typename T >
+    struct vertex_stream_view
+    {
+        T& m_Streams;
+
+        std::size_t     size        ( void )                                const noexcept { return m_Streams.size(); }
+        auto&           Position    ( std::size_t i )                       const noexcept { return m_Streams.m_Position[i]; }
+        std::int32_t    iFrame      ( std::size_t i )                       const noexcept { return m_Streams.m_iFrame.empty() ? 0 : m_Streams.m_iFrame[i]; }
+        std::int32_t    nWeights    ( std::size_t i )                       const noexcept { return m_Streams.m_Count[i].m_nWeights; }
+        std::int32_t    nNormals    ( std::size_t i )                       const noexcept { return m_Streams.m_Count[i].m_nNormals; }
+        std::int32_t    nTangents   ( std::size_t i )                       const noexcept { return m_Streams.m_Count[i].m_nTangents; }
+        std::int32_t    nBinormals  ( std::size_t i )                       const noexcept { return m_Streams.m_Count[i].m_nBinormals; }
+        std::int32_t    nUVs        ( std::size_t i )                       const noexcept { return m_Streams.m_Count[i].m_nUVs; }
+        std::int32_t    nColors     ( std::size_t i )                       const noexcept { return m_Streams.m_Count[i].m_nColors; }
+        auto&           Weight      ( std::size_t i, std::int32_t k )       const noexcept { return m_Streams.m_Weight[k][i]; }
+        auto&           BTN         ( std::size_t i, std::int32_t k )       const noexcept { return m_Streams.m_BTN[k][i]; }
+        auto&           UV          ( std::size_t i, std::int32_t k )       const noexcept { return m_Streams.m_UV[k][i]; }
+        auto&           Color       ( std::size_t i, std::int32_t k )       const noexcept { return m_Streams.m_Color[k][i]; }
+
+        void getVertex( std::size_t i, geom::vertex& Vertex ) const
+        {
+            m_Streams.getVertex( i, Vertex );
+        }
+
+        geom::vertex_counts Counts( std::size_t i ) const noexcept
+        {
+            return m_Streams.m_Count[i];
+        }
+
+        void setFrame( std::size_t i, std::int32_t iFrame ) const
+        {
+            if( iFrame == 0 && m_Streams.m_iFrame.empty() ) return;
+            m_Streams.m_iFrame.resize( m_Streams.size() );
+            m_Streams.m_iFrame[i] = iFrame;
+        }
+
+        void setCounts( std::size_t i, const geom::vertex_counts& Counts ) const noexcept
+        {
+            m_Streams.m_Count[i] = Counts;
+        }
+
+        void resize( std::size_t nVertices ) const
+        {
+            m_Streams.resize( nVertices );
+        }
+
+        void AllocateChannels( std::int32_t nUVs, std::int32_t nColors, std::int32_t nBTNs, std::int32_t nWeights ) const
+        {
+            m_Streams.AllocateChannels( nUVs, nColors, nBTNs, nWeights );
+        }
+
+        void Compact( std::span<const std::int32_t> Keep ) const
+        {
+            m_Streams.Compact( Keep );
+        }
+    };
+
+    //--------------------------------------------------------------------------
+    // Calls Function with the view of whichever layout the geom is currently using
+
+    template< typename T_GEOM, typename T_FUNCTION >
+    decltype(auto) VisitVertices( T_GEOM& Geom, T_FUNCTION&& Function )
+    {
+        using streams_t  = std::remove_reference_t<decltype((Geom.m_Streams))>;
+        using vertices_t = std::remove_reference_t<decltype((Geom.m_Vertex))>;
+
+        if( Geom.isStreamLayout() ) return Function( vertex_stream_view<streams_t>{ Geom.m_Streams } );
+        return Function( vertex_array_view<vertices_t>{ Geom.m_Vertex } );
+    }
+
+    //--------------------------------------------------------------------------
+    // Same idea for the facets (m_Facet and m_Triangles)
+    //--------------------------------------------------------------------------
+
+    template< typename T >
+    struct facet_array_view
+    {
+        T& m_Facet;
+
+        std::size_t     size                ( void )                                const noexcept { return m_Facet.size(); }
+        std::int32_t    nVertices           ( std::size_t i )                       const noexcept { return m_Facet[i].m_nVertices; }
+        std::int32_t    iVertex             ( std::size_t i, std::int32_t k )       const noexcept { return m_Facet[i].m_iVertex[k]; }
+        std::int32_t    iMesh               ( std::size_t i )                       const noexcept { return m_Facet[i].m_iMesh; }
+        std::int32_t    iMaterialInstance   ( std::size_t i )                       const noexcept { return m_Facet[i].m_iMaterialInstance; }
+
+        void            setVertex           ( std::size_t i, std::int32_t k, std::int32_t v ) const noexcept { m_Facet[i].m_iVertex[k]           = v; }
+        void            setMesh             ( std::size_t i, std::int32_t v )       const noexcept { m_Facet[i].m_iMesh             = v; }
+        void            setMaterialInstance ( std::size_t i, std::int32_t v )       const noexcept { m_Facet[i].m_iMaterialInstance = v; }
+
+        void getFacet( std::size_t i, geom::facet& Facet ) const
+        {
+            Facet = m_Facet[i];
+        }
+
+        void setFacet( std::size_t i, const geom::facet& Facet ) const
+        {
+            m_Facet[i] = Facet;
+        }
+
+        void Move( std::size_t iDst, std::size_t iSrc ) const
+        {
+            if( iDst != iSrc ) m_Facet[iDst] = m_Facet[iSrc];
+        }
+
+        void resize( std::size_t nFacets ) const
+        {
+            m_Facet.resize( nFacets );
+        }
+    };
+
+    //--------------------------------------------------------------------------
+
+    template< typename T >
+    struct triangle_list_view
+    {
+        T& m_Triangles;
+
+        std::size_t     size                ( void )                                const noexcept { return m_Triangles.size(); }
+        std::int32_t    nVertices           ( std::size_t )                         const noexcept { return 3; }
+        std::int32_t    iVertex             ( std::size_t i, std::int32_t k )       const noexcept { return static_cast<std::int32_t>( m_Triangles.m_Index[ i * 3 + k ] ); }
+        std::int32_t    iMesh               ( std::size_t i )                       const noexcept { return m_Triangles.m_iMesh.get(i); }
+        std::int32_t    iMaterialInstance   ( std::size_t i )                       const noexcept { return m_Triangles.m_iMaterialInstance.get(i); }
+
+        void            setVertex           ( std::size_t i, std::int32_t k, std::int32_t v ) const noexcept { m_Triangles.m_Index[ i * 3 + k ] = static_cast<std::uint32_t>(v); }
+        void            setMesh             ( std::size_t i, std::int32_t v )       const { m_Triangles.m_iMesh.set( i, v ); }
+        void            setMaterialInstance ( std::size_t i, std::int32_t v )       const { m_Triangles.m_iMaterialInstance.set( i, v ); }
+
+        void getFacet( std::size_t i, geom::facet& Facet ) const
+        {
+            m_Triangles.getFacet( i, Facet );
+        }
+
+        void setFacet( std::size_t i, const geom::facet& Facet ) const
+        {
+            m_Triangles.setFacet( i, Facet );
+        }
+
+        void Move( std::size_t iDst, std::size_t iSrc ) const
+        {
+            if( iDst == iSrc ) return;
+            for( std::size_t k = 0; k < 3; ++k ) m_Triangles.m_Index[ iDst * 3 + k ] = m_Triangles.m_Index[ iSrc * 3 + k ];
+            m_Triangles.m_iMesh.set( iDst, m_Triangles.m_iMesh.get( iSrc ) );
+            m_Triangles.m_iMaterialInstance.set( iDst, m_Triangles.m_iMaterialInstance.get( iSrc ) );
+        }
+
+        void resize( std::size_t nFacets ) const
+        {
+            m_Triangles.resize( nFacets );
+        }
+    };
+
+    //--------------------------------------------------------------------------
+    // Calls Function with the view of whichever facet layout the geom is currently using
+
+    template< typename T_GEOM, typename T_FUNCTION >
+    decltype(auto) VisitFacets( T_GEOM& Geom, T_FUNCTION&& Function )
+    {
+        using triangles_t = std::remove_reference_t<decltype((Geom.m_Triangles))>;
+        using facets_t    = std::remove_reference_t<decltype((Geom.m_Facet))>;
+
+        if( Geom.isTriangleLayout() ) return Function( triangle_list_view<triangles_t>{ Geom.m_Triangles } );
+        return Function( facet_array_view<facets_t>{ Geom.m_Facet } );
+    }
+
+    //--------------------------------------------------------------------------
+
+    inline geom::vertex_counts MakeVertexCounts
+    ( std::int32_t nWeights
+    , std::int32_t nNormals
+    , std::int32_t nTangents
+    , std::int32_t nBinormals
+    , std::int32_t nUVs
+    , std::int32_t nColors
+    )
+    {
+        if( nWeights   < 0 || nWeights   > geom::vertex_max_weights_v ) throw(std::runtime_error( std::format( "Invalid number of weights for a vertex {}",   nWeights   )));
+        if( nNormals   < 0 || nNormals   > geom::vertex_max_normals_v ) throw(std::runtime_error( std::format( "Invalid number of normals for a vertex {}",   nNormals   )));
+        if( nTangents  < 0 || nTangents  > geom::vertex_max_normals_v ) throw(std::runtime_error( std::format( "Invalid number of tangents for a vertex {}",  nTangents  )));
+        if( nBinormals < 0 || nBinormals > geom::vertex_max_normals_v ) throw(std::runtime_error( std::format( "Invalid number of binormals for a vertex {}", nBinormals )));
+        if( nUVs       < 0 || nUVs       > geom::vertex_max_uv_v      ) throw(std::runtime_error( std::format( "Invalid number of UVs for a vertex {}",       nUVs       )));
+        if( nColors    < 0 || nColors    > geom::vertex_max_colors_v  ) throw(std::runtime_error( std::format( "Invalid number of colors for a vertex {}",    nColors    )));
+
+        geom::vertex_counts Counts;
+        Counts.m_nWeights   = static_cast<std::uint8_t>( nWeights   );
+        Counts.m_nNormals   = static_cast<std::uint8_t>( nNormals   );
+        Counts.m_nTangents  = static_cast<std::uint8_t>( nTangents  );
+        Counts.m_nBinormals = static_cast<std::uint8_t>( nBinormals );
+        Counts.m_nUVs       = static_cast<std::uint8_t>( nUVs       );
+        Counts.m_nColors    = static_cast<std::uint8_t>( nColors    );
+        return Counts;
+    }
+
+    //--------------------------------------------------------------------------
+    // Weight sorting. A vertex's weights are packed into 64 bit keys, padded up to 4, 8 or 16 and
+    // sorted with a Batcher odd-even merge network of that size, so every vertex runs the same branch
+    // free sequence of min/max instead of a selection sort. The high half of a key is the weight
+    // flipped so larger weights come first, the low half the bone so ties are broken by bone index.
+    //--------------------------------------------------------------------------
+    using weight_block = std::array<geom::weight, geom::vertex_max_weights_v>;
+
+    template< std::size_t N, typename T_FUNCTION >
+    constexpr void ForEachComparator( T_FUNCTION&& Function )
+    {
+        for( std::size_t p = 1; p < N; p += p )
+            for( std::size_t k = p; k >= 1; k /= 2 )
+                for( std::size_t j = k % p; j + k < N; j += 2 * k )
+                    for( std::size_t i = 0; i < k && i + j + k < N; ++i )
+                        if( (i + j) / (2 * p) == (i + j + k) / (2 * p) )
+                            Function( i + j, i + j + k );
+    }
+
+    template< std::size_t N >
+    constexpr auto MakeSortingNetwork( void )
+    {
+        constexpr std::size_t nComparators = []
+        {
+            std::size_t n = 0;
+            ForEachComparator<N>( [&]( std::size_t, std::size_t ) { ++n; } );
+            return n;
+        }();
+
+        std::array<std::pair<std::uint8_t, std::uint8_t>, nComparators> Network{};
+        std::size_t n = 0;
+        ForEachComparator<N>( [&]( std::size_t a, std::size_t b )
+        {
+            Network[n++] = { static_cast<std::uint8_t>(a), static_cast<std::uint8_t>(b) };
+        });
+        return Network;
+    }
+
+    // Fully unrolled so the keys can live in registers
+    template< std::size_t N >
+    inline void RunSortingNetwork( std::array<std::uint64_t, geom::vertex_max_weights_v>& Keys ) noexcept
+    {
+        static constexpr auto network_v = MakeSortingNetwork<N>();
+        [&]<std::size_t... I>( std::index_sequence<I...> )
+        {
+            ( [&]
+            {
+                const std::uint64_t A = Keys[ network_v[I].first  ];
+                const std::uint64_t B = Keys[ network_v[I].second ];
+                Keys[ network_v[I].first  ] = A < B ? A : B;
+                Keys[ network_v[I].second ] = A < B ? B : A;
+            }(), ... );
+        }( std::make_index_sequence<network_v.size()>{} );
+    }
+
+    inline void SortWeights( weight_block& W, std::int32_t nWeights ) noexcept
+    {
+        static_assert( geom::vertex_max_weights_v == 16, "Add the sorting network for the new max" );
+
+        if( nWeights <= 1 ) return;
+
+        std::array<std::uint64_t, geom::vertex_max_weights_v> Keys;
+        const std::int32_t N = nWeights <= 4 ? 4 : nWeights <= 8 ? 8 : 16;
+
+        for( std::int32_t i = 0; i < nWeights; ++i )
+        {
+            // Order preserving float to integer, then inverted so the sort is descending
+            const std::uint32_t Bits = std::bit_cast<std::uint32_t>( W[i].m_Weight );
+            const std::uint32_t Key  = ~( Bits ^ ( (Bits >> 31) ? 0xffffffffu : 0x80000000u ) );
+            Keys[i] = ( std::uint64_t(Key) << 32 ) | std::bit_cast<std::uint32_t>( W[i].m_iBone );
+        }
+        for( std::int32_t i = nWeights; i < N; ++i ) Keys[i] = ~std::uint64_t(0);
+
+        if     ( N == 4 ) RunSortingNetwork<4> ( Keys );
+        else if( N == 8 ) RunSortingNetwork<8> ( Keys );
+        else              RunSortingNetwork<16>( Keys );
+
+        for( std::int32_t i = 0; i < nWeights; ++i )
+        {
+            const std::uint32_t Key  = ~static_cast<std::uint32_t>( Keys[i] >> 32 );
+            const std::uint32_t Bits = Key ^ ( (Key >> 31) ? 0x80000000u : 0xffffffffu );
+            W[i].m_iBone  = std::bit_cast<std::int32_t>( static_cast<std::uint32_t>( Keys[i] ) );
+            W[i].m_Weight = std::bit_cast<float>( Bits );
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    // The whole CleanWeights for one vertex: sort, keep the MaxNumWeights largest, drop the ones
+    // below MinWeightValue and normalize what is left. Returns the new count. Dropping uses the
+    // weights as they would be after normalizing the truncated set, so the result is the same as
+    // doing each step as its own pass. Vertices without weights get bone 0 with a weight of 1.
+    //--------------------------------------------------------------------------
+    inline std::int32_t CleanVertexWeights( weight_block& W, std::int32_t nWeights, std::int32_t MaxNumWeights, float MinWeightValue ) noexcept
+    {
+        alignas(16) std::array<float, geom::vertex_max_weights_v> Values;
+
+        // Horizontal sum of Values[0..n) four at a time, the caller zeroes the tail of the last group
+        auto Sum = [&]( std::int32_t n )
+        {
+            __m128 Total = _mm_setzero_ps();
+            for( std::int32_t i = 0; i < n; i += 4 ) Total = _mm_add_ps( Total, _mm_load_ps( &Values[i] ) );
+            Total = _mm_add_ps( Total, _mm_movehl_ps( Total, Total ) );
+            Total = _mm_add_ss( Total, _mm_shuffle_ps( Total, Total, 1 ) );
+            return _mm_cvtss_f32( Total );
+        };
+
+        auto Gather = [&]( std::int32_t n )
+        {
+            for( std::int32_t i = 0; i < n;                  ++i ) Values[i] = W[i].m_Weight;
+            for( std::int32_t i = n; i < ((n + 3) & ~3);     ++i ) Values[i] = 0;
+        };
+
+        SortWeights( W, nWeights );
+
+        float Threshold = MinWeightValue;
+        if( nWeights > MaxNumWeights )
+        {
+            nWeights = std::max( 0, MaxNumWeights );
+            Gather( nWeights );
+            Threshold *= Sum( nWeights );
+        }
+
+        if( nWeights == 0 )
+        {
+            W[0].m_iBone  = 0;
+            W[0].m_Weight = 1;
+            return 1;
+        }
+
+        // Sorted, so the weights that survive are a prefix. The first one always stays.
+        std::int32_t nKept = 1;
+        while( nKept < nWeights && W[nKept].m_Weight >= Threshold ) nKept++;
+
+        Gather( nKept );
+        const __m128 Total = _mm_set1_ps( Sum( nKept ) );
+        for( std::int32_t i = 0; i < nKept; i += 4 )
+            _mm_store_ps( &Values[i], _mm_div_ps( _mm_load_ps( &Values[i] ), Total ) );
+
+        for( std::int32_t i = 0; i < nKept; ++i ) W[i].m_Weight = Values[i];
+        return nKept;
+    }
+
+    //--------------------------------------------------------------------------
+    // Per vertex data used by the CleanMesh weld in place of TempVCompare. The fingerprint packs the
+    // attributes TempVCompare requires to match exactly (all the counts plus a hash of the bones) so most
+    // pairs that share a position are rejected with a single compare. The continuous attributes are not
+    // quantized into it, two values within tolerance could fall on different sides of a quantization step
+    // and change the weld; instead they are packed one per SSE register and tested with the same
+    // tolerances as TempVCompare.
+    //--------------------------------------------------------------------------
+    struct weld_attributes
+    {
+        static constexpr std::uint64_t  weights_shift_v   = 0;      // 5 bits
+        static constexpr std::uint64_t  normals_shift_v   = 5;      // 2 bits
+        static constexpr std::uint64_t  tangents_shift_v  = 7;      // 2 bits
+        static constexpr std::uint64_t  binormals_shift_v = 9;      // 2 bits
+        static constexpr std::uint64_t  uvs_shift_v       = 11;     // 4 bits
+        static constexpr std::uint64_t  colors_shift_v    = 15;     // 3 bits
+        static constexpr std::uint64_t  bones_shift_v     = 18;     // Bone hash in the remaining bits
+
+        static_assert( geom::vertex_max_weights_v < 32 && geom::vertex_max_normals_v < 4 && geom::vertex_max_uv_v < 16 && geom::vertex_max_colors_v < 8 );
+
+        template< typename T_VIEW >
+        weld_attributes( const T_VIEW& Vertices )
+        {
+            const std::size_t nVertices = Vertices.size();
+
+            m_Position.resize( nVertices );
+            m_Fingerprint.resize( nVertices );
+            m_iSlot.resize( nVertices + 1 );
+
+            m_iSlot[0] = 0;
+            for( std::size_t i = 0; i < nVertices; ++i )
+            {
+                m_iSlot[i+1] = m_iSlot[i]
+                             + Vertices.nWeights(i) + Vertices.nNormals(i) + Vertices.nTangents(i) + Vertices.nBinormals(i)
+                             + Vertices.nUVs(i)     + Vertices.nColors(i);
+            }
+            m_Slot.resize( m_iSlot[nVertices] );
+
+            ParallelFor( nVertices, 4096, [&]( std::size_t iBegin, std::size_t iEnd )
+            {
+                for( std::size_t i = iBegin; i < iEnd; ++i )
+                {
+                    const auto& P = Vertices.Position(i);
+                    m_Position[i] = _mm_setr_ps( P.m_X, P.m_Y, P.m_Z, 0 );
+
+                    std::uint64_t BoneHash = 0xcbf29ce484222325ull;
+                    __m128*       pSlot    = &m_Slot[ m_iSlot[i] ];
+
+                    // Weights keep the squared weight for the tolerance test and the bone for the exact test
+                    for( std::int32_t k = 0; k < Vertices.nWeights(i); ++k )
+                    {
+                        const auto& W = Vertices.Weight( i, k );
+                        *pSlot++ = _mm_castsi128_ps( _mm_setr_epi32( std::bit_cast<std::int32_t>( W.m_Weight * W.m_Weight ), W.m_iBone, 0, 0 ) );
+                        BoneHash = ( BoneHash ^ static_cast<std::uint32_t>(W.m_iBone) ) * 0x100000001b3ull;
+                    }
+
+                    for( std::int32_t k = 0; k < Vertices.nNormals(i);   ++k ) { const auto& V = Vertices.BTN(i,k).m_Normal;   *pSlot++ = _mm_setr_ps( V.m_X, V.m_Y, V.m_Z, 0 ); }
+                    for( std::int32_t k = 0; k < Vertices.nTangents(i);  ++k ) { const auto& V = Vertices.BTN(i,k).m_Tangent;  *pSlot++ = _mm_setr_ps( V.m_X, V.m_Y, V.m_Z, 0 ); }
+                    for( std::int32_t k = 0; k < Vertices.nBinormals(i); ++k ) { const auto& V = Vertices.BTN(i,k).m_Binormal; *pSlot++ = _mm_setr_ps( V.m_X, V.m_Y, V.m_Z, 0 ); }
+                    for( std::int32_t k = 0; k < Vertices.nUVs(i);       ++k ) { const auto& V = Vertices.UV(i,k);             *pSlot++ = _mm_setr_ps( V.m_X, V.m_Y, 0, 0 ); }
+                    for( std::int32_t k = 0; k < Vertices.nColors(i);    ++k ) { const auto& C = Vertices.Color(i,k);          *pSlot++ = _mm_setr_ps( C.m_R, C.m_G, C.m_B, C.m_A ); }
+
+                    m_Fingerprint[i] = ( static_cast<std::uint64_t>( Vertices.nWeights(i)   ) << weights_shift_v   )
+                                     | ( static_cast<std::uint64_t>( Vertices.nNormals(i)   ) << normals_shift_v   )
+                                     | ( static_cast<std::uint64_t>( Vertices.nTangents(i)  ) << tangents_shift_v  )
+                                     | ( static_cast<std::uint64_t>( Vertices.nBinormals(i) ) << binormals_shift_v )
+                                     | ( static_cast<std::uint64_t>( Vertices.nUVs(i)       ) << uvs_shift_v       )
+                                     | ( static_cast<std::uint64_t>( Vertices.nColors(i)    ) << colors_shift_v    )
+                                     | ( BoneHash << bones_shift_v );
+                }
+            });
+        }
+
+        // Sums the lanes as ((x+y)+(z+w)) which for w=0 matches the x+y+z order of a regular dot product
+        static float SquaredLength( __m128 V ) noexcept
+        {
+            const __m128 M = _mm_mul_ps( V, V );
+            const __m128 S = _mm_add_ps( M, _mm_shuffle_ps( M, M, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+            return _mm_cvtss_f32( _mm_add_ss( S, _mm_movehl_ps( S, S ) ) );
+        }
+
+        bool Compare( std::size_t iA, std::size_t iB, float PositionEpsilon ) const noexcept
+        {
+            const std::uint64_t Fingerprint = m_Fingerprint[iA];
+            if( Fingerprint != m_Fingerprint[iB] ) return false;
+
+            if( SquaredLength( _mm_sub_ps( m_Position[iA], m_Position[iB] ) ) > ( PositionEpsilon * PositionEpsilon ) ) return false;
+
+            const __m128* pA = &m_Slot[ m_iSlot[iA] ];
+            const __m128* pB = &m_Slot[ m_iSlot[iB] ];
+
+            auto Count = [&]( std::uint64_t Shift, std::uint64_t nBits )
+            {
+                return static_cast<std::int32_t>( ( Fingerprint >> Shift ) & ( ( 1ull << nBits ) - 1 ) );
+            };
+
+            // Same as TempVCompare: the weights only fail when A is heavier, the bones must match exactly
+            for( std::int32_t n = Count( weights_shift_v, 5 ); n; --n, ++pA, ++pB )
+            {
+                static const float WEpsilon = 0.001f;
+                if( _mm_cvtss_f32( *pA ) - _mm_cvtss_f32( *pB ) > WEpsilon ) return false;
+                if( _mm_cvtsi128_si32( _mm_srli_si128( _mm_castps_si128( *pA ), 4 ) ) != _mm_cvtsi128_si32( _mm_srli_si128( _mm_castps_si128( *pB ), 4 ) ) ) return false;
+            }
+
+            auto CompareSlots = [&]( std::int32_t n, float Epsilon )
+            {
+                for( ; n; --n, ++pA, ++pB )
+                    if( SquaredLength( _mm_sub_ps( *pB, *pA ) ) > Epsilon ) return false;
+                return true;
+            };
+
+            return CompareSlots( Count( normals_shift_v,   2 ) + Count( tangents_shift_v, 2 ) + Count( binormals_shift_v, 2 ) + Count( uvs_shift_v, 4 ), 0.001f )
+                && CompareSlots( Count( colors_shift_v,    3 ), 3.0f );
+        }
+
+        // Bitwise equal position and attributes, such vertices give the same Compare against any other vertex
+        bool isIdentical( std::size_t iA, std::size_t iB ) const noexcept
+        {
+            if( m_Fingerprint[iA] != m_Fingerprint[iB] ) return false;
+            if( std::memcmp( &m_Position[iA], &m_Position[iB], sizeof(__m128) ) ) return false;
+
+            const std::size_t nSlots = m_iSlot[iA+1] - m_iSlot[iA];
+            return nSlots == m_iSlot[iB+1] - m_iSlot[iB]
+                && std::memcmp( &m_Slot[ m_iSlot[iA] ], &m_Slot[ m_iSlot[iB] ], nSlots * sizeof(__m128) ) == 0;
+        }
+
+        // Returns for every vertex the lowest index that is identical to it (itself when there is none). Found with
+        // a sort on a hash of the data so a pile of copies at one position costs O(k log k) rather than O(k^2) compares.
+        std::vector<std::int32_t> FindIdentical( void ) const
+        {
+            const std::size_t           nVertices = m_Position.size();
+            std::vector<std::uint64_t>  Hash( nVertices );
+
+            ParallelFor( nVertices, 4096, [&]( std::size_t iBegin, std::size_t iEnd )
+            {
+                auto Mix = [&]( std::uint64_t H, __m128 V )
+                {
+                    const auto Words = std::bit_cast<std::array<std::uint64_t,2>>( V );
+                    H = ( H ^ Words[0] ) * 0x100000001b3ull;
+                    return ( H ^ Words[1] ) * 0x100000001b3ull;
+                };
+
+                for( std::size_t i = iBegin; i < iEnd; ++i )
+                {
+                    std::uint64_t H = Mix( 0xcbf29ce484222325ull ^ m_Fingerprint[i], m_Position[i] );
+                    for( std::uint32_t s = m_iSlot[i]; s < m_iSlot[i+1]; ++s ) H = Mix( H, m_Slot[s] );
+                    Hash[i] = H;
+                }
+            });
+
+            std::vector<std::int32_t> Order( nVertices );
+            for( std::size_t i = 0; i < nVertices; ++i ) Order[i] = static_cast<std::int32_t>(i);
+            std::sort( Order.begin(), Order.end(), [&]( std::int32_t A, std::int32_t B )
+            {
+                return Hash[A] != Hash[B] ? Hash[A] < Hash[B] : A < B;
+            });
+
+            // Inside a run of equal hashes the vertices are in index order, so the first of each group of
+            // identical vertices is the lowest index. Runs hold more than one group only on hash collisions.
+            std::vector<std::int32_t> Identical( nVertices );
+            std::vector<std::int32_t> Groups;
+            for( std::size_t iRun = 0; iRun < nVertices; )
+            {
+                std::size_t iEnd = iRun + 1;
+                while( iEnd < nVertices && Hash[ Order[iEnd] ] == Hash[ Order[iRun] ] ) ++iEnd;
+
+                Groups.clear();
+                for( std::size_t i = iRun; i < iEnd; ++i )
+                {
+                    const std::int32_t iVertex = Order[i];
+                    const auto         It      = std::find_if( Groups.begin(), Groups.end(), [&]( std::int32_t G ) { return isIdentical( G, iVertex ); } );
+
+                    if( It == Groups.end() ) { Groups.push_back( iVertex ); Identical[iVertex] = iVertex; }
+                    else                     Identical[iVertex] = *It;
+                }
+
+                iRun = iEnd;
+            }
+
+            return Identical;
+        }
+
+        std::vector<__m128>             m_Position;
+        std::vector<std::uint64_t>      m_Fingerprint;
+        std::vector<std::uint32_t>      m_iSlot;        // First slot of each vertex, one extra entry at the end
+        std::vector<__m128>             m_Slot;
+    };
+}
+
+//--------------------------------------------------------------------------
+
+void geom::vertex_streams::clear( void ) noexcept
 {
-    m_Bone.clear();
-    m_Vertex.clear();
-    m_Facet.clear();
-    m_MaterialInstance.clear();
-    m_Mesh.clear();
+    m_Position.clear();
+    m_Count.clear();
+    m_iFrame.clear();
+    m_UV.clear();
+    m_Color.clear();
+    m_BTN.clear();
+    m_Weight.clear();
 }
 
 //--------------------------------------------------------------------------
 
-void geom::Serialize
-( bool                      isRead
-, std::wstring_view         FileName
-, xtextfile::file_type      FileType
-)
+void geom::vertex_streams::resize( std::size_t nVertices )
 {
-    Kill();
+    m_Position.resize( nVertices );
+    m_Count.resize( nVertices );
+    if( m_iFrame.empty() == false ) m_iFrame.resize( nVertices );
+
+    for( auto& S : m_UV     ) S.resize( nVertices );
+    for( auto& S : m_Color  ) S.resize( nVertices );
+    for( auto& S : m_BTN    ) S.resize( nVertices );
+    for( auto& S : m_Weight ) S.resize( nVertices );
+}
+
+//--------------------------------------------------------------------------
+
+void geom::vertex_streams::AllocateChannels( std::int32_t nUVs, std::int32_t nColors, std::int32_t nBTNs, std::int32_t nWeights )
+{
+    if( nUVs     > vertex_max_uv_v      ) throw(std::runtime_error( "Too many UV sets for a vertex" ));
+    if( nColors  > vertex_max_colors_v  ) throw(std::runtime_error( "Too many colors for a vertex" ));
+    if( nBTNs    > vertex_max_normals_v ) throw(std::runtime_error( "Too many BTNs for a vertex" ));
+    if( nWeights > vertex_max_weights_v ) throw(std::runtime_error( "Too many weights for a vertex" ));
+
+    // Channels only grow, the ones already there keep their data
+    const auto nVertices = size();
+    if( nUVs     > static_cast<std::int32_t>(m_UV.size())     ) m_UV.resize    ( nUVs,     std::vector<xmath::fvec2>( nVertices ) );
+    if( nColors  > static_cast<std::int32_t>(m_Color.size())  ) m_Color.resize ( nColors,  std::vector<xcolori>     ( nVertices, xcolori{} ) );
+    if( nBTNs    > static_cast<std::int32_t>(m_BTN.size())    ) m_BTN.resize   ( nBTNs,    std::vector<btn>         ( nVertices, btn{} ) );
+    if( nWeights > static_cast<std::int32_t>(m_Weight.size()) ) m_Weight.resize( nWeights, std::vector<weight>      ( nVertices, weight{} ) );
+}
+
+//--------------------------------------------------------------------------
+
+void geom::vertex_streams::getVertex( std::size_t Index, vertex& Vertex ) const
+{
+    const auto& Count = m_Count[Index];
+
+    Vertex              = vertex{};
+    Vertex.m_Position   = m_Position[Index];
+    Vertex.m_iFrame     = m_iFrame.empty() ? 0 : m_iFrame[Index];
+    Vertex.m_nWeights   = Count.m_nWeights;
+    Vertex.m_nNormals   = Count.m_nNormals;
+    Vertex.m_nTangents  = Count.m_nTangents;
+    Vertex.m_nBinormals = Count.m_nBinormals;
+    Vertex.m_nUVs       = Count.m_nUVs;
+    Vertex.m_nColors    = Count.m_nColors;
+
+    const std::int32_t nBTNs = std::max( { Vertex.m_nNormals, Vertex.m_nTangents, Vertex.m_nBinormals } );
+
+    for( std::int32_t i = 0; i < Vertex.m_nUVs;     ++i ) Vertex.m_UV[i]     = m_UV[i][Index];
+    for( std::int32_t i = 0; i < Vertex.m_nColors;  ++i ) Vertex.m_Color[i]  = m_Color[i][Index];
+    for( std::int32_t i = 0; i < nBTNs;             ++i ) Vertex.m_BTN[i]    = m_BTN[i][Index];
+    for( std::int32_t i = 0; i < Vertex.m_nWeights; ++i ) Vertex.m_Weight[i] = m_Weight[i][Index];
+}
+
+//--------------------------------------------------------------------------
+
+void geom::vertex_streams::setVertex( std::size_t Index, const vertex& Vertex )
+{
+    const auto         Count = details::MakeVertexCounts( Vertex.m_nWeights, Vertex.m_nNormals, Vertex.m_nTangents, Vertex.m_nBinormals, Vertex.m_nUVs, Vertex.m_nColors );
+    const std::int32_t nBTNs = std::max( { Vertex.m_nNormals, Vertex.m_nTangents, Vertex.m_nBinormals } );
+
+    AllocateChannels( Vertex.m_nUVs, Vertex.m_nColors, nBTNs, Vertex.m_nWeights );
+
+    m_Position[Index] = Vertex.m_Position;
+    m_Count[Index]    = Count;
+
+    if( Vertex.m_iFrame != 0 && m_iFrame.empty() ) m_iFrame.resize( size() );
+    if( m_iFrame.empty() == false ) m_iFrame[Index] = Vertex.m_iFrame;
+
+    for( std::int32_t i = 0; i < Vertex.m_nUVs;     ++i ) m_UV[i][Index]     = Vertex.m_UV[i];
+    for( std::int32_t i = 0; i < Vertex.m_nColors;  ++i ) m_Color[i][Index]  = Vertex.m_Color[i];
+    for( std::int32_t i = 0; i < nBTNs;             ++i ) m_BTN[i][Index]    = Vertex.m_BTN[i];
+    for( std::int32_t i = 0; i < Vertex.m_nWeights; ++i ) m_Weight[i][Index] = Vertex.m_Weight[i];
+}
+
+//--------------------------------------------------------------------------
+
+void geom::vertex_streams::Compact( std::span<const std::int32_t> Keep )
+{
+    details::CompactStream( m_Position, Keep );
+    details::CompactStream( m_Count,    Keep );
+    details::CompactStream( m_iFrame,   Keep );
+    for( auto& S : m_UV     ) details::CompactStream( S, Keep );
+    for( auto& S : m_Color  ) details::CompactStream( S, Keep );
+    for( auto& S : m_BTN    ) details::CompactStream( S, Keep );
+    for( auto& S : m_Weight ) details::CompactStream( S, Keep );
+}
+
+//--------------------------------------------------------------------------
+
+std::size_t geom::vertex_streams::getMemoryUsage( void ) const noexcept
+{
+    std::size_t Total = m_Position.capacity() * sizeof(m_Position[0])
+                      + m_Count.capacity()    * sizeof(m_Count[0])
+                      + m_iFrame.capacity()   * sizeof(std::int32_t);
+
+    for( auto& S : m_UV     ) Total += S.capacity() * sizeof(xmath::fvec2);
+    for( auto& S : m_Color  ) Total += S.capacity() * sizeof(xcolori);
+    for( auto& S : m_BTN    ) Total += S.capacity() * sizeof(btn);
+    for( auto& S : m_Weight ) Total += S.capacity() * sizeof(weight);
+
+    return Total;
+}
+
+//--------------------------------------------------------------------------
+
+void geom::skin_stream::clear( void ) noexcept
+{
+    m_Bones.clear();
+    m_Weights.clear();
+}
+
+//--------------------------------------------------------------------------
+
+std::int32_t geom::skin_stream::iBone( std::size_t iVertex, std::int32_t iInfluence ) const noexcept
+{
+    const std::size_t Index = iVertex * m_Format.m_nInfluences + iInfluence;
+    if( m_Format.m_BoneFormat == bone_format::UINT8 ) return m_Bones[Index];
+
+    std::uint16_t Bone;
+    std::memcpy( &Bone, &m_Bones[ Index * 2 ], 2 );
+    return Bone;
+}
+
+//--------------------------------------------------------------------------
+
+float geom::skin_stream::Weight( std::size_t iVertex, std::int32_t iInfluence ) const noexcept
+{
+    const std::size_t Index = iVertex * m_Format.m_nInfluences + iInfluence;
+    if( m_Format.m_WeightFormat == weight_format::UNORM8 ) return m_Weights[Index] * ( 1.0f / 0xff );
+
+    std::uint16_t Weight;
+    std::memcpy( &Weight, &m_Weights[ Index * 2 ], 2 );
+    return Weight * ( 1.0f / 0xffff );
+}
+
+//--------------------------------------------------------------------------
+
+std::size_t geom::skin_stream::getMemoryUsage( void ) const noexcept
+{
+    return m_Bones.capacity() + m_Weights.capacity();
+}
+
+//--------------------------------------------------------------------------
+
+void geom::Kill(void)
+{
+    m_Bone.clear();
+    m_Vertex.clear();
+    m_Facet.clear();
+    m_MaterialInstance.clear();
+    m_Mesh.clear();
+    m_Streams.clear();
+    m_Triangles.clear();
+    m_Skin.clear();
+    m_BoneIndex.Invalidate();
+    InvalidateMeshIndex();
+    m_bFacetPlanesDirty = true;
+}
+
+//--------------------------------------------------------------------------
+
+bool geom::isStreamLayout( void ) const noexcept
+{
+    return m_Vertex.empty() && m_Streams.empty() == false;
+}
+
+//--------------------------------------------------------------------------
+
+namespace details
+{
+    // Fills Streams with the vertices, allocating only the channels that some vertex uses
+    inline void MakeVertexStreams( std::span<const geom::vertex> Vertices, geom::vertex_streams& Streams )
+    {
+        //
+        // Find out how many channels we really need
+        //
+        std::int32_t nUVs     = 0;
+        std::int32_t nColors  = 0;
+        std::int32_t nBTNs    = 0;
+        std::int32_t nWeights = 0;
+        for( const auto& V : Vertices )
+        {
+            nUVs     = std::max( nUVs,     V.m_nUVs );
+            nColors  = std::max( nColors,  V.m_nColors );
+            nBTNs    = std::max( { nBTNs,  V.m_nNormals, V.m_nTangents, V.m_nBinormals } );
+            nWeights = std::max( nWeights, V.m_nWeights );
+        }
+
+        Streams.clear();
+        Streams.resize( Vertices.size() );
+        Streams.AllocateChannels( nUVs, nColors, nBTNs, nWeights );
+
+        for( std::size_t i = 0; i < Vertices.size(); ++i )
+            Streams.setVertex( i, Vertices[i] );
+    }
+}
+
+//--------------------------------------------------------------------------
+
+void geom::ConvertToStreams( void )
+{
+    if( m_Vertex.empty() ) return;
+
+    details::MakeVertexStreams( m_Vertex, m_Streams );
+
+    // Release the memory for real
+    std::vector<vertex>().swap( m_Vertex );
+}
+
+//--------------------------------------------------------------------------
+
+void geom::ConvertToVertices( void )
+{
+    if( m_Streams.empty() ) return;
+
+    m_Vertex.resize( m_Streams.size() );
+    details::ParallelFor( m_Vertex.size(), 4096, [&]( std::size_t iBegin, std::size_t iEnd )
+    {
+        for( std::size_t i = iBegin; i < iEnd; ++i )
+            m_Streams.getVertex( i, m_Vertex[i] );
+    });
+
+    // Release the memory for real
+    m_Streams = vertex_streams{};
+}
+
+//--------------------------------------------------------------------------
+
+void geom::triangle_list::ids::set( std::size_t Index, std::int32_t Value )
+{
+    if( m_Wide.empty() )
+    {
+        if( Value >= -1 && Value < narrow_none_v )
+        {
+            m_Narrow[Index] = Value == -1 ? narrow_none_v : static_cast<std::uint16_t>(Value);
+            return;
+        }
+
+        // Does not fit any more, promote everything to 32 bits
+        std::vector<std::int32_t> Wide( m_Narrow.size() );
+        for( std::size_t i = 0; i < m_Narrow.size(); ++i ) Wide[i] = get(i);
+        m_Wide.swap( Wide );
+        std::vector<std::uint16_t>().swap( m_Narrow );
+    }
+
+    m_Wide[Index] = Value;
+}
+
+//--------------------------------------------------------------------------
+
+void geom::triangle_list::ids::resize( std::size_t Count )
+{
+    if( m_Wide.empty() ) m_Narrow.resize( Count );
+    else                 m_Wide.resize( Count );
+}
+
+//--------------------------------------------------------------------------
+
+void geom::triangle_list::ids::clear( void ) noexcept
+{
+    m_Narrow.clear();
+    m_Wide.clear();
+}
+
+//--------------------------------------------------------------------------
+
+void geom::triangle_list::clear( void ) noexcept
+{
+    m_Index.clear();
+    m_iMesh.clear();
+    m_iMaterialInstance.clear();
+}
+
+//--------------------------------------------------------------------------
+
+void geom::triangle_list::resize( std::size_t nTriangles )
+{
+    m_Index.resize( nTriangles * 3 );
+    m_iMesh.resize( nTriangles );
+    m_iMaterialInstance.resize( nTriangles );
+}
+
+//--------------------------------------------------------------------------
+
+void geom::triangle_list::getFacet( std::size_t Index, facet& Facet ) const
+{
+    Facet                       = facet{};
+    Facet.m_iMesh               = m_iMesh.get( Index );
+    Facet.m_iMaterialInstance   = m_iMaterialInstance.get( Index );
+    Facet.m_nVertices           = 3;
+    for( std::int32_t k = 0; k < 3; ++k ) Facet.m_iVertex[k] = static_cast<std::int32_t>( m_Index[ Index * 3 + k ] );
+}
+
+//--------------------------------------------------------------------------
+
+void geom::triangle_list::setFacet( std::size_t Index, const facet& Facet )
+{
+    if( Facet.m_nVertices != 3 )
+        throw(std::runtime_error( std::format( "The triangle layout can only hold triangles but got a facet with {} vertices", Facet.m_nVertices ) ));
+
+    m_iMesh.set( Index, Facet.m_iMesh );
+    m_iMaterialInstance.set( Index, Facet.m_iMaterialInstance );
+    for( std::int32_t k = 0; k < 3; ++k ) m_Index[ Index * 3 + k ] = static_cast<std::uint32_t>( Facet.m_iVertex[k] );
+}
+
+//--------------------------------------------------------------------------
+
+std::size_t geom::triangle_list::getMemoryUsage( void ) const noexcept
+{
+    return m_Index.capacity()                           * sizeof(std::uint32_t)
+         + m_iMesh.m_Narrow.capacity()                  * sizeof(std::uint16_t)
+         + m_iMesh.m_Wide.capacity()                    * sizeof(std::int32_t)
+         + m_iMaterialInstance.m_Narrow.capacity()      * sizeof(std::uint16_t)
+         + m_iMaterialInstance.m_Wide.capacity()        * sizeof(std::int32_t);
+}
+
+//--------------------------------------------------------------------------
+
+bool geom::isTriangleLayout( void ) const noexcept
+{
+    return m_Facet.empty() && m_Triangles.empty() == false;
+}
+
+//--------------------------------------------------------------------------
+
+void geom::ConvertToTriangles( void )
+{
+    if( m_Facet.empty() ) return;
+
+    for( const auto& Facet : m_Facet )
+    {
+        if( Facet.m_nVertices != 3 )
+            throw(std::runtime_error( std::format( "Unable to convert to triangles, found a facet with {} vertices", Facet.m_nVertices ) ));
+    }
+
+    m_Triangles.clear();
+    m_Triangles.resize( m_Facet.size() );
+    for( std::size_t i = 0; i < m_Facet.size(); ++i )
+        m_Triangles.setFacet( i, m_Facet[i] );
+
+    // Release the memory for real
+    std::vector<facet>().swap( m_Facet );
+    m_bFacetPlanesDirty = true;
+}
+
+//--------------------------------------------------------------------------
+
+void geom::ConvertToFacets( void )
+{
+    if( m_Triangles.empty() ) return;
+
+    m_Facet.resize( m_Triangles.size() );
+    for( std::size_t i = 0; i < m_Facet.size(); ++i )
+        m_Triangles.getFacet( i, m_Facet[i] );
+
+    // Release the memory for real
+    m_Triangles = triangle_list{};
+    m_bFacetPlanesDirty = true;
+}
+
+//--------------------------------------------------------------------------
+// Gives the meshes with a duplicated name (case insensitive) a unique one, the same way the
+// original O(M^2) scan did: visiting the meshes in order, every later mesh that still has the
+// name of the current one gets "__N" appended. Meshes are grouped by name in a hash table so
+// each step only visits the meshes that currently share its name.
+//--------------------------------------------------------------------------
+namespace details
+{
+    inline void RenameDuplicatedMeshes( std::vector<geom::mesh>& Meshes )
+    {
+        using groups = std::unordered_map<std::string, std::vector<std::int32_t>, folded_hash, folded_equal>;
+
+        const std::int32_t  nMeshes = static_cast<std::int32_t>( Meshes.size() );
+        groups              Groups;
+
+        // Ascending mesh indices for every name, entries go stale when their mesh is renamed
+        Groups.reserve( Meshes.size() );
+        for( std::int32_t i = 0; i < nMeshes; ++i )
+            Groups[ Meshes[i].m_Name ].push_back( i );
+
+        if( Groups.size() == Meshes.size() ) return;
+
+        for( std::int32_t i = 0; i < nMeshes; ++i )
+        {
+            auto It = Groups.find( Meshes[i].m_Name );
+            if( It == Groups.end() || It->second.size() < 2 ) continue;
+
+            // Only later meshes matter from now on, and renaming may rehash the table
+            const std::vector<std::int32_t> Members = std::move( It->second );
+            It->second.clear();
+
+            int Count = 0;
+            for( const std::int32_t j : Members )
+            {
+                if( j <= i || folded_equal{}( Meshes[i].m_Name, Meshes[j].m_Name ) == false )
+                    continue;
+
+                Meshes[j].m_Name = std::format( "{}__{}", Meshes[j].m_Name, Count++ );
+
+                auto& Dest = Groups[ Meshes[j].m_Name ];
+                Dest.insert( std::upper_bound( Dest.begin(), Dest.end(), j ), j );
+            }
+        }
+    }
+}
+
+//--------------------------------------------------------------------------
+
+void geom::Serialize
+( bool                      isRead
+, std::wstring_view         FileName
+, xtextfile::file_type      FileType
+, vertex_layout             Layout
+, facet_layout              FacetLayout
+)
+{
+    // Chunk files are recognized by their header so callers do not need to know the format
+    if( isRead && details::chunk_reader::isChunkFile( FileName ) )
+    {
+        SerializeChunked( true, FileName, Layout, FacetLayout );
+        return;
+    }
+
+    if( isRead ) Kill();
+
+    xtextfile::stream File;
+
+    if (auto Err = File.Open(isRead, FileName, FileType); Err)
+        throw(std::runtime_error( std::string(Err.getMessage() )));
+
+    if( isRead == false || File.getRecordName() == "Hierarchy" )
+    {
+        if( auto Err = File.Record
+            ( "Hierarchy"
+            , [&]( std::size_t& C, xerr& Err )
+            {
+                if(isRead) m_Bone.resize( C );
+                else       C   = m_Bone.size();
+            }
+            , [&](std::size_t I, xerr& Err )
+            {
+                int Index = int(I);
+                if (Err = File.Field("Index", Index)) return;
+                auto& Bone = m_Bone[Index];
+
+                   (Err = File.Field( "Name",       Bone.m_Name )                                                                         )
+                || (Err = File.Field( "nChildren",  Bone.m_nChildren )                                                                    )
+                || (Err = File.Field( "iParent",    Bone.m_iParent )                                                                      )
+                || (Err = File.Field( "Scale",      Bone.m_Scale.m_X,    Bone.m_Scale.m_Y,    Bone.m_Scale.m_Z )                          )
+                || (Err = File.Field( "Rotate",     Bone.m_Rotation.m_X, Bone.m_Rotation.m_Y, Bone.m_Rotation.m_Z, Bone.m_Rotation.m_W )  )
+                || (Err = File.Field( "Pos",        Bone.m_Position.m_X, Bone.m_Position.m_Y, Bone.m_Position.m_Z )                       )
+                ;
+            })
+        ; Err ) throw(std::runtime_error(std::string(Err.getMessage())));
+    }
+
+    if( isRead == false || File.getRecordName() == "MaterialInstance" )
+    {
+        if( auto Err = File.Record
+            ( "MaterialInstance"
+            , [&]( std::size_t& C, xerr& Err )
+            {
+                if(isRead) m_MaterialInstance.resize( C );
+                else       C   = m_MaterialInstance.size();
+            }
+            , [&](std::size_t I, xerr& Err )
+            {
+                int Index = int(I);
+                if (Err = File.Field("Index", Index)) return;
+                auto& MaterialInstance = m_MaterialInstance[Index];
+
+                int nParams = isRead ? 0 : int(MaterialInstance.m_Params.size());
+
+                   (Err = File.Field("Name",        MaterialInstance.m_Name)           )
+                || (Err = File.Field("Shader",      MaterialInstance.m_MaterialShader) )
+                || (Err = File.Field("Technique",   MaterialInstance.m_Technique)      )
+                || (Err = File.Field("nParams",     nParams)                           )
+                ;
+                if (Err) return;
+
+                // If we are loading then lets preallocate all the parameters
+                if( isRead == false )
+                {
+                    MaterialInstance.m_Params.resize(MaterialInstance.m_Params.size() + nParams);
+                }
+            })
+        ; Err ) throw(std::runtime_error(std::string(Err.getMessage())));
+
+        //
+        // Read all the parameters for each of the instancces
+        //
+        int iMaterial = 0;
+        int iParam    = 0;
+
+        if( auto Err = File.Record
+            ( "MaterialInstanceParams"
+            , [&]( std::size_t& C, xerr& Err )
+            {
+                if(isRead) m_MaterialInstance.resize( C );
+                else
+                {
+                    // For writting we need to determine how many items we need to write
+                    C   = [&]{ int nEntries = 0; for (auto& E : m_MaterialInstance) nEntries += int(E.m_Params.size()); return nEntries; }();
+
+                    // If need to write items which is the first item?
+                    if(C)
+                    {
+                        for( int i=0; i< m_MaterialInstance.size(); ++i )
+                        {
+                            auto& MatI = m_MaterialInstance[i];
+                            if( MatI.m_Params.size() )
+                            {
+                                iMaterial = i;
+                                iParam    = 0;
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+            , [&](std::size_t I, xerr& Err )
+            {
+                   ( Err = File.Field("iMaterialInstance", iMaterial) )
+                || ( Err = File.Field("iParam",            iParam)    )
+                ;
+                if(Err) return;
+
+                auto& Param = m_MaterialInstance[iMaterial].m_Params[iParam];
+
+                std::string TypeName;
+                if (isRead == false) TypeName = material_instance::getTypeString(Param.m_Type);
+
+                std::string NameView  = Param.m_Name.data();
+                std::string ValueView = Param.m_Value.data();
+
+                   ( Err = File.Field("Name",  NameView     ))
+                || ( Err = File.Field("Type",  TypeName     ))
+                || ( Err = File.Field("Value", ValueView    ))
+                ;
+                if (Err) return;
+
+                if( isRead )
+                {
+                    // Set the type of the param
+                    Param.m_Type = material_instance::params_type::INVALID;
+                    for( int i=1, end_i = int(material_instance::params_type::ENUM_COUNT); i < end_i; ++i )
+                    {
+                        const auto e = static_cast<material_instance::params_type>(i);
+                        if( xstrtool::CompareI( &TypeName[i], material_instance::getTypeString(e) ) == 0 )
+                        {
+                            Param.m_Type = e;
+                            break;
+                        }
+                    }
+
+                    if( Param.m_Type == material_instance::params_type::INVALID )
+                        throw(std::runtime_error("One of the parameters in the material instance was invalid"));
+                }
+                else
+                {
+                    iParam++;
+                    if(iParam == int(m_MaterialInstance[iMaterial].m_Params.size()) )
+                    {
+                        while (m_MaterialInstance[++iMaterial].m_Params.size() == 0);
+                    }
+                    
+                }
+            })
+         ; Err ) throw(std::runtime_error(std::string(Err.getMessage())));
+
+    } // material instances and params
+    
+
+    //
+    // Vertices, these go through the view so that both layouts can be serialized directly
+    //
+    auto SerializeVertices = [&]( auto Vertices )
+    {
+        int nBTNs      = 0;
+        int nUVSets    = 0;
+        int nColors    = 0;
+        int nWeights   = 0;
+
+        std::int32_t MaxBTNs    = 0;
+        std::int32_t MaxUVSets  = 0;
+        std::int32_t MaxColors  = 0;
+        std::int32_t MaxWeights = 0;
+
+        if( auto Err = File.Record
+            ( "Vertices"
+            , [&]( std::size_t& C, xerr& Err )
+            {
+                if(isRead) Vertices.resize( C );
+                else       C   = Vertices.size();
+            }
+            , [&](std::size_t I, xerr& Err )
+            {
+                int Index = int(I);
+                if (Err = File.Field("Index", Index)) return;
+
+                auto&        Position   = Vertices.Position(Index);
+                std::int32_t nBinormals = Vertices.nBinormals(Index);
+                std::int32_t nTangents  = Vertices.nTangents(Index);
+                std::int32_t nNormals   = Vertices.nNormals(Index);
+                std::int32_t nUVs       = Vertices.nUVs(Index);
+                std::int32_t nColorsV   = Vertices.nColors(Index);
+                std::int32_t nWeightsV  = Vertices.nWeights(Index);
+
+                   ( Err = File.Field("Pos",        Position.m_X, Position.m_Y, Position.m_Z) )
+                || ( Err = File.Field("nBinormals", nBinormals)                               )
+                || ( Err = File.Field("nTangents",  nTangents)                                )
+                || ( Err = File.Field("nNormals",   nNormals)                                 )
+                || ( Err = File.Field("nUVSets",    nUVs)                                     )
+                || ( Err = File.Field("nColors",    nColorsV)                                 )
+                || ( Err = File.Field("nWeights",   nWeightsV)                                )
+                ;
+                if(Err) return;
+
+                if( isRead ) Vertices.setCounts( Index, details::MakeVertexCounts( nWeightsV, nNormals, nTangents, nBinormals, nUVs, nColorsV ) );
+
+                const std::int32_t nVertexBTNs = std::max( { nBinormals, nTangents, nNormals } );
+
+                nBTNs      += nVertexBTNs;
+                nUVSets    += nUVs;
+                nColors    += nColorsV;
+                nWeights   += nWeightsV;
+
+                MaxBTNs     = std::max( MaxBTNs,    nVertexBTNs );
+                MaxUVSets   = std::max( MaxUVSets,  nUVs );
+                MaxColors   = std::max( MaxColors,  nColorsV );
+                MaxWeights  = std::max( MaxWeights, nWeightsV );
+            })
+         ; Err ) throw(std::runtime_error(std::string(Err.getMessage())));
+
+        // Now that we know which channels are used we can allocate them
+        if( isRead ) Vertices.AllocateChannels( MaxUVSets, MaxColors, MaxBTNs, MaxWeights );
+
+        if( isRead == false || File.getRecordName() == "Colors" )
+        {
+            int iColor  = 0;
+            int iVertex = 0;
+
+            if( auto Err = File.Record
+                ( "Colors"
+                , [&]( std::size_t& C, xerr& Err )
+                {
+                    if(isRead){ assert( C == nColors ); }
+                    else       C   = nColors;
+                }
+                , [&](std::size_t, xerr& Err )
+                {
+                    // Skip writing vertices that don't have colors
+                    if( isRead == false )
+                    {
+                        while( Vertices.nColors(iVertex) == 0 )
+                        {
+                            iVertex++;
+                            iColor = 0;
+                        }
+                    }
+
+                    if (Err = File.Field("iVertex", iVertex)) return;
+                    if (Err = File.Field("Index", iColor)) return;
+
+                    auto& C = Vertices.Color( iVertex, iColor );
+                    if( ++iColor == Vertices.nColors(iVertex) ) 
+                    {
+                        iVertex++;
+                        iColor  = 0;
+                    }
+
+                    xmath::fvec4 FColor = C.getRGBA();
+                    if( Err = File.Field("Color", FColor.m_X, FColor.m_Y, FColor.m_Z, FColor.m_W) ) return;
+                    if( isRead ) C.setupFromRGBA( FColor );
+                })
+             ; Err ) throw(std::runtime_error(std::string(Err.getMessage())));
+        }
+    
+        if( isRead == false || File.getRecordName() == "BTNs" )
+        {
+            int iBTN    = 0;
+            int iVertex = 0;
+
+            if( auto Err = File.Record
+                ( "BTNs"
+                , [&]( std::size_t& C, xerr& Err )
+                {
+                    if(isRead) { assert( C == nBTNs); }
+                    else       C   = nBTNs;
+                }
+                , [&](std::size_t, xerr& Err )
+                {
+                    // Skip writing vertices that don't have btns
+                    if (isRead == false)
+                    {
+                        while( Vertices.nBinormals(iVertex) == 0 
+                            && Vertices.nTangents(iVertex)  == 0
+                            && Vertices.nNormals(iVertex)   == 0 )
+                        {
+                            iVertex++;
+                            iBTN = 0;
+                        }
+                    }
+
+                    if (Err = File.Field("iVertex", iVertex)) return;
+                    if (Err = File.Field("Index", iBTN)) return;
+
+                    auto& BTN = Vertices.BTN( iVertex, iBTN );
+                    if( ++iBTN >= Vertices.nTangents(iVertex)
+                     && iBTN   >= Vertices.nNormals(iVertex)
+                     && iBTN   >= Vertices.nBinormals(iVertex) )
+                    {
+                        iVertex++;
+                        iBTN = 0;
+                    }
+
+                       (Err = File.Field("Binormals", BTN.m_Binormal.m_X, BTN.m_Binormal.m_Y, BTN.m_Binormal.m_Z, BTN.m_Binormal.m_W ))
+                    || (Err = File.Field("Tangents",  BTN.m_Tangent.m_X,  BTN.m_Tangent.m_Y,  BTN.m_Tangent.m_Z,  BTN.m_Tangent.m_W ))
+                    || (Err = File.Field("Normals",   BTN.m_Normal.m_X,   BTN.m_Normal.m_Y,   BTN.m_Normal.m_Z))
+                    ;
+                })
+             ; Err ) throw(std::runtime_error( std::string(Err.getMessage())));
+        }
+
+        if( isRead == false || File.getRecordName() == "UVs" )
+        {
+            int iUVs    = 0;
+            int iVertex = 0;
+
+            if( auto Err = File.Record
+                ( "UVs"
+                , [&]( std::size_t& C, xerr& Err )
+                {
+                    if(isRead) { assert( C == nUVSets ); }
+                    else       C   = nUVSets;
+                }
+                , [&](std::size_t, xerr& Err )
+                {
+                    // Skip writing vertices that don't have colors
+                    if( isRead == false )
+                    {
+                        while( Vertices.nUVs(iVertex) == 0 )
+                        {
+                            iVertex++;
+                            iUVs = 0;
+                        }
+                    }
+
+                    if (Err = File.Field("iVertex", iVertex)) return;
+                    if (Err = File.Field("Index", iUVs)) return;
+
+                    auto& UV = Vertices.UV( iVertex, iUVs );
+                    if( ++iUVs == Vertices.nUVs(iVertex) )
+                    {
+                        iVertex++;
+                        iUVs = 0;
+                    }
+
+                    Err = File.Field("UV", UV.m_X, UV.m_Y );
+                })
+             ) throw(std::runtime_error( std::string(Err.getMessage())));
+        }
+
+        if( isRead == false || File.getRecordName() == "Skin" )
+        {
+            int iWeight = 0;
+            int iVertex = 0;
+
+            if( auto Err = File.Record
+                ( "Skin"
+                , [&]( std::size_t& C, xerr& Err )
+                {
+                    if(isRead) { assert( C == nWeights); }
+                    else       C   = nWeights;
+                }
+                , [&](std::size_t, xerr& Err )
+                {
+                    // Skip writing vertices that don't have colors
+                    if( isRead == false )
+                    {
+                        while( Vertices.nWeights(iVertex) == 0 )
+                        {
+                            iVertex++;
+                            iWeight = 0;
+                        }
+                    }
+
+                    if (Err = File.Field("iVertex", iVertex)) return;
+                    if (Err = File.Field("Index", iWeight)) return;
+
+                    auto& Weight = Vertices.Weight( iVertex, iWeight );
+                    if( ++iWeight == Vertices.nWeights(iVertex) )
+                    {
+                        iVertex++;
+                        iWeight = 0;
+                    }
+
+                       ( Err =  File.Field("iBone",  Weight.m_iBone) )
+                    || ( Err =  File.Field("Weight", Weight.m_Weight))
+                    ;
+                })
+             ) throw(std::runtime_error( std::string(Err.getMessage())));
+        }
+    };
+
+    if( isRead ? Layout == vertex_layout::STREAMS : isStreamLayout() ) SerializeVertices( details::vertex_stream_view<vertex_streams>{ m_Streams } );
+    else                                                                SerializeVertices( details::vertex_array_view<std::vector<vertex>>{ m_Vertex } );
+
+    //
+    // Facets, same as the vertices they go through the view. The facet layout writes m_Plane as kept
+    // by UpdateFacetPlanes, the triangle layout stores no planes so it computes them in one batch to
+    // write them and ignores them when reading
+    //
+    if( isRead == false ) UpdateFacetPlanes();
+
+    auto SerializeFacets = [&]( auto Facets )
+    {
+        std::vector<xmath::fplane> Planes;
+        if( isRead == false && isTriangleLayout() )
+        {
+            Planes.resize( Facets.size() );
+            ComputeFacetPlanes( Planes );
+        }
+
+        int nIndices = 0;
+        if( auto Err = File.Record
+            ( "Polygons"
+            , [&]( std::size_t& C, xerr& Err )
+            {
+                if(isRead) Facets.resize( C );
+                else       C   = Facets.size();
+            }
+            , [&](std::size_t I, xerr& Err )
+            {
+                facet Facet{};
+                if( isRead == false )
+                {
+                    Facets.getFacet( I, Facet );
+                    if( Planes.empty() == false ) Facet.m_Plane = Planes[I];
+                }
+
+                   ( Err =  File.Field("iMesh",     Facet.m_iMesh)              )
+                || ( Err =  File.Field("nVerts",    Facet.m_nVertices)          )
+                || ( Err =  File.Field("Plane",     Facet.m_Plane.m_Normal.m_X  
+                                                  , Facet.m_Plane.m_Normal.m_Y  
+                                                  , Facet.m_Plane.m_Normal.m_Z  
+                                                  , Facet.m_Plane.m_D )         )
+                || ( Err =  File.Field("iMaterialInstance", Facet.m_iMaterialInstance)  )
+                ;
+                if( Err ) return;
+
+                // The indices are filled by the FacetIndex record
+                if( isRead ) Facets.setFacet( I, Facet );
+
+                nIndices += Facet.m_nVertices;
+            })
+         ; Err ) throw(std::runtime_error( std::string(Err.getMessage())));
+
+        int iIndex = 0;
+        int iFacet = 0;
+        if( auto Err = File.Record
+            ( "FacetIndex"
+            , [&]( std::size_t& C, xerr& Err )
+            {
+                if(isRead) assert( C == nIndices );
+                else       C   = nIndices;
+            }
+            , [&](std::size_t, xerr& Err )
+            {
+                   (Err = File.Field("iFacet", iFacet)      )
+                || (Err = File.Field("Index",  iIndex)      )
+                ;
+                if( Err ) return;
+
+                std::int32_t iVertex = isRead ? 0 : Facets.iVertex( iFacet, iIndex );
+                if( Err = File.Field("iVertex", iVertex ); Err ) return;
+                if( isRead ) Facets.setVertex( iFacet, iIndex, iVertex );
+
+                if( ++iIndex == Facets.nVertices(iFacet) )
+                {
+                    iFacet++;
+                    iIndex = 0;
+                }
+            })
+         ; Err ) throw( std::runtime_error(std::string(Err.getMessage())));
+    };
+
+    if( isRead ? FacetLayout == facet_layout::TRIANGLES : isTriangleLayout() ) SerializeFacets( details::triangle_list_view<triangle_list>{ m_Triangles } );
+    else                                                                   SerializeFacets( details::facet_array_view<std::vector<facet>>{ m_Facet } );
+
+    // The planes we just read are good
+    if( isRead ) m_bFacetPlanesDirty = FacetLayout == facet_layout::TRIANGLES;
+
+    if (isRead == false || File.getRecordName() == "Mesh")
+    {
+        if( auto Err = File.Record
+            ( "Mesh"
+            , [&]( std::size_t& C, xerr& Err )
+            {
+                if(isRead) m_Mesh.resize( C );
+                else       C   = m_Mesh.size();
+            }
+            , [&](std::size_t I, xerr& Err )
+            {
+                Err = File.Field("Name", m_Mesh[I].m_Name);
+            })
+         ) throw(std::runtime_error( std::string(Err.getMessage())));
+
+        if (isRead)
+        {
+            // Rename duplicated names if we found any
+            details::RenameDuplicatedMeshes( m_Mesh );
+            InvalidateMeshIndex();
+        }
+    }
+        
+    // Compute all bone related info
+    if( isRead ) ComputeBoneInfo();
+}
+
+//--------------------------------------------------------------------------
+// Layout of the geom chunk file. The records are plain data so they can be used straight from
+// the mapped file, the vertex channels get one chunk each ("VUV0", "VUV1", ...) and the facets
+// are stored flat: all the indices in one chunk plus the vertex count of each facet, which is
+// left out when all of them are triangles. With lossy compression the btn channels are stored
+// octahedral instead ("VBQ0", "VBQ1", ...), two snorm16 per vector.
+//--------------------------------------------------------------------------
+namespace details
+{
+    struct geom_chunk
+    {
+        static constexpr std::uint32_t file_type_v          = MakeChunkID( "GEOM" );
+        static constexpr std::uint32_t bones_v              = MakeChunkID( "BONE" );
+        static constexpr std::uint32_t materials_v          = MakeChunkID( "MATI" );
+        static constexpr std::uint32_t params_v             = MakeChunkID( "MATP" );
+        static constexpr std::uint32_t meshes_v             = MakeChunkID( "MESH" );
+        static constexpr std::uint32_t positions_v          = MakeChunkID( "VPOS" );
+        static constexpr std::uint32_t counts_v             = MakeChunkID( "VCNT" );
+        static constexpr std::uint32_t frames_v             = MakeChunkID( "VFRM" );
+        static constexpr std::uint32_t uvs_v                = MakeChunkID( "VUV0" );
+        static constexpr std::uint32_t colors_v             = MakeChunkID( "VCL0" );
+        static constexpr std::uint32_t btns_v               = MakeChunkID( "VBT0" );
+        static constexpr std::uint32_t octahedral_btns_v    = MakeChunkID( "VBQ0" );
+        static constexpr std::uint32_t weights_v            = MakeChunkID( "VWT0" );
+        static constexpr std::uint32_t facet_indices_v      = MakeChunkID( "FIDX" );
+        static constexpr std::uint32_t facet_counts_v       = MakeChunkID( "FCNT" );
+        static constexpr std::uint32_t facet_meshes_v       = MakeChunkID( "FMSH" );
+        static constexpr std::uint32_t facet_materials_v    = MakeChunkID( "FMAT" );
+        static constexpr std::uint32_t mesh_ranges_v        = MakeChunkID( "MRNG" );
+        static constexpr std::uint32_t facet_runs_v         = MakeChunkID( "MRUN" );
+
+        using octahedral_btn = std::array<std::int16_t, 6>;                         // Binormal, tangent and normal
+        struct bone
+        {
+            chunk_string                                    m_Name;
+            std::int32_t                                    m_nChildren;
+            std::int32_t                                    m_iParent;
+            std::array<float, 3>                            m_Scale;
+            std::array<float, 4>                            m_Rotation;
+            std::array<float, 3>                            m_Position;
+        };
+
+        struct material
+        {
+            chunk_string                                    m_Name;
+            chunk_string                                    m_Shader;
+            chunk_string                                    m_Technique;
+            std::uint32_t                                   m_iFirstParam;
+            std::uint32_t                                   m_nParams;
+        };
+
+        struct param
+        {
+            std::uint32_t                                   m_Type;
+            chunk_string                                    m_Name;
+            chunk_string                                    m_Value;
+        };
+
+        struct mesh
+        {
+            chunk_string                                    m_ScenePath;
+            chunk_string                                    m_Name;
+            std::int32_t                                    m_nBones;
+        };
+
+        // Table of contents of the facets, one range per mesh. The facets of a mesh are the runs
+        // [m_iFirstRun, m_iFirstRun + m_nRuns), the vertices are found through their indices
+        struct mesh_range
+        {
+            std::uint32_t                                   m_iFirstRun;
+            std::uint32_t                                   m_nRuns;
+        };
+
+        struct facet_run
+        {
+            std::uint64_t                                   m_iFirstFacet;
+            std::uint64_t                                   m_nFacets;
+            std::uint64_t                                   m_iFirstIndex;  // In the facet_indices_v chunk
+        };
+    };
+
+    //--------------------------------------------------------------------------
+    // Octahedral mapping of a unit vector to two snorm16. Zero vectors (unused slots) get a code
+    // of their own so they come back as zero.
+    //--------------------------------------------------------------------------
+    constexpr std::int16_t octahedral_zero_v = -32768;
+
+    inline void EncodeOctahedral( const xmath::fvec3& V, std::int16_t* pOut ) noexcept
+    {
+        const float L = std::abs( V.m_X ) + std::abs( V.m_Y ) + std::abs( V.m_Z );
+        if( L == 0 )
+        {
+            pOut[0] = pOut[1] = octahedral_zero_v;
+            return;
+        }
+
+        float X = V.m_X / L;
+        float Y = V.m_Y / L;
+        if( V.m_Z < 0 )
+        {
+            const float T = X;
+            X = ( 1 - std::abs( Y ) ) * ( T >= 0 ? 1.0f : -1.0f );
+            Y = ( 1 - std::abs( T ) ) * ( Y >= 0 ? 1.0f : -1.0f );
+        }
+
+        pOut[0] = static_cast<std::int16_t>( std::lround( std::clamp( X, -1.0f, 1.0f ) * 32767.0f ) );
+        pOut[1] = static_cast<std::int16_t>( std::lround( std::clamp( Y, -1.0f, 1.0f ) * 32767.0f ) );
+    }
+
+    inline xmath::fvec3 DecodeOctahedral( const std::int16_t* pIn ) noexcept
+    {
+        if( pIn[0] == octahedral_zero_v ) return xmath::fvec3( 0, 0, 0 );
+
+        float       X = pIn[0] / 32767.0f;
+        float       Y = pIn[1] / 32767.0f;
+        const float Z = 1 - std::abs( X ) - std::abs( Y );
+        const float T = std::max( -Z, 0.0f );
+        X += X >= 0 ? -T : T;
+        Y += Y >= 0 ? -T : T;
+
+        const float L = std::sqrt( X * X + Y * Y + Z * Z );
+        return xmath::fvec3( X / L, Y / L, Z / L );
+    }
+
+    //--------------------------------------------------------------------------
+    // Groups the facets of each mesh in runs of consecutive facets. Counts is the vertex count of
+    // every facet or empty for triangles. Facets with a mesh out of range are left out.
+    //--------------------------------------------------------------------------
+    inline void BuildFacetRuns
+    ( std::span<const std::int32_t>             Meshes
+    , std::span<const std::uint8_t>             Counts
+    , std::size_t                               nMeshes
+    , std::vector<geom_chunk::mesh_range>&      Ranges
+    , std::vector<geom_chunk::facet_run>&       Runs
+    )
+    {
+        std::vector<std::vector<geom_chunk::facet_run>> MeshRuns( nMeshes );
+
+        Ranges.assign( nMeshes, geom_chunk::mesh_range{ 0, 0 } );
+
+        std::uint64_t iIndex = 0;
+        for( std::size_t i = 0; i < Meshes.size(); ++i )
+        {
+            const std::uint64_t nVerts = Counts.empty() ? 3 : Counts[i];
+            const std::int32_t  iMesh  = Meshes[i];
+
+            if( iMesh >= 0 && static_cast<std::size_t>(iMesh) < nMeshes )
+            {
+                auto& List = MeshRuns[iMesh];
+                if( List.empty() == false && List.back().m_iFirstFacet + List.back().m_nFacets == i ) List.back().m_nFacets++;
+                else                                                                                 List.push_back( { i, 1, iIndex } );
+            }
+
+            iIndex += nVerts;
+        }
+
+        Runs.clear();
+        for( std::size_t i = 0; i < nMeshes; ++i )
+        {
+            Ranges[i].m_iFirstRun   = static_cast<std::uint32_t>( Runs.size() );
+            Ranges[i].m_nRuns       = static_cast<std::uint32_t>( MeshRuns[i].size() );
+            Runs.insert( Runs.end(), MeshRuns[i].begin(), MeshRuns[i].end() );
+        }
+    }
+
+    //--------------------------------------------------------------------------
+
+    template< typename T >
+    void AddChannelChunks( chunk_writer& Writer, std::uint32_t BaseID, const std::vector<std::vector<T>>& Channels )
+    {
+        for( std::size_t i = 0; i < Channels.size(); ++i )
+            Writer.Add( MakeChannelChunkID( BaseID, static_cast<std::int32_t>(i) ), std::span<const T>{ Channels[i] }, chunk_encoding::DELTA );
+    }
+
+    //--------------------------------------------------------------------------
+
+    //--------------------------------------------------------------------------
+    // A section of a mapped chunk file going to its place in memory. The loaders size all their
+    // destinations first and then run every copy at once, so the sections are decoded (and their
+    // pages faulted in) by all the cores instead of one section after the other.
+    //--------------------------------------------------------------------------
+    struct chunk_copy
+    {
+        std::byte*                                      m_pDst;
+        const std::byte*                                m_pSrc;
+        std::size_t                                     m_Size;
+    };
+
+    inline void RunChunkCopies( std::span<const chunk_copy> Copies )
+    {
+        constexpr std::size_t block_v = 1 << 20;
+
+        // Big sections are split in blocks so they get shared between the threads
+        std::vector<chunk_copy> Blocks;
+        std::size_t             Total = 0;
+        for( const chunk_copy& Copy : Copies )
+        {
+            for( std::size_t Offset = 0; Offset < Copy.m_Size; Offset += block_v )
+                Blocks.push_back( { Copy.m_pDst + Offset, Copy.m_pSrc + Offset, std::min( block_v, Copy.m_Size - Offset ) } );
+            Total += Copy.m_Size;
+        }
+
+        // Partial loads make lots of small copies, those get grouped so a task is still about a block
+        const std::size_t Grain = std::max<std::size_t>( 1, Blocks.size() * block_v / std::max<std::size_t>( 1, Total ) );
+
+        ParallelFor( Blocks.size(), Grain, [&]( std::size_t iBegin, std::size_t iEnd )
+        {
+            for( std::size_t i = iBegin; i < iEnd; ++i )
+                std::memcpy( Blocks[i].m_pDst, Blocks[i].m_pSrc, Blocks[i].m_Size );
+        });
+    }
+
+    //--------------------------------------------------------------------------
+
+    // Sizes the stream of a vertex chunk and queues the copies of the vertices in Ranges, packed one after the other.
+    // Compressed chunks only decode the blocks that hold those vertices.
+    template< typename T >
+    void GatherVertexChunk( const chunk_reader& Reader, std::uint32_t ID, std::size_t nVertices, std::span<const element_range> Ranges, std::vector<T>& Stream, std::vector<chunk_copy>& Copies )
+    {
+        const chunk_entry* pEntry = Reader.find( ID );
+        if( ( pEntry ? pEntry->m_Count : 0 ) != nVertices )
+            throw(std::runtime_error( "The chunk file has vertex streams with different sizes" ));
+
+        const auto  Src   = Reader.get<T>( ID, Ranges );
+        std::size_t nKept = 0;
+        for( const element_range& Range : Ranges ) nKept += static_cast<std::size_t>( Range.m_iEnd - Range.m_iBegin );
+        Stream.resize( nKept );
+
+        auto*       pDst = reinterpret_cast<std::byte*>( Stream.data() );
+        for( const element_range& Range : Ranges )
+        {
+            const std::size_t n = static_cast<std::size_t>( Range.m_iEnd - Range.m_iBegin );
+            Copies.push_back( { pDst, reinterpret_cast<const std::byte*>( &Src[ Range.m_iBegin ] ), n * sizeof(T) } );
+            pDst += n * sizeof(T);
+        }
+    }
+
+    //--------------------------------------------------------------------------
+
+    template< typename T >
+    void GatherChannelChunks( const chunk_reader& Reader, std::uint32_t BaseID, std::int32_t MaxChannels, std::size_t nVertices, std::span<const element_range> Ranges, std::vector<std::vector<T>>& Channels, std::vector<chunk_copy>& Copies )
+    {
+        // The copies point to the buffer of each channel which stays put when Channels grows
+        for( std::int32_t i = 0; i < MaxChannels && Reader.find( MakeChannelChunkID( BaseID, i ) ); ++i )
+            GatherVertexChunk( Reader, MakeChannelChunkID( BaseID, i ), nVertices, Ranges, Channels.emplace_back(), Copies );
+    }
+
+    //--------------------------------------------------------------------------
+    // Reads all the vertex streams, or only the vertices in Keep (sorted) when given. The streams are
+    // independent sections of the file so they are all copied concurrently. The weights must
+    // point to one of the nBones bones.
+
+    inline void ReadChunkVertices( const chunk_reader& Reader, const std::vector<std::uint32_t>* pKeep, std::size_t nBones, geom::vertex_streams& Streams )
+    {
+        using chunk = geom_chunk;
+
+        const chunk_entry*          pPositions = Reader.find( chunk::positions_v );
+        const std::size_t           nVertices  = pPositions ? static_cast<std::size_t>( pPositions->m_Count ) : 0;
+        std::vector<element_range>  Ranges;
+        std::vector<chunk_copy>     Copies;
+
+        // The vertices we want as runs of consecutive ones, each run is then a single copy per stream
+        if( pKeep == nullptr )
+        {
+            if( nVertices ) Ranges.push_back( { 0, nVertices } );
+        }
+        else
+        {
+            const auto& Keep = *pKeep;
+            for( std::size_t i = 0; i < Keep.size(); )
+            {
+                std::size_t n = 1;
+                while( i + n < Keep.size() && Keep[i + n] == Keep[i] + n ) ++n;
+
+                Ranges.push_back( { Keep[i], Keep[i] + n } );
+                i += n;
+            }
+        }
+
+        // Compressed streams are decoded together, the cores share the blocks of all of them
+        std::vector<std::uint32_t> IDs = { chunk::positions_v, chunk::counts_v, chunk::frames_v };
+        auto AddChannelIDs = [&]( std::uint32_t BaseID, std::int32_t MaxChannels )
+        {
+            for( std::int32_t i = 0; i < MaxChannels; ++i ) IDs.push_back( MakeChannelChunkID( BaseID, i ) );
+        };
+        AddChannelIDs( chunk::uvs_v,             geom::vertex_max_uv_v );
+        AddChannelIDs( chunk::colors_v,          geom::vertex_max_colors_v );
+        AddChannelIDs( chunk::btns_v,            geom::vertex_max_normals_v );
+        AddChannelIDs( chunk::weights_v,         geom::vertex_max_weights_v );
+        AddChannelIDs( chunk::octahedral_btns_v, geom::vertex_max_normals_v );
+        Reader.Prefetch( IDs, Ranges );
+
+        GatherVertexChunk( Reader, chunk::positions_v, nVertices, Ranges, Streams.m_Position, Copies );
+        GatherVertexChunk( Reader, chunk::counts_v,    nVertices, Ranges, Streams.m_Count,    Copies );
+        if( Reader.find( chunk::frames_v ) ) GatherVertexChunk( Reader, chunk::frames_v, nVertices, Ranges, Streams.m_iFrame, Copies );
+
+        GatherChannelChunks( Reader, chunk::uvs_v,     geom::vertex_max_uv_v,      nVertices, Ranges, Streams.m_UV,     Copies );
+        GatherChannelChunks( Reader, chunk::colors_v,  geom::vertex_max_colors_v,  nVertices, Ranges, Streams.m_Color,  Copies );
+        GatherChannelChunks( Reader, chunk::btns_v,    geom::vertex_max_normals_v, nVertices, Ranges, Streams.m_BTN,    Copies );
+        GatherChannelChunks( Reader, chunk::weights_v, geom::vertex_max_weights_v, nVertices, Ranges, Streams.m_Weight, Copies );
+
+        std::vector<std::vector<chunk::octahedral_btn>> Octahedral;
+        if( Streams.m_BTN.empty() ) GatherChannelChunks( Reader, chunk::octahedral_btns_v, geom::vertex_max_normals_v, nVertices, Ranges, Octahedral, Copies );
+
+        RunChunkCopies( Copies );
+
+        // Lossy files have the btns octahedral
+        Streams.m_BTN.resize( std::max( Streams.m_BTN.size(), Octahedral.size() ) );
+        for( std::size_t c = 0; c < Octahedral.size(); ++c )
+        {
+            const auto& Src = Octahedral[c];
+            auto&       Dst = Streams.m_BTN[c];
+            Dst.resize( Src.size() );
+            ParallelFor( Src.size(), 4096, [&]( std::size_t iBegin, std::size_t iEnd )
+            {
+                for( std::size_t i = iBegin; i < iEnd; ++i )
+                {
+                    Dst[i].m_Binormal = DecodeOctahedral( &Src[i][0] );
+                    Dst[i].m_Tangent  = DecodeOctahedral( &Src[i][2] );
+                    Dst[i].m_Normal   = DecodeOctahedral( &Src[i][4] );
+                }
+            });
+        }
+
+        // Every vertex must fit in the channels we got and its weights must point to real bones
+        ParallelFor( Streams.m_Count.size(), 4096, [&]( std::size_t iBegin, std::size_t iEnd )
+        {
+            for( std::size_t i = iBegin; i < iEnd; ++i )
+            {
+                const geom::vertex_counts& Count = Streams.m_Count[i];
+                if( Count.m_nUVs     > Streams.m_UV.size()
+                 || Count.m_nColors  > Streams.m_Color.size()
+                 || Count.m_nWeights > Streams.m_Weight.size()
+                 || std::max( { Count.m_nNormals, Count.m_nTangents, Count.m_nBinormals } ) > Streams.m_BTN.size() )
+                    throw(std::runtime_error( "The chunk file has a vertex with more attributes than channels" ));
+
+                for( std::size_t k = 0; k < Count.m_nWeights; ++k )
+                {
+                    const std::int32_t iBone = Streams.m_Weight[k][i].m_iBone;
+                    if( iBone < 0 || static_cast<std::size_t>( iBone ) >= nBones )
+                        throw(std::runtime_error( std::format( "The chunk file has a vertex weight with an invalid bone {}", iBone ) ));
+                }
+            }
+        });
+    }
+
+    //--------------------------------------------------------------------------
+
+    inline void ReadChunkBones( const chunk_reader& Reader, std::vector<geom::bone>& Bones )
+    {
+        const auto Records = Reader.get<geom_chunk::bone>( geom_chunk::bones_v );
+        Bones.resize( Records.size() );
+        for( std::size_t i = 0; i < Records.size(); ++i )
+        {
+            const auto& Src  = Records[i];
+            auto&       Bone = Bones[i];
+            Bone.m_Name         = Reader.getString( Src.m_Name );
+            Bone.m_nChildren    = Src.m_nChildren;
+            Bone.m_iParent      = Src.m_iParent;
+            Bone.m_Scale        = xmath::fvec3( Src.m_Scale[0], Src.m_Scale[1], Src.m_Scale[2] );
+            Bone.m_Rotation.m_X = Src.m_Rotation[0];
+            Bone.m_Rotation.m_Y = Src.m_Rotation[1];
+            Bone.m_Rotation.m_Z = Src.m_Rotation[2];
+            Bone.m_Rotation.m_W = Src.m_Rotation[3];
+            Bone.m_Position     = xmath::fvec3( Src.m_Position[0], Src.m_Position[1], Src.m_Position[2] );
+
+            if( Bone.m_iParent < -1 || Bone.m_iParent >= static_cast<std::int32_t>( Records.size() ) )
+                throw(std::runtime_error( "The chunk file has a bone with an invalid parent" ));
+        }
+    }
+
+    //--------------------------------------------------------------------------
+
+    inline void ReadChunkMaterials( const chunk_reader& Reader, std::vector<geom::material_instance>& MaterialInstances )
+    {
+        using material_instance = geom::material_instance;
+
+        const auto Materials = Reader.get<geom_chunk::material>( geom_chunk::materials_v );
+        const auto Params    = Reader.get<geom_chunk::param>( geom_chunk::params_v );
+        MaterialInstances.resize( Materials.size() );
+        for( std::size_t i = 0; i < Materials.size(); ++i )
+        {
+            const auto& Src      = Materials[i];
+            auto&       Material = MaterialInstances[i];
+            Material.m_Name             = Reader.getString( Src.m_Name );
+            Material.m_MaterialShader   = Reader.getString( Src.m_Shader );
+            Material.m_Technique        = Reader.getString( Src.m_Technique );
+
+            if( Src.m_iFirstParam > Params.size() || Src.m_nParams > Params.size() - Src.m_iFirstParam )
+                throw(std::runtime_error( "The chunk file has a material instance with invalid parameters" ));
+
+            Material.m_Params.resize( Src.m_nParams );
+            for( std::uint32_t j = 0; j < Src.m_nParams; ++j )
+            {
+                const auto& SrcParam = Params[ Src.m_iFirstParam + j ];
+                auto&       Param    = Material.m_Params[j];
+
+                if( SrcParam.m_Type == 0 || SrcParam.m_Type >= static_cast<std::uint32_t>( material_instance::params_type::ENUM_COUNT ) )
+                    throw(std::runtime_error("One of the parameters in the material instance was invalid"));
+
+                Param.m_Type    = static_cast<material_instance::params_type>( SrcParam.m_Type );
+                Param.m_Name    = Reader.getString( SrcParam.m_Name );
+                Param.m_Value   = Reader.getString( SrcParam.m_Value );
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+
+    inline void ReadChunkMeshes( const chunk_reader& Reader, std::vector<geom::mesh>& Meshes )
+    {
+        const auto Records = Reader.get<geom_chunk::mesh>( geom_chunk::meshes_v );
+        Meshes.resize( Records.size() );
+        for( std::size_t i = 0; i < Records.size(); ++i )
+        {
+            Meshes[i].m_ScenePath   = Reader.getString( Records[i].m_ScenePath );
+            Meshes[i].m_Name        = Reader.getString( Records[i].m_Name );
+            Meshes[i].m_nBones      = Records[i].m_nBones;
+        }
+    }
+}
 
-    xtextfile::stream File;
+//--------------------------------------------------------------------------
 
-    if (auto Err = File.Open(isRead, FileName, FileType); Err)
-        throw(std::runtime_error( std::string(Err.getMessage() )));
+void geom::SerializeChunked( bool isRead, std::wstring_view FileName, vertex_layout Layout, facet_layout FacetLayout, compression Compression )
+{
+    using chunk = details::geom_chunk;
+    using details::chunk_encoding;
 
-    if( isRead == false || File.getRecordName() == "Hierarchy" )
+    if( isRead == false )
     {
-        if( auto Err = File.Record
-            ( "Hierarchy"
-            , [&]( std::size_t& C, xerr& Err )
+        details::chunk_writer Writer;
+        Writer.setCompression( Compression != compression::NONE );
+
+        //
+        // Bones, materials and meshes
+        //
+        {
+            std::vector<chunk::bone> Bones( m_Bone.size() );
+            for( std::size_t i = 0; i < m_Bone.size(); ++i )
             {
-                if(isRead) m_Bone.resize( C );
-                else       C   = m_Bone.size();
+                const auto& Bone = m_Bone[i];
+                Bones[i].m_Name         = Writer.AddString( Bone.m_Name );
+                Bones[i].m_nChildren    = Bone.m_nChildren;
+                Bones[i].m_iParent      = Bone.m_iParent;
+                Bones[i].m_Scale        = { Bone.m_Scale.m_X,    Bone.m_Scale.m_Y,    Bone.m_Scale.m_Z };
+                Bones[i].m_Rotation     = { Bone.m_Rotation.m_X, Bone.m_Rotation.m_Y, Bone.m_Rotation.m_Z, Bone.m_Rotation.m_W };
+                Bones[i].m_Position     = { Bone.m_Position.m_X, Bone.m_Position.m_Y, Bone.m_Position.m_Z };
             }
-            , [&](std::size_t I, xerr& Err )
+            Writer.Add( chunk::bones_v, std::move(Bones) );
+
+            std::vector<chunk::material> Materials( m_MaterialInstance.size() );
+            std::vector<chunk::param>    Params;
+            for( std::size_t i = 0; i < m_MaterialInstance.size(); ++i )
             {
-                int Index = int(I);
-                if (Err = File.Field("Index", Index)) return;
-                auto& Bone = m_Bone[Index];
+                const auto& Material = m_MaterialInstance[i];
+                Materials[i].m_Name         = Writer.AddString( Material.m_Name );
+                Materials[i].m_Shader       = Writer.AddString( Material.m_MaterialShader );
+                Materials[i].m_Technique    = Writer.AddString( Material.m_Technique );
+                Materials[i].m_iFirstParam  = static_cast<std::uint32_t>( Params.size() );
+                Materials[i].m_nParams      = static_cast<std::uint32_t>( Material.m_Params.size() );
+
+                for( const auto& Param : Material.m_Params )
+                    Params.push_back( { static_cast<std::uint32_t>( Param.m_Type ), Writer.AddString( Param.m_Name ), Writer.AddString( Param.m_Value ) } );
+            }
+            Writer.Add( chunk::materials_v, std::move(Materials) );
+            Writer.Add( chunk::params_v,    std::move(Params) );
 
-                   (Err = File.Field( "Name",       Bone.m_Name )                                                                         )
-                || (Err = File.Field( "nChildren",  Bone.m_nChildren )                                                                    )
-                || (Err = File.Field( "iParent",    Bone.m_iParent )                                                                      )
-                || (Err = File.Field( "Scale",      Bone.m_Scale.m_X,    Bone.m_Scale.m_Y,    Bone.m_Scale.m_Z )                          )
-                || (Err = File.Field( "Rotate",     Bone.m_Rotation.m_X, Bone.m_Rotation.m_Y, Bone.m_Rotation.m_Z, Bone.m_Rotation.m_W )  )
-                || (Err = File.Field( "Pos",        Bone.m_Position.m_X, Bone.m_Position.m_Y, Bone.m_Position.m_Z )                       )
-                ;
-            })
-        ; Err ) throw(std::runtime_error(std::string(Err.getMessage())));
-    }
+            std::vector<chunk::mesh> Meshes( m_Mesh.size() );
+            for( std::size_t i = 0; i < m_Mesh.size(); ++i )
+            {
+                Meshes[i].m_ScenePath   = Writer.AddString( m_Mesh[i].m_ScenePath );
+                Meshes[i].m_Name        = Writer.AddString( m_Mesh[i].m_Name );
+                Meshes[i].m_nBones      = m_Mesh[i].m_nBones;
+            }
+            Writer.Add( chunk::meshes_v, std::move(Meshes) );
+        }
 
-    if( isRead == false || File.getRecordName() == "MaterialInstance" )
-    {
-        if( auto Err = File.Record
-            ( "MaterialInstance"
-            , [&]( std::size_t& C, xerr& Err )
+        //
+        // Vertices are always stored as streams, the vertex layout gets converted into a temporary
+        //
+        vertex_streams          Temp;
+        const vertex_streams&   Streams = isStreamLayout() ? m_Streams : ( details::MakeVertexStreams( m_Vertex, Temp ), Temp );
+
+        Writer.Add( chunk::positions_v, std::span<const xmath::fvec3>{ Streams.m_Position }, chunk_encoding::DELTA );
+        Writer.Add( chunk::counts_v,    std::span<const vertex_counts>{ Streams.m_Count },  chunk_encoding::DELTA );
+        if( Streams.m_iFrame.empty() == false ) Writer.Add( chunk::frames_v, std::span<const std::int32_t>{ Streams.m_iFrame }, chunk_encoding::DELTA );
+        details::AddChannelChunks( Writer, chunk::uvs_v,     Streams.m_UV );
+        details::AddChannelChunks( Writer, chunk::colors_v,  Streams.m_Color );
+        details::AddChannelChunks( Writer, chunk::weights_v, Streams.m_Weight );
+
+        if( Compression == compression::LOSSY )
+        {
+            for( std::size_t c = 0; c < Streams.m_BTN.size(); ++c )
             {
-                if(isRead) m_MaterialInstance.resize( C );
-                else       C   = m_MaterialInstance.size();
+                const auto&                         Src = Streams.m_BTN[c];
+                std::vector<chunk::octahedral_btn>  Dst( Src.size() );
+                details::ParallelFor( Src.size(), 4096, [&]( std::size_t iBegin, std::size_t iEnd )
+                {
+                    for( std::size_t i = iBegin; i < iEnd; ++i )
+                    {
+                        details::EncodeOctahedral( Src[i].m_Binormal, &Dst[i][0] );
+                        details::EncodeOctahedral( Src[i].m_Tangent,  &Dst[i][2] );
+                        details::EncodeOctahedral( Src[i].m_Normal,   &Dst[i][4] );
+                    }
+                });
+                Writer.Add( details::MakeChannelChunkID( chunk::octahedral_btns_v, static_cast<std::int32_t>(c) ), std::move(Dst), chunk_encoding::DELTA );
             }
-            , [&](std::size_t I, xerr& Err )
+        }
+        else
+        {
+            details::AddChannelChunks( Writer, chunk::btns_v, Streams.m_BTN );
+        }
+
+        //
+        // Facets
+        //
+        details::VisitFacets( *this, [&]( auto Facets )
+        {
+            const std::size_t           nFacets = Facets.size();
+            std::vector<std::int32_t>   Meshes( nFacets );
+            std::vector<std::int32_t>   Materials( nFacets );
+            std::vector<std::uint8_t>   Counts( nFacets );
+            std::vector<std::uint32_t>  Indices;
+            bool                        bTriangles = true;
+
+            Indices.reserve( nFacets * 3 );
+            for( std::size_t i = 0; i < nFacets; ++i )
             {
-                int Index = int(I);
-                if (Err = File.Field("Index", Index)) return;
-                auto& MaterialInstance = m_MaterialInstance[Index];
+                Meshes[i]       = Facets.iMesh(i);
+                Materials[i]    = Facets.iMaterialInstance(i);
+                Counts[i]       = static_cast<std::uint8_t>( Facets.nVertices(i) );
+                bTriangles     &= Counts[i] == 3;
 
-                int nParams = isRead ? 0 : int(MaterialInstance.m_Params.size());
+                for( std::int32_t k = 0; k < Counts[i]; ++k )
+                    Indices.push_back( static_cast<std::uint32_t>( Facets.iVertex( i, k ) ) );
+            }
 
-                   (Err = File.Field("Name",        MaterialInstance.m_Name)           )
-                || (Err = File.Field("Shader",      MaterialInstance.m_MaterialShader) )
-                || (Err = File.Field("Technique",   MaterialInstance.m_Technique)      )
-                || (Err = File.Field("nParams",     nParams)                           )
-                ;
-                if (Err) return;
+            // Table of contents so single meshes can be loaded without scanning the facets
+            std::vector<chunk::mesh_range>  Ranges;
+            std::vector<chunk::facet_run>   Runs;
+            details::BuildFacetRuns( Meshes, bTriangles ? std::span<const std::uint8_t>{} : std::span<const std::uint8_t>{ Counts }, m_Mesh.size(), Ranges, Runs );
+            Writer.Add( chunk::mesh_ranges_v, std::move(Ranges), chunk_encoding::DELTA );
+            Writer.Add( chunk::facet_runs_v,  std::move(Runs),   chunk_encoding::DELTA );
+
+            Writer.Add( chunk::facet_indices_v,   std::move(Indices),   chunk_encoding::DELTA );
+            Writer.Add( chunk::facet_meshes_v,    std::move(Meshes),    chunk_encoding::DELTA );
+            Writer.Add( chunk::facet_materials_v, std::move(Materials), chunk_encoding::DELTA );
+            if( bTriangles == false ) Writer.Add( chunk::facet_counts_v, std::move(Counts), chunk_encoding::DELTA );
+        });
+
+        Writer.Save( FileName, chunk::file_type_v );
+        return;
+    }
 
-                // If we are loading then lets preallocate all the parameters
-                if( isRead == false )
-                {
-                    MaterialInstance.m_Params.resize(MaterialInstance.m_Params.size() + nParams);
-                }
-            })
-        ; Err ) throw(std::runtime_error(std::string(Err.getMessage())));
+    Kill();
+
+    details::chunk_reader Reader;
+    Reader.Open( FileName, chunk::file_type_v );
+
+    // Everything is needed so all the compressed chunks are decoded at once
+    Reader.PrefetchAll();
+
+    details::ReadChunkBones( Reader, m_Bone );
+    details::ReadChunkMaterials( Reader, m_MaterialInstance );
+    details::ReadChunkMeshes( Reader, m_Mesh );
+
+    //
+    // Vertices, the streams are copied concurrently
+    //
+    details::ReadChunkVertices( Reader, nullptr, m_Bone.size(), m_Streams );
+
+    const std::size_t nVertices = m_Streams.size();
+
+    //
+    // Facets
+    //
+    {
+        const auto          Indices     = Reader.get<std::uint32_t>( chunk::facet_indices_v );
+        const auto          Counts      = Reader.get<std::uint8_t>( chunk::facet_counts_v );
+        const auto          Meshes      = Reader.get<std::int32_t>( chunk::facet_meshes_v );
+        const auto          Materials   = Reader.get<std::int32_t>( chunk::facet_materials_v );
+        const std::size_t   nFacets     = Meshes.size();
+        const bool          bTriangles  = Counts.empty();
+
+        if( Materials.size() != nFacets || ( bTriangles == false && Counts.size() != nFacets ) )
+            throw(std::runtime_error( "The chunk file has facet streams with different sizes" ));
 
         //
-        // Read all the parameters for each of the instancces
+        // Where each block of facets starts in the index chunk, so the blocks can then be decoded concurrently
         //
-        int iMaterial = 0;
-        int iParam    = 0;
+        constexpr std::size_t       block_v   = 4096;
+        std::vector<std::size_t>    BlockIndex( ( nFacets + block_v - 1 ) / block_v + 1, 0 );
 
-        if( auto Err = File.Record
-            ( "MaterialInstanceParams"
-            , [&]( std::size_t& C, xerr& Err )
+        details::ParallelFor( nFacets, block_v, [&]( std::size_t iBegin, std::size_t iEnd )
+        {
+            std::size_t nIndices = bTriangles ? ( iEnd - iBegin ) * 3 : 0;
+            for( std::size_t i = iBegin; i < iEnd; ++i )
             {
-                if(isRead) m_MaterialInstance.resize( C );
-                else
-                {
-                    // For writting we need to determine how many items we need to write
-                    C   = [&]{ int nEntries = 0; for (auto& E : m_MaterialInstance) nEntries += int(E.m_Params.size()); return nEntries; }();
+                if( Meshes[i] < 0 || static_cast<std::size_t>( Meshes[i] ) >= m_Mesh.size() )
+                    throw(std::runtime_error( std::format( "The chunk file has a facet with an invalid mesh {}", Meshes[i] ) ));
+                if( Materials[i] < -1 || Materials[i] >= static_cast<std::int64_t>( m_MaterialInstance.size() ) )
+                    throw(std::runtime_error( std::format( "The chunk file has a facet with an invalid material instance {}", Materials[i] ) ));
 
-                    // If need to write items which is the first item?
-                    if(C)
-                    {
-                        for( int i=0; i< m_MaterialInstance.size(); ++i )
-                        {
-                            auto& MatI = m_MaterialInstance[i];
-                            if( MatI.m_Params.size() )
-                            {
-                                iMaterial = i;
-                                iParam    = 0;
-                                break;
-                            }
-                        }
-                    }
-                }
+                if( bTriangles ) continue;
+
+                if( Counts[i] < 3 || Counts[i] > facet_max_vertices_v ) throw(std::runtime_error( std::format( "Invalid number of vertices for a facet {}", Counts[i] ) ));
+                if( Counts[i] != 3 && FacetLayout == facet_layout::TRIANGLES )
+                    throw(std::runtime_error( std::format( "The triangle layout can only hold triangles but got a facet with {} vertices", Counts[i] ) ));
+                nIndices += Counts[i];
             }
-            , [&](std::size_t I, xerr& Err )
-            {
-                   ( Err = File.Field("iMaterialInstance", iMaterial) )
-                || ( Err = File.Field("iParam",            iParam)    )
-                ;
-                if(Err) return;
+            BlockIndex[ iBegin / block_v + 1 ] = nIndices;
+        });
 
-                auto& Param = m_MaterialInstance[iMaterial].m_Params[iParam];
+        std::partial_sum( BlockIndex.begin(), BlockIndex.end(), BlockIndex.begin() );
+        if( Indices.size() != BlockIndex.back() )
+            throw(std::runtime_error( "The chunk file has the wrong number of facet indices" ));
 
-                std::string TypeName;
-                if (isRead == false) TypeName = material_instance::getTypeString(Param.m_Type);
+        details::ParallelFor( Indices.size(), 1 << 16, [&]( std::size_t iBegin, std::size_t iEnd )
+        {
+            for( std::size_t i = iBegin; i < iEnd; ++i )
+                if( Indices[i] >= nVertices ) throw(std::runtime_error( "The chunk file has a facet with an invalid vertex" ));
+        });
 
-                std::string NameView  = Param.m_Name.data();
-                std::string ValueView = Param.m_Value.data();
+        if( FacetLayout == facet_layout::TRIANGLES )
+        {
+            m_Triangles.resize( nFacets );
+            if( Indices.empty() == false ) details::RunChunkCopies( std::array{ details::chunk_copy{ reinterpret_cast<std::byte*>( m_Triangles.m_Index.data() ), reinterpret_cast<const std::byte*>( Indices.data() ), Indices.size_bytes() } } );
 
-                   ( Err = File.Field("Name",  NameView     ))
-                || ( Err = File.Field("Type",  TypeName     ))
-                || ( Err = File.Field("Value", ValueView    ))
-                ;
-                if (Err) return;
+            // Promoting the ids to 32 bits is not thread safe so it is done up front when a value needs it
+            auto Promote = [&]( triangle_list::ids& IDs, std::span<const std::int32_t> Values )
+            {
+                const auto It = std::find_if( Values.begin(), Values.end(), []( std::int32_t V ) { return V < -1 || V >= triangle_list::ids::narrow_none_v; } );
+                if( It != Values.end() ) IDs.set( static_cast<std::size_t>( It - Values.begin() ), *It );
+            };
+            Promote( m_Triangles.m_iMesh,             Meshes );
+            Promote( m_Triangles.m_iMaterialInstance, Materials );
 
-                if( isRead )
+            details::ParallelFor( nFacets, block_v, [&]( std::size_t iBegin, std::size_t iEnd )
+            {
+                for( std::size_t i = iBegin; i < iEnd; ++i )
                 {
-                    // Set the type of the param
-                    Param.m_Type = material_instance::params_type::INVALID;
-                    for( int i=1, end_i = int(material_instance::params_type::ENUM_COUNT); i < end_i; ++i )
-                    {
-                        const auto e = static_cast<material_instance::params_type>(i);
-                        if( xstrtool::CompareI( &TypeName[i], material_instance::getTypeString(e) ) == 0 )
-                        {
-                            Param.m_Type = e;
-                            break;
-                        }
-                    }
-
-                    if( Param.m_Type == material_instance::params_type::INVALID )
-                        throw(std::runtime_error("One of the parameters in the material instance was invalid"));
+                    m_Triangles.m_iMesh.set( i, Meshes[i] );
+                    m_Triangles.m_iMaterialInstance.set( i, Materials[i] );
                 }
-                else
+            });
+        }
+        else
+        {
+            m_Facet.resize( nFacets );
+            details::ParallelFor( nFacets, block_v, [&]( std::size_t iBegin, std::size_t iEnd )
+            {
+                for( std::size_t i = iBegin, iIndex = BlockIndex[ iBegin / block_v ]; i < iEnd; ++i )
                 {
-                    iParam++;
-                    if(iParam == int(m_MaterialInstance[iMaterial].m_Params.size()) )
-                    {
-                        while (m_MaterialInstance[++iMaterial].m_Params.size() == 0);
-                    }
-                    
+                    facet& Facet = m_Facet[i];
+                    Facet                       = facet{};
+                    Facet.m_iMesh               = Meshes[i];
+                    Facet.m_iMaterialInstance   = Materials[i];
+                    Facet.m_nVertices           = bTriangles ? 3 : Counts[i];
+                    for( std::int32_t k = 0; k < Facet.m_nVertices; ++k )
+                        Facet.m_iVertex[k] = static_cast<std::int32_t>( Indices[ iIndex++ ] );
                 }
-            })
-         ; Err ) throw(std::runtime_error(std::string(Err.getMessage())));
+            });
+        }
+    }
+
+    if( Layout == vertex_layout::VERTICES ) ConvertToVertices();
+
+    // Same clean up the text path does
+    details::RenameDuplicatedMeshes( m_Mesh );
+    InvalidateMeshIndex();
+    m_bFacetPlanesDirty = true;
+
+    ComputeBoneInfo();
+}
+
+//--------------------------------------------------------------------------
+
+void geom::LoadChunkedHierarchy( std::wstring_view FileName )
+{
+    Kill();
+
+    details::chunk_reader Reader;
+    Reader.Open( FileName, details::geom_chunk::file_type_v );
+
+    details::ReadChunkBones( Reader, m_Bone );
+    ComputeBoneInfo();
+}
+
+//--------------------------------------------------------------------------
+
+void geom::LoadChunkedMaterials( std::wstring_view FileName )
+{
+    Kill();
+
+    details::chunk_reader Reader;
+    Reader.Open( FileName, details::geom_chunk::file_type_v );
+
+    details::ReadChunkMaterials( Reader, m_MaterialInstance );
+}
+
+//--------------------------------------------------------------------------
+
+std::int32_t geom::LoadChunkedMeshes( std::wstring_view FileName, std::span<const std::string_view> MeshNames, vertex_layout Layout, facet_layout FacetLayout )
+{
+    using chunk = details::geom_chunk;
+
+    Kill();
+
+    details::chunk_reader Reader;
+    Reader.Open( FileName, chunk::file_type_v );
+
+    details::ReadChunkBones( Reader, m_Bone );
+    details::ReadChunkMaterials( Reader, m_MaterialInstance );
+
+    //
+    // Pick the meshes, they keep the order they have in the file
+    //
+    std::vector<mesh>           FileMeshes;
+    std::vector<std::int32_t>   Selected;
+    {
+        details::ReadChunkMeshes( Reader, FileMeshes );
+
+        const std::unordered_set<std::string_view> Names( MeshNames.begin(), MeshNames.end() );
+        for( std::size_t i = 0; i < FileMeshes.size(); ++i )
+        {
+            if( Names.contains( FileMeshes[i].m_Name ) == false ) continue;
+            Selected.push_back( static_cast<std::int32_t>(i) );
+            m_Mesh.push_back( FileMeshes[i] );
+        }
+    }
+
+    //
+    // Table of contents, files without one get it built from the facet meshes
+    //
+    auto Count = [&]( std::uint32_t ID ) -> std::size_t
+    {
+        const details::chunk_entry* pEntry = Reader.find( ID );
+        return pEntry ? static_cast<std::size_t>( pEntry->m_Count ) : 0;
+    };
+
+    const std::size_t   nFacets     = Count( chunk::facet_materials_v );
+    const std::size_t   nIndices    = Count( chunk::facet_indices_v );
+    const std::size_t   nVertices   = Count( chunk::positions_v );
+    const bool          bTriangles  = Reader.find( chunk::facet_counts_v ) == nullptr;
+
+    std::vector<chunk::mesh_range>  OwnedRanges;
+    std::vector<chunk::facet_run>   OwnedRuns;
+    auto                            Ranges = Reader.get<chunk::mesh_range>( chunk::mesh_ranges_v );
+    auto                            Runs   = Reader.get<chunk::facet_run>( chunk::facet_runs_v );
+
+    if( bTriangles == false && Count( chunk::facet_counts_v ) != nFacets )
+        throw(std::runtime_error( "The chunk file has facet streams with different sizes" ));
+
+    if( Reader.find( chunk::mesh_ranges_v ) == nullptr )
+    {
+        const auto Meshes = Reader.get<std::int32_t>( chunk::facet_meshes_v );
+        if( Meshes.size() != nFacets ) throw(std::runtime_error( "The chunk file has facet streams with different sizes" ));
+
+        details::BuildFacetRuns( Meshes, Reader.get<std::uint8_t>( chunk::facet_counts_v ), FileMeshes.size(), OwnedRanges, OwnedRuns );
+        Ranges = OwnedRanges;
+        Runs   = OwnedRuns;
+    }
+
+    if( Ranges.size() != FileMeshes.size() )
+        throw(std::runtime_error( "The chunk file has a corrupted table of contents" ));
+
+    //
+    // Only the facets of the selected runs are read (decoded for compressed files), then the indices they use
+    //
+    std::vector<std::span<const chunk::facet_run>>  SelectedRuns;
+    std::vector<details::element_range>             FacetRanges;
+    for( const std::int32_t iMesh : Selected )
+    {
+        const auto& Range = Ranges[iMesh];
+        if( Range.m_iFirstRun > Runs.size() || Range.m_nRuns > Runs.size() - Range.m_iFirstRun )
+            throw(std::runtime_error( "The chunk file has a corrupted table of contents" ));
+
+        SelectedRuns.push_back( Runs.subspan( Range.m_iFirstRun, Range.m_nRuns ) );
+        for( const auto& Run : SelectedRuns.back() )
+        {
+            if( Run.m_iFirstFacet > nFacets || Run.m_nFacets > nFacets - Run.m_iFirstFacet )
+                throw(std::runtime_error( "The chunk file has a corrupted table of contents" ));
+            FacetRanges.push_back( { Run.m_iFirstFacet, Run.m_iFirstFacet + Run.m_nFacets } );
+        }
+    }
+
+    auto SortRanges = []( std::vector<details::element_range>& List )
+    {
+        std::sort( List.begin(), List.end(), []( const details::element_range& A, const details::element_range& B ) { return A.m_iBegin < B.m_iBegin; } );
+    };
+    SortRanges( FacetRanges );
+
+    Reader.Prefetch( std::array{ chunk::facet_materials_v, chunk::facet_counts_v }, FacetRanges );
+
+    const auto Materials = Reader.get<std::int32_t>( chunk::facet_materials_v, FacetRanges );
+    const auto Counts    = Reader.get<std::uint8_t>( chunk::facet_counts_v,    FacetRanges );
+
+    std::vector<details::element_range> IndexRanges;
+    for( const auto& MeshRuns : SelectedRuns )
+    {
+        for( const auto& Run : MeshRuns )
+        {
+            std::uint64_t nRunIndices = bTriangles ? Run.m_nFacets * 3 : 0;
+            for( std::uint64_t i = 0; i < Run.m_nFacets && bTriangles == false; ++i ) nRunIndices += Counts[ Run.m_iFirstFacet + i ];
+
+            if( Run.m_iFirstIndex > nIndices || nRunIndices > nIndices - Run.m_iFirstIndex )
+                throw(std::runtime_error( "The chunk file has a corrupted table of contents" ));
+            IndexRanges.push_back( { Run.m_iFirstIndex, Run.m_iFirstIndex + nRunIndices } );
+        }
+    }
+    SortRanges( IndexRanges );
+
+    const auto Indices = Reader.get<std::uint32_t>( chunk::facet_indices_v, IndexRanges );
+
+    //
+    // Collect the facets of the selected meshes and the vertices they use
+    //
+    std::vector<facet>          Facets;
+    std::vector<std::uint32_t>  Keep;
+    for( std::size_t iNew = 0; iNew < SelectedRuns.size(); ++iNew )
+    {
+        for( const auto& Run : SelectedRuns[iNew] )
+        {
+            std::uint64_t iIndex = Run.m_iFirstIndex;
+            for( std::uint64_t iFacet = Run.m_iFirstFacet, iEnd = Run.m_iFirstFacet + Run.m_nFacets; iFacet < iEnd; ++iFacet )
+            {
+                facet& Facet = Facets.emplace_back();
+                Facet                       = facet{};
+                Facet.m_iMesh               = static_cast<std::int32_t>( iNew );
+                Facet.m_iMaterialInstance   = Materials[iFacet];
+                Facet.m_nVertices           = bTriangles ? 3 : Counts[iFacet];
+
+                if( Facet.m_nVertices < 3 || Facet.m_nVertices > facet_max_vertices_v )
+                    throw(std::runtime_error( "The chunk file has a corrupted facet" ));
+                if( Facet.m_iMaterialInstance < -1 || Facet.m_iMaterialInstance >= static_cast<std::int64_t>( m_MaterialInstance.size() ) )
+                    throw(std::runtime_error( std::format( "The chunk file has a facet with an invalid material instance {}", Facet.m_iMaterialInstance ) ));
+
+                for( std::int32_t k = 0; k < Facet.m_nVertices; ++k )
+                {
+                    const std::uint32_t iVertex = Indices[ iIndex++ ];
+                    if( iVertex >= nVertices ) throw(std::runtime_error( "The chunk file has a facet with an invalid vertex" ));
+
+                    Facet.m_iVertex[k] = static_cast<std::int32_t>( iVertex );
+                    Keep.push_back( iVertex );
+                }
+            }
+        }
+    }
+
+    std::sort( Keep.begin(), Keep.end() );
+    Keep.erase( std::unique( Keep.begin(), Keep.end() ), Keep.end() );
+
+    //
+    // Vertices, the facets are remapped to the ones we kept
+    //
+    details::ReadChunkVertices( Reader, &Keep, m_Bone.size(), m_Streams );
+
+    for( facet& Facet : Facets )
+        for( std::int32_t k = 0; k < Facet.m_nVertices; ++k )
+            Facet.m_iVertex[k] = static_cast<std::int32_t>( std::lower_bound( Keep.begin(), Keep.end(), static_cast<std::uint32_t>( Facet.m_iVertex[k] ) ) - Keep.begin() );
 
-    } // material instances and params
-    
+    if( FacetLayout == facet_layout::TRIANGLES )
+    {
+        for( const facet& Facet : Facets )
+            if( Facet.m_nVertices != 3 ) throw(std::runtime_error( std::format( "The triangle layout can only hold triangles but got a facet with {} vertices", Facet.m_nVertices ) ));
+
+        m_Triangles.resize( Facets.size() );
+        for( std::size_t i = 0; i < Facets.size(); ++i )
+            m_Triangles.setFacet( i, Facets[i] );
+    }
+    else
+    {
+        m_Facet = std::move( Facets );
+    }
+
+    if( Layout == vertex_layout::VERTICES ) ConvertToVertices();
+
+    details::RenameDuplicatedMeshes( m_Mesh );
+    InvalidateMeshIndex();
+    m_bFacetPlanesDirty = true;
+
+    ComputeBoneInfo();
+
+    return static_cast<std::int32_t>( Selected.size() );
+}
+
+//--------------------------------------------------------------------------
+
+void geom::DeleteMesh(int iMesh) noexcept
+{
+    assert (iMesh >= 0);
+    assert (static_cast<size_t>(iMesh) < m_Mesh.size());
 
-    int nBTNs      = 0;
-    int nUVSets    = 0;
-    int nColors    = 0;
-    int nWeights   = 0;
+    details::VisitVertices( *this, [&]( auto Vertices )
+    {
+    details::VisitFacets( *this, [&]( auto Facets )
+    {
+        // 1. Remove all facets belonging to this mesh
+        // 2. Shift down mesh indices in remaining facets
+        std::size_t nFacets = 0;
+        for( std::size_t i = 0; i < Facets.size(); ++i )
+        {
+            const std::int32_t iFacetMesh = Facets.iMesh(i);
+            if( iFacetMesh == iMesh ) continue;
 
-    if( auto Err = File.Record
-        ( "Vertices"
-        , [&]( std::size_t& C, xerr& Err )
+            Facets.Move( nFacets, i );
+            if( iFacetMesh > iMesh ) Facets.setMesh( nFacets, iFacetMesh - 1 );
+            nFacets++;
+        }
+        Facets.resize( nFacets );
+
+        // 3. Build set of used vertex indices after facet deletion
+        std::vector<int> oldToNewVertex( Vertices.size(), -1 );
+        for( std::size_t i = 0; i < nFacets; ++i )
+            for( std::int32_t k = 0; k < Facets.nVertices(i); ++k )
+                if( Facets.iVertex(i, k) >= 0 )
+                    oldToNewVertex[ Facets.iVertex(i, k) ] = -2;
+
+        // 4. Remap vertices: compact the used ones + old -> new index map
+        std::vector<std::int32_t> Keep;
+        Keep.reserve( Vertices.size() );
+        for( std::size_t i = 0; i < oldToNewVertex.size(); ++i )
         {
-            if(isRead) 
+            if( oldToNewVertex[i] == -2 )
             {
-                m_Vertex.resize( C );
-                std::memset( m_Vertex.data(), 0, m_Vertex.size() * sizeof(m_Vertex[0]));
+                oldToNewVertex[i] = static_cast<int>( Keep.size() );
+                Keep.push_back( static_cast<std::int32_t>(i) );
             }
-            else       C   = m_Vertex.size();
         }
-        , [&](std::size_t I, xerr& Err )
-        {
-            int Index = int(I);
-            if (Err = File.Field("Index", Index)) return;
 
-            auto& Vertex = m_Vertex[Index];
+        Vertices.Compact( Keep );
+        m_Skin.clear();
 
-               ( Err = File.Field("Pos",        Vertex.m_Position.m_X, Vertex.m_Position.m_Y, Vertex.m_Position.m_Z) )
-            || ( Err = File.Field("nBinormals", Vertex.m_nBinormals)                                                 )
-            || ( Err = File.Field("nTangents",  Vertex.m_nTangents)                                                  )
-            || ( Err = File.Field("nNormals",   Vertex.m_nNormals)                                                   )
-            || ( Err = File.Field("nUVSets",    Vertex.m_nUVs)                                                       )
-            || ( Err = File.Field("nColors",    Vertex.m_nColors)                                                    )
-            || ( Err = File.Field("nWeights",   Vertex.m_nWeights)                                                   )
-            ;
-            if(Err) return;
+        // 5. Update all facet vertex indices
+        for( std::size_t i = 0; i < nFacets; ++i )
+            for( std::int32_t k = 0; k < Facets.nVertices(i); ++k )
+                if( Facets.iVertex(i, k) >= 0 )
+                    Facets.setVertex( i, k, oldToNewVertex[ Facets.iVertex(i, k) ] );
 
-           nBTNs      += std::max( Vertex.m_nTangents, std::max( Vertex.m_nNormals, Vertex.m_nTangents) );
-           nUVSets    += Vertex.m_nUVs     ;
-           nColors    += Vertex.m_nColors  ;
-           nWeights   += Vertex.m_nWeights ;
-        })
-     ; Err ) throw(std::runtime_error(std::string(Err.getMessage())));
-    
+        // 6. Clean up orphaned material instances (same as before)
+        std::unordered_set<int> usedMatInst;
+        for( std::size_t i = 0; i < nFacets; ++i )
+            if( Facets.iMaterialInstance(i) >= 0 )
+                usedMatInst.insert( Facets.iMaterialInstance(i) );
 
-    if( isRead == false || File.getRecordName() == "Colors" )
-    {
-        int iColor  = 0;
-        int iVertex = 0;
+        std::vector<material_instance> newMatInst;
+        newMatInst.reserve(m_MaterialInstance.size());
+        std::vector<int> oldToNewMat(m_MaterialInstance.size(), -1);
 
-        if( auto Err = File.Record
-            ( "Colors"
-            , [&]( std::size_t& C, xerr& Err )
+        for (size_t i = 0; i < m_MaterialInstance.size(); ++i)
+        {
+            if (usedMatInst.count(static_cast<int>(i)))
             {
-                if(isRead){ assert( C == nColors ); }
-                else       C   = nColors;
+                oldToNewMat[i] = static_cast<int>(newMatInst.size());
+                newMatInst.push_back(std::move(m_MaterialInstance[i]));
             }
-            , [&](std::size_t, xerr& Err )
-            {
-                // Skip writing vertices that don't have colors
-                if( isRead == false )
-                {
-                    while( m_Vertex[iVertex].m_nColors == 0 )
-                    {
-                        iVertex++;
-                        iColor = 0;
-                    }
-                }
+        }
 
-                if (Err = File.Field("iVertex", iVertex)) return;
-                auto& Vertex = m_Vertex[iVertex];
+        m_MaterialInstance = std::move(newMatInst);
 
-                if (Err = File.Field("Index", iColor)) return;
-                auto& C = Vertex.m_Color[++iColor];
-                if( iColor == Vertex.m_nColors ) 
-                {
-                    iVertex++;
-                    iColor  = 0;
-                }
+        for( std::size_t i = 0; i < nFacets; ++i )
+            if( Facets.iMaterialInstance(i) >= 0 )
+                Facets.setMaterialInstance( i, oldToNewMat[ Facets.iMaterialInstance(i) ] );
+    });
+    });
 
-                xmath::fvec4 FColor = C.getRGBA();
-                if( Err = File.Field("Color", FColor.m_X, FColor.m_Y, FColor.m_Z, FColor.m_W) ) return;
-                if( isRead ) C.setupFromRGBA( FColor );
-            })
-         ; Err ) throw(std::runtime_error(std::string(Err.getMessage())));
-    }
-    
-    if( isRead == false || File.getRecordName() == "BTNs" )
+    // 7. Finally remove the mesh itself
+    m_Mesh.erase(m_Mesh.begin() + iMesh);
+    InvalidateMeshIndex();
+}
+
+//--------------------------------------------------------------------------
+
+namespace details
+{
+    //--------------------------------------------------------------------------
+    // Min/max accumulator for the bbox functions, one SSE register per corner (w is unused).
+    // Starts inverted so a box that never saw a point can be told apart. NaN positions are
+    // skipped since min/max return their second operand when either one is a NaN.
+    //--------------------------------------------------------------------------
+    struct simd_bbox
     {
-        int iBTN    = 0;
-        int iVertex = 0;
+        __m128  m_Min = _mm_set1_ps(  std::numeric_limits<float>::max() );
+        __m128  m_Max = _mm_set1_ps( -std::numeric_limits<float>::max() );
 
-        if( auto Err = File.Record
-            ( "BTNs"
-            , [&]( std::size_t& C, xerr& Err )
-            {
-                if(isRead) { assert( C == nBTNs); }
-                else       C   = nBTNs;
-            }
-            , [&](std::size_t, xerr& Err )
-            {
-                // Skip writing vertices that don't have btns
-                if (isRead == false)
-                {
-                    while( m_Vertex[iVertex].m_nBinormals == 0 
-                        && m_Vertex[iVertex].m_nTangents  == 0
-                        && m_Vertex[iVertex].m_nNormals   == 0 )
-                    {
-                        iVertex++;
-                        iBTN = 0;
-                    }
-                }
+        void Add( const xmath::fvec3& P ) noexcept
+        {
+            const __m128 V = _mm_setr_ps( P.m_X, P.m_Y, P.m_Z, 0 );
+            m_Min = _mm_min_ps( V, m_Min );
+            m_Max = _mm_max_ps( V, m_Max );
+        }
 
-                if (Err = File.Field("iVertex", iVertex)) return;
-                auto& Vertex = m_Vertex[iVertex];
+        void Add( const simd_bbox& Box ) noexcept
+        {
+            m_Min = _mm_min_ps( Box.m_Min, m_Min );
+            m_Max = _mm_max_ps( Box.m_Max, m_Max );
+        }
 
-                if (Err = File.Field("Index", iBTN)) return;
-                auto& BTN = Vertex.m_BTN[iBTN];
-                if( iBTN >= Vertex.m_nTangents 
-                 && iBTN >= Vertex.m_nNormals
-                 && iBTN >= Vertex.m_nBinormals )
-                {
-                    iVertex++;
-                    iBTN = 0;
-                }
+        bool isEmpty( void ) const noexcept
+        {
+            return ( _mm_movemask_ps( _mm_cmpgt_ps( m_Min, m_Max ) ) & 0x7 ) != 0;
+        }
 
-                   (Err = File.Field("Binormals", BTN.m_Binormal.m_X, BTN.m_Binormal.m_Y, BTN.m_Binormal.m_Z, BTN.m_Binormal.m_W ))
-                || (Err = File.Field("Tangents",  BTN.m_Tangent.m_X,  BTN.m_Tangent.m_Y,  BTN.m_Tangent.m_Z,  BTN.m_Tangent.m_W ))
-                || (Err = File.Field("Normals",   BTN.m_Normal.m_X,   BTN.m_Normal.m_Y,   BTN.m_Normal.m_Z))
-                ;
-            })
-         ; Err ) throw(std::runtime_error( std::string(Err.getMessage())));
-    }
+        // Goes through fbbox::operator+= so the result matches adding the points one by one
+        void Write( xmath::fbbox& BBox ) const noexcept
+        {
+            BBox.setupZero();
+            if( isEmpty() ) return;
+
+            alignas(16) float Min[4], Max[4];
+            _mm_store_ps( Min, m_Min );
+            _mm_store_ps( Max, m_Max );
+            BBox += xmath::fvec3( Min[0], Min[1], Min[2] );
+            BBox += xmath::fvec3( Max[0], Max[1], Max[2] );
+        }
+    };
+}
 
+//--------------------------------------------------------------------------
 
-    if( isRead == false || File.getRecordName() == "UVs" )
-    {
-        int iUVs    = 0;
-        int iVertex = 0;
+xmath::fbbox geom::getBBox( void ) const
+{
+    xmath::fbbox BBox;
 
-        if( auto Err = File.Record
-            ( "UVs"
-            , [&]( std::size_t& C, xerr& Err )
-            {
-                if(isRead) { assert( C == nUVSets ); }
-                else       C   = nUVSets;
-            }
-            , [&](std::size_t, xerr& Err )
-            {
-                // Skip writing vertices that don't have colors
-                if( isRead == false )
-                {
-                    while( m_Vertex[iVertex].m_nUVs == 0 )
-                    {
-                        iVertex++;
-                        iUVs = 0;
-                    }
-                }
+    details::VisitVertices( *this, [&]( auto Vertices )
+    {
+        const std::size_t                   nVertices = Vertices.size();
+        std::vector<details::simd_bbox>     Partials( (nVertices + 4095) / 4096 );
 
-                if (Err = File.Field("iVertex", iVertex)) return;
-                auto& Vertex = m_Vertex[iVertex];
+        details::ParallelFor( nVertices, 4096, [&]( std::size_t iBegin, std::size_t iEnd )
+        {
+            auto& Box = Partials[ iBegin / 4096 ];
+            for( std::size_t i = iBegin; i < iEnd; ++i )
+                Box.Add( Vertices.Position(i) );
+        });
 
-                if (Err = File.Field("Index", iUVs)) return;
-                auto& UV = Vertex.m_UV[++iUVs];
-                if(iUVs == Vertex.m_nUVs )
-                {
-                    iVertex++;
-                    iUVs = 0;
-                }
+        details::simd_bbox Total;
+        for( const auto& Box : Partials ) Total.Add( Box );
+        Total.Write( BBox );
+    });
 
-                Err = File.Field("UV", UV.m_X, UV.m_Y );
-            })
-         ) throw(std::runtime_error( std::string(Err.getMessage())));
-    }
+    return BBox;
+}
 
-    if( isRead == false || File.getRecordName() == "Skin" )
+//--------------------------------------------------------------------------
+// Facet ordering. Orders are permutations computed by packing the sort keys into 64 bits and running
+// a stable parallel radix sort, so ties keep their original order and the result is the same for any
+// number of threads. They are applied to the facets once, in place.
+//--------------------------------------------------------------------------
+namespace details
+{
+    // Stable LSD radix sort over the low nBits of Keys, 8 bits per pass. Passes where every key has the
+    // same digit are skipped. Each pass histograms and scatters fixed ranges of keys in parallel, every
+    // range writing to its own slots. Returns for each sorted position the original index.
+    inline std::vector<std::uint32_t> RadixSortOrder( std::span<const std::uint64_t> Keys, std::int32_t nBits )
     {
-        int iWeight = 0;
-        int iVertex = 0;
+        constexpr std::size_t       grain_v  = 1 << 16;
+        const std::size_t           nKeys    = Keys.size();
+        const std::size_t           nChunks  = ( nKeys + grain_v - 1 ) / grain_v;
+        std::vector<std::uint64_t>  Key      ( Keys.begin(), Keys.end() );
+        std::vector<std::uint64_t>  KeyTemp  ( nKeys );
+        std::vector<std::uint32_t>  Order    ( nKeys );
+        std::vector<std::uint32_t>  OrderTemp( nKeys );
 
-        if( auto Err = File.Record
-            ( "Skin"
-            , [&]( std::size_t& C, xerr& Err )
+        std::vector<std::array<std::uint32_t, 256>> Histogram( nChunks );
+
+        for( std::size_t i = 0; i < nKeys; ++i ) Order[i] = static_cast<std::uint32_t>(i);
+
+        for( std::int32_t Shift = 0; Shift < nBits; Shift += 8 )
+        {
+            ParallelFor( nKeys, grain_v, [&]( std::size_t iBegin, std::size_t iEnd )
+            {
+                auto& H = Histogram[ iBegin / grain_v ];
+                H.fill( 0 );
+                for( std::size_t i = iBegin; i < iEnd; ++i ) H[ ( Key[i] >> Shift ) & 0xff ]++;
+            });
+
+            // Skip the pass when a single digit holds every key, counting it over all the chunks
+            bool bSkip = false;
+            for( std::int32_t d = 0; d < 256 && bSkip == false; ++d )
             {
-                if(isRead) { assert( C == nWeights); }
-                else       C   = nWeights;
+                std::size_t Total = 0;
+                for( const auto& H : Histogram ) Total += H[d];
+                bSkip = Total == nKeys;
             }
-            , [&](std::size_t, xerr& Err )
+            if( bSkip ) continue;
+
+            // Turn the counts into where each chunk starts writing each digit
+            std::uint32_t Running = 0;
+            for( std::int32_t d = 0; d < 256; ++d )
             {
-                // Skip writing vertices that don't have colors
-                if( isRead == false )
+                for( auto& H : Histogram )
                 {
-                    while( m_Vertex[iVertex].m_nWeights == 0 )
-                    {
-                        iVertex++;
-                        iWeight = 0;
-                    }
+                    const std::uint32_t Count = H[d];
+                    H[d]     = Running;
+                    Running += Count;
                 }
+            }
 
-                if (Err = File.Field("iVertex", iVertex)) return;
-                auto& Vertex = m_Vertex[iVertex];
-
-                if (Err = File.Field("Index", iWeight)) return;
-                auto& Weight = Vertex.m_Weight[++iWeight];
-                if(iWeight == Vertex.m_nWeights )
+            ParallelFor( nKeys, grain_v, [&]( std::size_t iBegin, std::size_t iEnd )
+            {
+                auto& H = Histogram[ iBegin / grain_v ];
+                for( std::size_t i = iBegin; i < iEnd; ++i )
                 {
-                    iVertex++;
-                    iWeight = 0;
+                    const std::uint32_t iDst = H[ ( Key[i] >> Shift ) & 0xff ]++;
+                    KeyTemp[iDst]   = Key[i];
+                    OrderTemp[iDst] = Order[i];
                 }
+            });
 
-                   ( Err =  File.Field("iBone",  Weight.m_iBone) )
-                || ( Err =  File.Field("Weight", Weight.m_Weight))
-                ;
-            })
-         ) throw(std::runtime_error( std::string(Err.getMessage())));
+            Key.swap( KeyTemp );
+            Order.swap( OrderTemp );
+        }
+
+        return Order;
     }
 
-    int nIndices = 0;
-    if( auto Err = File.Record
-        ( "Polygons"
-        , [&]( std::size_t& C, xerr& Err )
+    //--------------------------------------------------------------------------
+
+    // Orders the facets by the signed fields returned by getFields( iFacet ), the first field being the most
+    // significant. Each field is offset by its minimum and packed with just the bits its range needs.
+    // The facets are visited in Base order when given, so ties keep that order.
+    template< std::size_t N_FIELDS_V, typename T_FACETS, typename T_GET_FIELDS >
+    std::vector<std::uint32_t> ComputeFacetOrder( const T_FACETS& Facets, std::span<const std::uint32_t> Base, T_GET_FIELDS&& getFields )
+    {
+        const std::size_t nFacets = Facets.size();
+
+        if( Base.empty() == false && Base.size() != nFacets )
+            throw(std::runtime_error( std::format( "The base facet order has {} entries but there are {} facets", Base.size(), nFacets ) ));
+
+        std::array<std::int32_t, N_FIELDS_V> Min;
+        std::array<std::int32_t, N_FIELDS_V> Max;
+        Min.fill( std::numeric_limits<std::int32_t>::max() );
+        Max.fill( std::numeric_limits<std::int32_t>::min() );
+
+        for( std::size_t i = 0; i < nFacets; ++i )
         {
-            if(isRead) 
+            const std::array<std::int32_t, N_FIELDS_V> Fields = getFields( i );
+            for( std::size_t f = 0; f < N_FIELDS_V; ++f )
             {
-                m_Facet.resize( C );
-                std::memset(m_Facet.data(), 0, m_Facet.size() * sizeof(m_Facet[0]));
+                Min[f] = std::min( Min[f], Fields[f] );
+                Max[f] = std::max( Max[f], Fields[f] );
             }
-            else       C   = m_Facet.size();
         }
-        , [&](std::size_t I, xerr& Err )
-        {
-            auto& Facet = m_Facet[I];
 
-               ( Err =  File.Field("iMesh",     Facet.m_iMesh)              )
-            || ( Err =  File.Field("nVerts",    Facet.m_nVertices)          )
-            || ( Err =  File.Field("Plane",     Facet.m_Plane.m_Normal.m_X  
-                                              , Facet.m_Plane.m_Normal.m_Y  
-                                              , Facet.m_Plane.m_Normal.m_Z  
-                                              , Facet.m_Plane.m_D )         )
-            || ( Err =  File.Field("iMaterialInstance", Facet.m_iMaterialInstance)  )
-            ;
+        std::array<std::int32_t, N_FIELDS_V> Shift;
+        std::int32_t                         nBits = 0;
+        for( std::size_t f = N_FIELDS_V; f--; )
+        {
+            Shift[f] = nBits;
+            nBits   += static_cast<std::int32_t>( std::bit_width( static_cast<std::uint32_t>( static_cast<std::int64_t>(Max[f]) - Min[f] ) ) );
+        }
 
-            if( !Err ) nIndices += Facet.m_nVertices;
-        })
-     ; Err ) throw(std::runtime_error( std::string(Err.getMessage())));
+        if( nBits > 64 )
+            throw(std::runtime_error( std::format( "The facet sort key needs {} bits which does not fit in 64", nBits ) ));
 
-    {
-        int iIndex = 0;
-        int iFacet = 0;
-        if( auto Err = File.Record
-            ( "FacetIndex"
-            , [&]( std::size_t& C, xerr& Err )
-            {
-                if(isRead) assert( C == nIndices );
-                else       C   = nIndices;
-            }
-            , [&](std::size_t, xerr& Err )
+        std::vector<std::uint64_t> Keys( nFacets );
+        ParallelFor( nFacets, 4096, [&]( std::size_t iBegin, std::size_t iEnd )
+        {
+            for( std::size_t i = iBegin; i < iEnd; ++i )
             {
-                   (Err = File.Field("iFacet", iFacet)      )
-                || (Err = File.Field("Index",  iIndex)      )
-                ;
-                if( Err ) return;
+                const std::array<std::int32_t, N_FIELDS_V> Fields = getFields( Base.empty() ? i : Base[i] );
 
-                auto& Facet = m_Facet[iFacet];
-                auto& Index = Facet.m_iVertex[++iIndex];
-                if( iIndex == Facet.m_nVertices )
-                {
-                    iFacet++;
-                    iIndex = 0;
-                }
+                std::uint64_t Key = 0;
+                for( std::size_t f = 0; f < N_FIELDS_V; ++f )
+                    Key |= static_cast<std::uint64_t>( static_cast<std::int64_t>(Fields[f]) - Min[f] ) << Shift[f];
+                Keys[i] = Key;
+            }
+        });
 
-                Err = File.Field("iVertex", Index );
-            })
-         ; Err ) throw( std::runtime_error(std::string(Err.getMessage())));
+        std::vector<std::uint32_t> Order = RadixSortOrder( Keys, nBits );
+        if( Base.empty() == false ) for( auto& i : Order ) i = Base[i];
+        return Order;
     }
+}
 
-    if (isRead == false || File.getRecordName() == "Mesh")
+//--------------------------------------------------------------------------
+
+std::vector<std::uint32_t> geom::getFacetOrder( facet_order Order, std::span<const std::uint32_t> Base ) const
+{
+    return details::VisitFacets( *this, [&]( auto Facets ) -> std::vector<std::uint32_t>
     {
-        if( auto Err = File.Record
-            ( "Mesh"
-            , [&]( std::size_t& C, xerr& Err )
-            {
-                if(isRead) m_Mesh.resize( C );
-                else       C   = nIndices;
-            }
-            , [&](std::size_t I, xerr& Err )
+        switch( Order )
+        {
+        case facet_order::MESH_MATERIAL:
+            return details::ComputeFacetOrder<2>( Facets, Base, [&]( std::size_t i )
             {
-                Err = File.Field("Name", m_Mesh[I].m_Name);
-            })
-         ) throw(std::runtime_error( std::string(Err.getMessage())));
+                return std::array<std::int32_t, 2>{ Facets.iMesh(i), Facets.iMaterialInstance(i) };
+            });
 
-        if (isRead)
-        {
-            // Rename duplicated names if we found any
-            for( mesh& Mesh : m_Mesh )
+        case facet_order::MESH_MATERIAL_BONE:
+            return details::VisitVertices( *this, [&]( auto Vertices )
             {
-                int Count = 0;
-                const auto Index = static_cast<int>( &Mesh - m_Mesh.data() );
-                for( int j =  1 + Index; j < m_Mesh.size(); j++ )
+                return details::ComputeFacetOrder<3>( Facets, Base, [&]( std::size_t i )
                 {
-                    if ( xstrtool::CompareI( Mesh.m_Name, m_Mesh[j].m_Name ) == 0 )
-                    {
-                         m_Mesh[j].m_Name = std::format( "{}__{}", m_Mesh[j].m_Name, Count++ );
-                    }
-                }
-            }
+                    const auto          iV    = Facets.iVertex( i, 0 );
+                    const std::int32_t  iBone = Vertices.nWeights( iV ) ? Vertices.Weight( iV, 0 ).m_iBone : 0;
+                    return std::array<std::int32_t, 3>{ Facets.iMesh(i), Facets.iMaterialInstance(i), iBone };
+                });
+            });
         }
-    }
-        
-    // Compute all bone related info
-    if( isRead ) ComputeBoneInfo();
+
+        throw(std::runtime_error( "Unknown facet order" ));
+    });
 }
 
 //--------------------------------------------------------------------------
 
-void geom::DeleteMesh(int iMesh) noexcept
+std::vector<std::uint32_t> geom::getFacetOrder( std::span<const std::uint64_t> Keys, std::span<const std::uint32_t> Base ) const
 {
-    assert (iMesh >= 0);
-    assert (static_cast<size_t>(iMesh) < m_Mesh.size());
-
-    // 1. Remove all facets belonging to this mesh
-    m_Facet.erase(
-        std::remove_if(m_Facet.begin(), m_Facet.end(),
-            [iMesh](const facet& f) { return f.m_iMesh == iMesh; }),
-        m_Facet.end());
+    const std::size_t nFacets = details::VisitFacets( *this, []( auto Facets ) { return Facets.size(); } );
 
-    // 2. Shift down mesh indices in remaining facets
-    for (auto& f : m_Facet)
-        if (f.m_iMesh > iMesh)
-            --f.m_iMesh;
+    if( Keys.size() != nFacets )
+        throw(std::runtime_error( std::format( "Got {} facet keys but there are {} facets", Keys.size(), nFacets ) ));
 
-    // 3. Build set of used vertex indices after facet deletion
-    std::vector<bool> vertexUsed(m_Vertex.size(), false);
-    for (const auto& f : m_Facet)
-        for (std::int32_t i = 0; i < f.m_nVertices; ++i)
-            if (f.m_iVertex[i] >= 0)
-                vertexUsed[f.m_iVertex[i]] = true;
+    if( Base.empty() )
+        return details::RadixSortOrder( Keys, 64 );
 
-    // 4. Remap vertices: build new vertex array + old -> new index map
-    std::vector<vertex> newVertices;
-    newVertices.reserve(m_Vertex.size());
+    if( Base.size() != nFacets )
+        throw(std::runtime_error( std::format( "The base facet order has {} entries but there are {} facets", Base.size(), nFacets ) ));
 
-    std::vector<int> oldToNewVertex(m_Vertex.size(), -1);
+    std::vector<std::uint64_t> BaseKeys( Keys.size() );
+    for( std::size_t i = 0; i < Base.size(); ++i ) BaseKeys[i] = Keys[ Base[i] ];
 
-    for (size_t i = 0; i < m_Vertex.size(); ++i)
-    {
-        if (vertexUsed[i])
-        {
-            oldToNewVertex[i] = static_cast<int>(newVertices.size());
-            newVertices.push_back(std::move(m_Vertex[i]));
-        }
-    }
-
-    m_Vertex = std::move(newVertices);
+    std::vector<std::uint32_t> Order = details::RadixSortOrder( BaseKeys, 64 );
+    for( auto& i : Order ) i = Base[i];
+    return Order;
+}
 
-    // 5. Update all facet vertex indices
-    for (auto& f : m_Facet)
-        for (std::int32_t i = 0; i < f.m_nVertices; ++i)
-            if (f.m_iVertex[i] >= 0)
-                f.m_iVertex[i] = oldToNewVertex[f.m_iVertex[i]];
+//--------------------------------------------------------------------------
 
-    // 6. Clean up orphaned material instances (same as before)
-    std::unordered_set<int> usedMatInst;
-    for (const auto& f : m_Facet)
-        if (f.m_iMaterialInstance >= 0)
-            usedMatInst.insert(f.m_iMaterialInstance);
+void geom::ApplyFacetOrder( std::span<const std::uint32_t> Order )
+{
+    const std::size_t nFacets = details::VisitFacets( *this, []( auto Facets ) { return Facets.size(); } );
 
-    std::vector<material_instance> newMatInst;
-    newMatInst.reserve(m_MaterialInstance.size());
-    std::vector<int> oldToNewMat(m_MaterialInstance.size(), -1);
+    if( Order.size() != nFacets )
+        throw(std::runtime_error( std::format( "The facet order has {} entries but there are {} facets", Order.size(), nFacets ) ));
 
-    for (size_t i = 0; i < m_MaterialInstance.size(); ++i)
+    // Make sure it is a permutation before touching anything
+    std::vector<bool> Done( nFacets, false );
+    for( auto i : Order )
     {
-        if (usedMatInst.count(static_cast<int>(i)))
-        {
-            oldToNewMat[i] = static_cast<int>(newMatInst.size());
-            newMatInst.push_back(std::move(m_MaterialInstance[i]));
-        }
+        if( i >= nFacets || Done[i] )
+            throw(std::runtime_error( std::format( "The facet order is not a permutation, facet {} is out of range or repeated", i ) ));
+        Done[i] = true;
     }
 
-    m_MaterialInstance = std::move(newMatInst);
-
-    for (auto& f : m_Facet)
-        if (f.m_iMaterialInstance >= 0)
-            f.m_iMaterialInstance = oldToNewMat[f.m_iMaterialInstance];
-
-    // 7. Finally remove the mesh itself
-    m_Mesh.erase(m_Mesh.begin() + iMesh);
-}
-
-//--------------------------------------------------------------------------
-
-xmath::fbbox geom::getBBox( void ) const
-{
-    xmath::fbbox BBox;
-    BBox.setupZero();
-    for( std::int32_t i=0; i<m_Vertex.size(); i++ )
+    // Follow each cycle moving every facet only once
+    Done.assign( nFacets, false );
+    for( std::size_t iStart = 0; iStart < nFacets; ++iStart )
     {
-        BBox += m_Vertex[i].m_Position;
+        if( Done[iStart] || Order[iStart] == iStart ) continue;
+
+        details::VisitFacets( *this, [&]( auto Facets )
+        {
+            facet        Temp;
+            std::size_t  i    = iStart;
+            Facets.getFacet( iStart, Temp );
+            for( std::size_t iSrc = Order[i]; iSrc != iStart; i = iSrc, iSrc = Order[i] )
+            {
+                Facets.Move( i, iSrc );
+                Done[i] = true;
+            }
+            Facets.setFacet( i, Temp );
+            Done[i] = true;
+        });
     }
-    return BBox;
 }
 
 //--------------------------------------------------------------------------
 
 void geom::SortFacetsByMaterial( void )
 {
-    std::qsort( &m_Facet[0], m_Facet.size(), sizeof(facet),
-            [](const void* paA, const void* paB ) -> std::int32_t
-            {
-                const geom::facet* pA = (const geom::facet*)paA;
-                const geom::facet* pB = (const geom::facet*)paB;
-                
-                if( pA->m_iMesh < pB->m_iMesh ) return -1;
-                if( pA->m_iMesh > pB->m_iMesh ) return  1;
-                
-                if( pA->m_iMaterialInstance < pB->m_iMaterialInstance ) return -1;
-                return pA->m_iMaterialInstance > pB->m_iMaterialInstance;
-            });
+    ApplyFacetOrder( getFacetOrder( facet_order::MESH_MATERIAL ) );
 }
 
 //--------------------------------------------------------------------------
 
 void geom::SortFacetsByMeshMaterialBone( void )
 {
-   static geom* g_pCompare;
-    
-   g_pCompare = this;
-    
-   std::qsort( &m_Facet[0], m_Facet.size(), sizeof(facet),
-            [](const void* paA, const void* paB ) -> std::int32_t
-            {
-                const geom::facet* pA = (const geom::facet*)paA;
-                const geom::facet* pB = (const geom::facet*)paB;
-                
-                if( pA->m_iMesh < pB->m_iMesh ) return -1;
-                if( pA->m_iMesh > pB->m_iMesh ) return  1;
-                
-                if( pA->m_iMaterialInstance < pB->m_iMaterialInstance ) return -1;
-                
-                if( pA->m_iMaterialInstance > pB->m_iMaterialInstance ) return 1;
-                
-                if( pA->m_iMaterialInstance == pB->m_iMaterialInstance )
-                {
-                    if( g_pCompare->m_Vertex[pA->m_iVertex[0]].m_Weight[0].m_iBone >
-                        g_pCompare->m_Vertex[pB->m_iVertex[0]].m_Weight[0].m_iBone )
-                        return 1;
-                    
-                    if( g_pCompare->m_Vertex[pA->m_iVertex[0]].m_Weight[0].m_iBone <
-                        g_pCompare->m_Vertex[pB->m_iVertex[0]].m_Weight[0].m_iBone )
-                        return -1;
-                }
-                return 0;
-            });
+    ApplyFacetOrder( getFacetOrder( facet_order::MESH_MATERIAL_BONE ) );
 }
 
 //--------------------------------------------------------------------------
@@ -736,803 +2964,1127 @@ bool geom::CompareFaces( const geom::facet& A, const geom::facet& B )
     return true;
 }
 
-//--------------------------------------------------------------------------
+//--------------------------------------------------------------------------
+
+void geom::ForceAddColorIfNone(void)
+{
+    details::VisitVertices( *this, [&]( auto Vertices )
+    {
+        if( Vertices.size() == 0 ) return;
+
+        // Make sure the first color channel exists for the stream layout
+        Vertices.AllocateChannels( 0, 1, 0, 0 );
+
+        for( std::size_t i = 0; i < Vertices.size(); ++i )
+        {
+            if( Vertices.nColors(i) ) continue;
+
+            auto Counts = Vertices.Counts(i);
+            Counts.m_nColors = 1;
+            Vertices.setCounts( i, Counts );
+            Vertices.Color( i, 0 ).m_Value = ~0u;
+        }
+    });
+}
+
+
+//--------------------------------------------------------------------------
+// Tangent space generation. The facets are partitioned by mesh (MikkTSpace only looks at
+// connected geometry anyway) and every mesh and UV set pair runs as its own job. The jobs only
+// read the geom and record a tangent per facet corner, the results are written back serially
+// in mesh order afterwards so vertices shared between meshes do not race.
+//--------------------------------------------------------------------------
+namespace details
+{
+    // Facet indices grouped by mesh, in facet order inside each group
+    struct mesh_partition
+    {
+        template< typename T_FACETS >
+        mesh_partition( const T_FACETS& Facets, std::size_t nMeshes )
+        {
+            m_MeshStart.assign( nMeshes + 1, 0 );
+            for( std::size_t i = 0; i < Facets.size(); ++i )
+            {
+                const std::int32_t iMesh = Facets.iMesh(i);
+                if( iMesh < 0 || static_cast<std::size_t>(iMesh) >= nMeshes )
+                    throw(std::runtime_error(std::format("Facet {} references mesh {} but the geom only has {} meshes", i, iMesh, nMeshes)));
+                ++m_MeshStart[ iMesh + 1 ];
+            }
+            for( std::size_t m = 0; m < nMeshes; ++m ) m_MeshStart[m + 1] += m_MeshStart[m];
+
+            m_iFacet.resize( Facets.size() );
+            std::vector<std::uint32_t> Cursor( m_MeshStart.begin(), m_MeshStart.end() - 1 );
+            for( std::size_t i = 0; i < Facets.size(); ++i ) m_iFacet[ Cursor[ Facets.iMesh(i) ]++ ] = static_cast<std::uint32_t>(i);
+        }
+
+        std::size_t size( void ) const noexcept
+        {
+            return m_MeshStart.size() - 1;
+        }
 
-void geom::ForceAddColorIfNone(void)
-{
-    for( auto& V : m_Vertex )
-    {
-        if( V.m_nColors == 0 )
+        std::span<const std::uint32_t> operator[]( std::size_t iMesh ) const noexcept
         {
-            V.m_nColors = 1;
-            V.m_Color[0].m_Value = ~0u;
+            return { m_iFacet.data() + m_MeshStart[iMesh], m_iFacet.data() + m_MeshStart[iMesh + 1] };
         }
-    }
-}
 
+        std::vector<std::uint32_t>  m_MeshStart;
+        std::vector<std::uint32_t>  m_iFacet;
+    };
 
-//--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
 
-void geom::ComputeTangentsAndBinormalsMikk(int uvSet)
-{
-    struct MikkUserData
+    // Tangent plus the sign of the binormal for one facet corner
+    struct corner_tangent
     {
-        geom* pGeom;
-        int   uvSet;
+        xmath::fvec3    m_Tangent;
+        float           m_Sign;
     };
 
-    auto getNumFaces = [](const SMikkTSpaceContext* pContext) -> int
-        {
-            MikkUserData* pUD = static_cast<MikkUserData*>(pContext->m_pUserData);
-            return static_cast<int>(pUD->pGeom->m_Facet.size());
-        };
+    //--------------------------------------------------------------------------
 
-    auto getNumVertsOfFace = [](const SMikkTSpaceContext*, const int) -> int
-        {
-            return 3;
-        };
+    // Writes the tangent and binormal of BTN set iSet, built around the normal of set 0 which is the one
+    // the tangents were computed with. The counts grow to include the set so the vertex stays valid for
+    // CleanMesh, a set that had no normal gets the one from set 0.
+    template< typename T_VERTICES >
+    void WriteTangentBasis( const T_VERTICES& Vertices, std::int32_t iVertex, std::int32_t iSet, const corner_tangent& Corner )
+    {
+        const xmath::fvec3  Normal  = Vertices.BTN( iVertex, 0 ).m_Normal;
+        auto&               BTN     = Vertices.BTN( iVertex, iSet );
+        auto                Counts  = Vertices.Counts( iVertex );
+
+        if( Counts.m_nNormals <= iSet ) BTN.m_Normal = Normal;
+        BTN.m_Tangent   = Corner.m_Tangent;
+        BTN.m_Binormal  = Corner.m_Sign * Normal.Cross( Corner.m_Tangent );
+
+        const auto n = static_cast<std::uint8_t>( iSet + 1 );
+        Counts.m_nNormals   = std::max( Counts.m_nNormals,   n );
+        Counts.m_nTangents  = std::max( Counts.m_nTangents,  n );
+        Counts.m_nBinormals = std::max( Counts.m_nBinormals, n );
+        Vertices.setCounts( iVertex, Counts );
+    }
 
-    auto getPosition = [](const SMikkTSpaceContext* pContext, float fvPosOut[], const int iFace, const int iVert)
-        {
-            MikkUserData* pUD = static_cast<MikkUserData*>(pContext->m_pUserData);
-            int iV = pUD->pGeom->m_Facet[iFace].m_iVertex[iVert];
-            const xmath::fvec3& pos = pUD->pGeom->m_Vertex[iV].m_Position;
-            fvPosOut[0] = pos.m_X;
-            fvPosOut[1] = pos.m_Y;
-            fvPosOut[2] = pos.m_Z;
-        };
+    //--------------------------------------------------------------------------
 
-    auto getNormal = [](const SMikkTSpaceContext* pContext, float fvNormalOut[], const int iFace, const int iVert)
+    // Runs MikkTSpace over the given facets (triangles) and returns a tangent per corner
+    template< typename T_VERTICES, typename T_FACETS >
+    std::vector<corner_tangent> ComputeMikkTangents( const T_VERTICES& Vertices, const T_FACETS& Facets, std::span<const std::uint32_t> iFacets, std::int32_t uvSet )
+    {
+        struct MikkUserData
         {
-            MikkUserData* pUD = static_cast<MikkUserData*>(pContext->m_pUserData);
-            int iV = pUD->pGeom->m_Facet[iFace].m_iVertex[iVert];
-            const xmath::fvec3& n = pUD->pGeom->m_Vertex[iV].m_BTN[0].m_Normal;
-            fvNormalOut[0] = n.m_X;
-            fvNormalOut[1] = n.m_Y;
-            fvNormalOut[2] = n.m_Z;
+            const T_VERTICES&               VertexView;
+            const T_FACETS&                 FacetView;
+            std::span<const std::uint32_t>  iFacets;
+            int                             uvSet;
+            std::vector<corner_tangent>     Corners;
         };
 
-    auto getTexCoord = [](const SMikkTSpaceContext* pContext, float fvTexcOut[], const int iFace, const int iVert)
-        {
-            MikkUserData* pUD = static_cast<MikkUserData*>(pContext->m_pUserData);
-            int iV = pUD->pGeom->m_Facet[iFace].m_iVertex[iVert];
-            const xmath::fvec2& uv = pUD->pGeom->m_Vertex[iV].m_UV[pUD->uvSet];
-            fvTexcOut[0] = uv.m_X;
-            fvTexcOut[1] = uv.m_Y;
-        };
+        auto getNumFaces = [](const SMikkTSpaceContext* pContext) -> int
+            {
+                MikkUserData* pUD = static_cast<MikkUserData*>(pContext->m_pUserData);
+                return static_cast<int>(pUD->iFacets.size());
+            };
 
-    auto setTSpaceBasic = [](const SMikkTSpaceContext* pContext, const float fvTangent[], const float fSign, const int iFace, const int iVert)
-        {
-            MikkUserData* pUD = static_cast<MikkUserData*>(pContext->m_pUserData);
-            int iV = pUD->pGeom->m_Facet[iFace].m_iVertex[iVert];
-            btn& b = pUD->pGeom->m_Vertex[iV].m_BTN[0];
-            xmath::fvec3 tangent(fvTangent[0], fvTangent[1], fvTangent[2]);
-            xmath::fvec3 normal(b.m_Normal.m_X, b.m_Normal.m_Y, b.m_Normal.m_Z);
-            xmath::fvec3 binormal = fSign * normal.Cross(tangent);
-            b.m_Tangent = tangent;
-            b.m_Binormal = binormal;
-            pUD->pGeom->m_Vertex[iV].m_nTangents = 1;
-            pUD->pGeom->m_Vertex[iV].m_nBinormals = 1;
-        };
+        auto getNumVertsOfFace = [](const SMikkTSpaceContext*, const int) -> int
+            {
+                return 3;
+            };
+
+        auto getPosition = [](const SMikkTSpaceContext* pContext, float fvPosOut[], const int iFace, const int iVert)
+            {
+                MikkUserData* pUD = static_cast<MikkUserData*>(pContext->m_pUserData);
+                int iV = pUD->FacetView.iVertex(pUD->iFacets[iFace], iVert);
+                const xmath::fvec3& pos = pUD->VertexView.Position(iV);
+                fvPosOut[0] = pos.m_X;
+                fvPosOut[1] = pos.m_Y;
+                fvPosOut[2] = pos.m_Z;
+            };
+
+        auto getNormal = [](const SMikkTSpaceContext* pContext, float fvNormalOut[], const int iFace, const int iVert)
+            {
+                MikkUserData* pUD = static_cast<MikkUserData*>(pContext->m_pUserData);
+                int iV = pUD->FacetView.iVertex(pUD->iFacets[iFace], iVert);
+                const xmath::fvec3& n = pUD->VertexView.BTN(iV, 0).m_Normal;
+                fvNormalOut[0] = n.m_X;
+                fvNormalOut[1] = n.m_Y;
+                fvNormalOut[2] = n.m_Z;
+            };
+
+        auto getTexCoord = [](const SMikkTSpaceContext* pContext, float fvTexcOut[], const int iFace, const int iVert)
+            {
+                MikkUserData* pUD = static_cast<MikkUserData*>(pContext->m_pUserData);
+                int iV = pUD->FacetView.iVertex(pUD->iFacets[iFace], iVert);
+                const xmath::fvec2& uv = pUD->VertexView.UV(iV, pUD->uvSet);
+                fvTexcOut[0] = uv.m_X;
+                fvTexcOut[1] = uv.m_Y;
+            };
+
+        auto setTSpaceBasic = [](const SMikkTSpaceContext* pContext, const float fvTangent[], const float fSign, const int iFace, const int iVert)
+            {
+                MikkUserData* pUD = static_cast<MikkUserData*>(pContext->m_pUserData);
+                pUD->Corners[ iFace * 3 + iVert ] = { xmath::fvec3(fvTangent[0], fvTangent[1], fvTangent[2]), fSign };
+            };
+
+        SMikkTSpaceInterface iface{};
+        iface.m_getNumFaces = getNumFaces;
+        iface.m_getNumVerticesOfFace = getNumVertsOfFace;
+        iface.m_getPosition = getPosition;
+        iface.m_getNormal = getNormal;
+        iface.m_getTexCoord = getTexCoord;
+        iface.m_setTSpaceBasic = setTSpaceBasic;
+        iface.m_setTSpace = nullptr;
 
-    SMikkTSpaceInterface iface{};
-    iface.m_getNumFaces = getNumFaces;
-    iface.m_getNumVerticesOfFace = getNumVertsOfFace;
-    iface.m_getPosition = getPosition;
-    iface.m_getNormal = getNormal;
-    iface.m_getTexCoord = getTexCoord;
-    iface.m_setTSpaceBasic = setTSpaceBasic;
-    iface.m_setTSpace = nullptr;
+        MikkUserData ud{ Vertices, Facets, iFacets, uvSet, std::vector<corner_tangent>( iFacets.size() * 3 ) };
 
-    SMikkTSpaceContext ctx{};
-    ctx.m_pInterface = &iface;
-    MikkUserData ud{ this, uvSet };
-    ctx.m_pUserData = &ud;
+        SMikkTSpaceContext ctx{};
+        ctx.m_pInterface = &iface;
+        ctx.m_pUserData = &ud;
 
-    genTangSpaceDefault(&ctx);
+        if( genTangSpaceDefault(&ctx) == 0 )
+            throw(std::runtime_error( "MikkTSpace failed to generate the tangents" ));
+
+        return std::move( ud.Corners );
+    }
 }
 
 //--------------------------------------------------------------------------
 
-void geom::CleanMesh( std::int32_t iMesh /* = -1 */ ) // Remove this Mesh
+void geom::ComputeTangentsAndBinormalsMikk(int uvSet)
 {
-    std::int32_t TotalFacetsRemoved = 0;
-    std::int32_t TotalVerticesRemoved = 0;
-    std::int32_t TotalMaterialsRemoved = 0;
+    const int UVSets[] = { uvSet };
+    ComputeTangentsAndBinormalsMikk( UVSets );
+}
 
-    RMESH_SANITY
+//--------------------------------------------------------------------------
 
-    //
-    // Make sure that all normals are normalied
-    //
-    {
-        for ( std::int32_t i = 0; i < m_Vertex.size(); i++ )
-        {
-            auto& Vertex = m_Vertex[i];
+void geom::ComputeTangentsAndBinormalsMikk( std::span<const int> UVSets )
+{
+    if( UVSets.size() > vertex_max_normals_v )
+        throw(std::runtime_error( std::format( "Asked for {} tangent sets but a vertex can only hold {}", UVSets.size(), vertex_max_normals_v ) ));
 
-            if( Vertex.m_nBinormals != Vertex.m_nTangents )
-                throw(std::runtime_error("ERROR: The mesh has a different number of Binormals To Tangents"));
+    if( UVSets.empty() ) return;
 
-            if( Vertex.m_nNormals < Vertex.m_nBinormals )
-                throw(std::runtime_error( "ERROR: We have more Binormals than Normals" ));
+    // The streams only have the channels that some vertex used, make sure the ones we touch are there
+    if( isStreamLayout() ) m_Streams.AllocateChannels( *std::max_element( UVSets.begin(), UVSets.end() ) + 1, 0, static_cast<std::int32_t>(UVSets.size()), 0 );
+
+    details::VisitVertices( *this, [&]( auto Vertices )
+    {
+    details::VisitFacets( *this, [&]( auto Facets )
+    {
+        const details::mesh_partition Meshes( Facets, m_Mesh.size() );
+        const std::size_t             nSets = UVSets.size();
 
-            for ( std::int32_t j = 0; j < Vertex.m_nNormals; j++ )
+        // One job per mesh and UV set
+        std::vector<std::vector<details::corner_tangent>> Results( Meshes.size() * nSets );
+        details::ParallelFor( Results.size(), 1, [&]( std::size_t iBegin, std::size_t iEnd )
+        {
+            for( std::size_t i = iBegin; i < iEnd; ++i )
             {
-                Vertex.m_BTN[j].m_Normal.NormalizeSafe();
-                if( j < Vertex.m_nBinormals )
-                {
-                    Vertex.m_BTN[ j ].m_Binormal.NormalizeSafe();
-                    Vertex.m_BTN[ j ].m_Tangent.NormalizeSafe();
-                }
+                if( Meshes[ i / nSets ].empty() ) continue;
+                Results[i] = details::ComputeMikkTangents( Vertices, Facets, Meshes[ i / nSets ], UVSets[ i % nSets ] );
             }
-        }
-    }
+        });
 
-    //
-    // Sort weights from largest to smallest
-    //
-    {
-        std::int32_t i, j, k;
-        for ( i = 0; i < m_Vertex.size(); i++ )
+        // Write back in mesh order
+        for( std::size_t i = 0; i < Results.size(); ++i )
         {
-            for ( j = 0; j < m_Vertex[ i ].m_nWeights; j++ )
+            const auto iFacets = Meshes[ i / nSets ];
+            for( std::size_t iCorner = 0; iCorner < Results[i].size(); ++iCorner )
             {
-                std::int32_t BestW = j;
-                for ( k = j + 1; k<m_Vertex[ i ].m_nWeights; k++ )
-                {
-                    if ( m_Vertex[ i ].m_Weight[ k ].m_Weight > m_Vertex[ i ].m_Weight[ BestW ].m_Weight )
-                        BestW = k;
-                }
-
-                weight TW = m_Vertex[ i ].m_Weight[ j ];
-                m_Vertex[ i ].m_Weight[ j ] = m_Vertex[ i ].m_Weight[ BestW ];
-                m_Vertex[ i ].m_Weight[ BestW ] = TW;
+                const auto iVertex = Facets.iVertex( iFacets[ iCorner / 3 ], static_cast<std::int32_t>( iCorner % 3 ) );
+                details::WriteTangentBasis( Vertices, iVertex, static_cast<std::int32_t>( i % nSets ), Results[i][iCorner] );
             }
         }
-    }
-
-    RMESH_SANITY
+    });
+    });
+}
 
-    //
-    // Collapse vertices that are too close from each other and have 
-    // the same properties.
-    //
+//--------------------------------------------------------------------------
+// Fast tangents, the classic per triangle accumulation (Lengyel). Each triangle computes its
+// s and t directions from the UV gradients four at a time with SSE, then every vertex sums the
+// directions of the triangles around it, orthogonalizes against its normal and picks the
+// handedness. Both passes are parallel and linear in the size of the geom.
+//--------------------------------------------------------------------------
+namespace details
+{
+    template< typename T_VERTICES, typename T_FACETS >
+    void ComputeFastTangents( const T_VERTICES& Vertices, const T_FACETS& Facets, std::span<const int> UVSets )
     {
-        constexpr float too_close_v = 0.0001f; // Defines how close is close...
+        const std::size_t nFacets   = Facets.size();
+        const std::size_t nVertices = Vertices.size();
+
+        // Corners (iFacet * 3 + k) around each vertex, with a counting sort
+        std::vector<std::uint32_t> CornerStart( nVertices + 1, 0 );
+        std::vector<std::uint32_t> Corner( nFacets * 3 );
+        for( std::size_t i = 0; i < nFacets; ++i )
+            for( std::int32_t k = 0; k < 3; ++k ) ++CornerStart[ Facets.iVertex( i, k ) + 1 ];
+
+        for( std::size_t v = 0; v < nVertices; ++v ) CornerStart[v + 1] += CornerStart[v];
 
-        struct hash_entry
         {
-            std::int32_t m_iNext = -1;
-        };
+            std::vector<std::uint32_t> Cursor( CornerStart.begin(), CornerStart.end() - 1 );
+            for( std::size_t i = 0; i < nFacets; ++i )
+                for( std::int32_t k = 0; k < 3; ++k ) Corner[ Cursor[ Facets.iVertex( i, k ) ]++ ] = static_cast<std::uint32_t>( i * 3 + k );
+        }
 
-        struct tempv
+        // s and t directions of each triangle, SoA
+        std::array<std::vector<float>, 3> SDir, TDir;
+        for( auto& D : SDir ) D.resize( nFacets );
+        for( auto& D : TDir ) D.resize( nFacets );
+
+        for( std::int32_t iSet = 0; iSet < static_cast<std::int32_t>(UVSets.size()); ++iSet )
         {
-            std::int32_t m_RemapIndex;  // New vertex index
-            std::int32_t m_Index;       // Original index
-            std::int32_t m_iNext = -1;  // Next in hash chain
-        };
+            const int uvSet = UVSets[iSet];
 
-        if (m_Vertex.empty())
-            throw std::runtime_error("geom has no vertices");
+            constexpr std::size_t block_v = 256;
+            ParallelFor( nFacets, block_v, [&]( std::size_t iBegin, std::size_t iEnd )
+            {
+                alignas(16) std::array<std::array<float, block_v>, 3> X, Y, Z, U, V;
+
+                // Gather, padding the last group of four with zeros
+                const std::size_t n       = iEnd - iBegin;
+                const std::size_t nPadded = ( n + 3 ) & ~std::size_t(3);
+                for( std::size_t i = 0; i < nPadded; ++i )
+                {
+                    for( std::int32_t k = 0; k < 3; ++k )
+                    {
+                        if( i < n )
+                        {
+                            const auto  iVertex = Facets.iVertex( iBegin + i, k );
+                            const auto& P       = Vertices.Position( iVertex );
+                            const auto& UV      = Vertices.UV( iVertex, uvSet );
+                            X[k][i] = P.m_X;
+                            Y[k][i] = P.m_Y;
+                            Z[k][i] = P.m_Z;
+                            U[k][i] = UV.m_X;
+                            V[k][i] = UV.m_Y;
+                        }
+                        else
+                        {
+                            X[k][i] = Y[k][i] = Z[k][i] = U[k][i] = V[k][i] = 0;
+                        }
+                    }
+                }
 
-        const std::int32_t hash_dim = std::max<std::int32_t>(20, static_cast<std::int32_t>(std::sqrt(static_cast<float>(m_Vertex.size()))));
-        const std::int32_t hash_size = hash_dim * hash_dim;
+                const __m128 Epsilon = _mm_set1_ps( 1e-20f );
+                const __m128 One     = _mm_set1_ps( 1.0f );
+                const __m128 AbsMask = _mm_castsi128_ps( _mm_set1_epi32( 0x7fffffff ) );
+                for( std::size_t i = 0; i < nPadded; i += 4 )
+                {
+                    const __m128 X0 = _mm_load_ps( &X[0][i] ), Y0 = _mm_load_ps( &Y[0][i] ), Z0 = _mm_load_ps( &Z[0][i] );
+                    const __m128 U0 = _mm_load_ps( &U[0][i] ), V0 = _mm_load_ps( &V[0][i] );
 
-        std::vector<hash_entry> hash_table(hash_size);
-        std::vector<tempv> temp_vertices(m_Vertex.size());
+                    const __m128 X1 = _mm_sub_ps( _mm_load_ps( &X[1][i] ), X0 ), X2 = _mm_sub_ps( _mm_load_ps( &X[2][i] ), X0 );
+                    const __m128 Y1 = _mm_sub_ps( _mm_load_ps( &Y[1][i] ), Y0 ), Y2 = _mm_sub_ps( _mm_load_ps( &Y[2][i] ), Y0 );
+                    const __m128 Z1 = _mm_sub_ps( _mm_load_ps( &Z[1][i] ), Z0 ), Z2 = _mm_sub_ps( _mm_load_ps( &Z[2][i] ), Z0 );
+                    const __m128 S1 = _mm_sub_ps( _mm_load_ps( &U[1][i] ), U0 ), S2 = _mm_sub_ps( _mm_load_ps( &U[2][i] ), U0 );
+                    const __m128 T1 = _mm_sub_ps( _mm_load_ps( &V[1][i] ), V0 ), T2 = _mm_sub_ps( _mm_load_ps( &V[2][i] ), V0 );
 
-        // Initialize temp_vertices
-        for (std::int32_t i = 0; i < static_cast<std::int32_t>(m_Vertex.size()); ++i)
-        {
-            temp_vertices[i].m_RemapIndex = i;
-            temp_vertices[i].m_Index = i;
-        }
+                    // Triangles without a UV area do not contribute
+                    const __m128 Det   = _mm_sub_ps( _mm_mul_ps( S1, T2 ), _mm_mul_ps( S2, T1 ) );
+                    const __m128 Valid = _mm_cmpgt_ps( _mm_and_ps( Det, AbsMask ), Epsilon );
+                    const __m128 R     = _mm_and_ps( Valid, _mm_div_ps( One, _mm_or_ps( _mm_and_ps( Valid, Det ), _mm_andnot_ps( Valid, One ) ) ) );
 
-        // Compute bounds, skipping crazy vertices
-        constexpr float crazy_max_v = 100000000.0f;
-        float max_x = -crazy_max_v;
-        float min_x =  crazy_max_v;
-        float max_z = -crazy_max_v;
-        float min_z =  crazy_max_v;
-        std::int32_t total_crazy = 0;
+                    auto Dir = [&]( __m128 A, __m128 B, __m128 C, __m128 D )
+                    {
+                        return _mm_mul_ps( _mm_sub_ps( _mm_mul_ps( A, B ), _mm_mul_ps( C, D ) ), R );
+                    };
+
+                    const std::size_t iFacet = iBegin + i;
+                    const std::size_t nStore = std::min<std::size_t>( 4, n - std::min( n, i ) );
+                    alignas(16) std::array<std::array<float, 4>, 6> Out;
+                    _mm_store_ps( Out[0].data(), Dir( T2, X1, T1, X2 ) );
+                    _mm_store_ps( Out[1].data(), Dir( T2, Y1, T1, Y2 ) );
+                    _mm_store_ps( Out[2].data(), Dir( T2, Z1, T1, Z2 ) );
+                    _mm_store_ps( Out[3].data(), Dir( S1, X2, S2, X1 ) );
+                    _mm_store_ps( Out[4].data(), Dir( S1, Y2, S2, Y1 ) );
+                    _mm_store_ps( Out[5].data(), Dir( S1, Z2, S2, Z1 ) );
+
+                    for( std::size_t j = 0; j < nStore; ++j )
+                    {
+                        for( std::int32_t a = 0; a < 3; ++a )
+                        {
+                            SDir[a][ iFacet + j ] = Out[a][j];
+                            TDir[a][ iFacet + j ] = Out[a + 3][j];
+                        }
+                    }
+                }
+            });
 
-        for (std::int32_t i = 0; i < static_cast<std::int32_t>(m_Vertex.size()); ++i)
-        {
-            const auto& pos = m_Vertex[i].m_Position;
-            const float x_dis_min = std::abs(max_x - pos.m_X);
-            const float x_dis_max = std::abs(pos.m_X - min_x);
-            if (x_dis_min > crazy_max_v || x_dis_max > crazy_max_v)
+            // Every vertex only writes itself
+            ParallelFor( nVertices, 4096, [&]( std::size_t iBegin, std::size_t iEnd )
             {
-                ++total_crazy;
-                continue;
-            }
-            const float z_dis_min = std::abs(max_z - pos.m_Z);
-            const float z_dis_max = std::abs(pos.m_Z - min_z);
-            if (z_dis_min > crazy_max_v || z_dis_max > crazy_max_v)
-            {
-                ++total_crazy;
-                continue;
-            }
+                for( std::size_t v = iBegin; v < iEnd; ++v )
+                {
+                    if( CornerStart[v] == CornerStart[v + 1] ) continue;
 
-            max_x = std::max(max_x, pos.m_X);
-            min_x = std::min(min_x, pos.m_X);
-            max_z = std::max(max_z, pos.m_Z);
-            min_z = std::min(min_z, pos.m_Z);
+                    xmath::fvec3 S( 0, 0, 0 );
+                    xmath::fvec3 T( 0, 0, 0 );
+                    for( std::uint32_t c = CornerStart[v]; c < CornerStart[v + 1]; ++c )
+                    {
+                        const std::size_t iFacet = Corner[c] / 3;
+                        S += xmath::fvec3( SDir[0][iFacet], SDir[1][iFacet], SDir[2][iFacet] );
+                        T += xmath::fvec3( TDir[0][iFacet], TDir[1][iFacet], TDir[2][iFacet] );
+                    }
+
+                    // Gram-Schmidt orthogonalize, when there is nothing left use any direction perpendicular to the normal
+                    const xmath::fvec3  N       = Vertices.BTN( static_cast<std::int32_t>(v), 0 ).m_Normal;
+                    xmath::fvec3        Tangent = S - N * N.Dot( S );
+                    float               LenSq   = Tangent.Dot( Tangent );
+                    if( LenSq < 1e-20f )
+                    {
+                        Tangent = N.Cross( std::abs( N.m_X ) < 0.9f ? xmath::fvec3( 1, 0, 0 ) : xmath::fvec3( 0, 1, 0 ) );
+                        LenSq   = std::max( Tangent.Dot( Tangent ), 1e-20f );
+                    }
+                    Tangent = Tangent * ( 1.0f / std::sqrt( LenSq ) );
+
+                    // Calculate handedness
+                    const float Sign = N.Cross( Tangent ).Dot( T ) < 0.0f ? -1.0f : 1.0f;
+
+                    WriteTangentBasis( Vertices, static_cast<std::int32_t>(v), iSet, corner_tangent{ Tangent, Sign } );
+                }
+            });
         }
+    }
+}
 
-        if (total_crazy > 5000)
-            throw std::runtime_error("ERROR: We have too many vertices that are outside an acceptable range");
+//--------------------------------------------------------------------------
 
-        // Handle degenerate bounds
-        if (max_x - min_x < 1e-6f) { max_x += 1.0f; min_x -= 1.0f; }
-        if (max_z - min_z < 1e-6f) { max_z += 1.0f; min_z -= 1.0f; }
+void geom::ComputeTangentsAndBinormalsFast( std::span<const int> UVSets )
+{
+    if( UVSets.size() > vertex_max_normals_v )
+        throw(std::runtime_error( std::format( "Asked for {} tangent sets but a vertex can only hold {}", UVSets.size(), vertex_max_normals_v ) ));
 
-        // Compute shifts
-        const float x_shift = static_cast<float>(hash_dim - 1) / (max_x - min_x);
-        const float z_shift = static_cast<float>(hash_dim - 1) / (max_z - min_z);
+    if( UVSets.empty() ) return;
 
-        // Hash all vertices
-        for (std::int32_t i = 0; i < static_cast<std::int32_t>(m_Vertex.size()); ++i)
-        {
-            const auto& pos = m_Vertex[i].m_Position;
-            const std::int32_t x_offset = static_cast<std::int32_t>(std::clamp((pos.m_X - min_x) * x_shift, 0.0f, static_cast<float>(hash_dim - 1)));
-            const std::int32_t z_offset = static_cast<std::int32_t>(std::clamp((pos.m_Z - min_z) * z_shift, 0.0f, static_cast<float>(hash_dim - 1)));
-            const std::int32_t entry = x_offset + hash_dim * z_offset;
+    // The streams only have the channels that some vertex used, make sure the ones we touch are there
+    if( isStreamLayout() ) m_Streams.AllocateChannels( *std::max_element( UVSets.begin(), UVSets.end() ) + 1, 0, static_cast<std::int32_t>(UVSets.size()), 0 );
 
-            temp_vertices[i].m_iNext = hash_table[entry].m_iNext;
-            hash_table[entry].m_iNext = i;
-        }
+    details::VisitVertices( *this, [&]( auto Vertices )
+    {
+    details::VisitFacets( *this, [&]( auto Facets )
+    {
+        details::ComputeFastTangents( Vertices, Facets, UVSets );
+    });
+    });
+}
 
-        // Search for duplicates in neighborhood
-        for (std::int32_t h = 0; h < hash_size; ++h)
-        {
-            const std::int32_t x_cell = h % hash_dim;
-            const std::int32_t z_cell = h / hash_dim;
-            const std::int32_t x_from = std::max(0, x_cell - 1);
-            const std::int32_t z_from = std::max(0, z_cell - 1);
-            const std::int32_t x_to = std::min(hash_dim - 1, x_cell + 1) + 1;
-            const std::int32_t z_to = std::min(hash_dim - 1, z_cell + 1) + 1;
+//--------------------------------------------------------------------------
 
-            for (std::int32_t k = hash_table[h].m_iNext; k != -1; k = temp_vertices[k].m_iNext)
-            {
-                auto& key_entry = temp_vertices[k];
-                if (key_entry.m_RemapIndex != key_entry.m_Index)
-                    continue;
+void geom::ComputeTangentsAndBinormals( tangent_mode Mode, std::span<const int> UVSets )
+{
+    switch( Mode )
+    {
+    case tangent_mode::MIKKTSPACE:  ComputeTangentsAndBinormalsMikk( UVSets ); return;
+    case tangent_mode::FAST:        ComputeTangentsAndBinormalsFast( UVSets ); return;
+    }
 
-                for (std::int32_t x = x_from; x < x_to; ++x)
-                {
-                    for (std::int32_t z = z_from; z < z_to; ++z)
-                    {
-                        const std::int32_t ihash = x + z * hash_dim;
-                        if (ihash >= hash_size) continue;
+    throw(std::runtime_error( "Unknown tangent mode" ));
+}
 
-                        const bool same_hash = (ihash == h);
-                        std::int32_t start_node = same_hash ? temp_vertices[k].m_iNext : hash_table[ihash].m_iNext;
+//--------------------------------------------------------------------------
 
-                        for (std::int32_t j = start_node; j != -1; j = temp_vertices[j].m_iNext)
-                        {
-                            auto& v_test = temp_vertices[j];
-                            if (v_test.m_RemapIndex != v_test.m_Index)
-                                continue;
+geom::tangent_benchmark geom::BenchmarkTangents( std::span<const int> UVSets ) const
+{
+    tangent_benchmark Result;
+    geom              Mikk = *this;
+    geom              Fast = *this;
 
-                            if (TempVCompare(m_Vertex[key_entry.m_RemapIndex], m_Vertex[v_test.m_Index], too_close_v))
-                                v_test.m_RemapIndex = key_entry.m_RemapIndex;
-                        }
-                    }
-                }
-            }
-        }
+    auto Time = []( auto&& Function )
+    {
+        const auto Start = std::chrono::steady_clock::now();
+        Function();
+        return std::chrono::duration<float, std::milli>( std::chrono::steady_clock::now() - Start ).count();
+    };
 
-        RMESH_SANITY
+    Result.m_MikkMS = Time( [&]{ Mikk.ComputeTangentsAndBinormalsMikk( UVSets ); } );
+    Result.m_FastMS = Time( [&]{ Fast.ComputeTangentsAndBinormalsFast( UVSets ); } );
 
-        // Count unique vertices and mark remaps
-        std::int32_t n_verts = 0;
-        for (std::int32_t i = 0; i < static_cast<std::int32_t>(m_Vertex.size()); ++i)
+    // Compare the tangents that both of them wrote
+    double Total = 0;
+    details::VisitVertices( Mikk, [&]( auto MikkVertices )
+    {
+    details::VisitVertices( Fast, [&]( auto FastVertices )
+    {
+        for( std::size_t i = 0; i < MikkVertices.size(); ++i )
         {
-            if (temp_vertices[i].m_RemapIndex == temp_vertices[i].m_Index)
+            for( std::int32_t iSet = 0; iSet < static_cast<std::int32_t>(UVSets.size()); ++iSet )
             {
-                temp_vertices[i].m_RemapIndex = n_verts++;
-                temp_vertices[i].m_Index = -1;  // Mark as kept
+                if( MikkVertices.nTangents(i) <= iSet || FastVertices.nTangents(i) <= iSet ) continue;
+
+                const xmath::fvec3& A      = MikkVertices.BTN( i, iSet ).m_Tangent;
+                const xmath::fvec3& B      = FastVertices.BTN( i, iSet ).m_Tangent;
+                const float         LenSq  = A.Dot( A ) * B.Dot( B );
+                if( LenSq <= 0 ) continue;
+
+                const float Angle = std::acos( std::clamp( A.Dot( B ) / std::sqrt( LenSq ), -1.0f, 1.0f ) );
+                Total                 += Angle;
+                Result.m_MaxDeviation  = std::max( Result.m_MaxDeviation, Angle );
+                Result.m_nCompared++;
             }
         }
+    });
+    });
 
-        RMESH_SANITY
+    if( Result.m_nCompared ) Result.m_AverageDeviation = static_cast<float>( Total / Result.m_nCompared );
+    return Result;
+}
 
-        // Remap facet indices
-        for (auto& facet : m_Facet)
+//--------------------------------------------------------------------------
+// 3D grid over the vertex positions with about one cell per vertex. Used by the algorithms that
+// need to find the vertices that share (or almost share) a position.
+//--------------------------------------------------------------------------
+namespace details
+{
+    struct position_grid
+    {
+        // A cell is never smaller than MinCellSize so the 27 neighbors of a cell always cover
+        // every vertex within MinCellSize of the ones inside it
+        template< typename T_VIEW >
+        position_grid( const T_VIEW& Vertices, const float MinCellSize )
         {
-            for (std::int32_t j = 0; j < facet.m_nVertices; ++j)
+            const std::int32_t n_vertices = static_cast<std::int32_t>(Vertices.size());
+
+            // Compute bounds, skipping crazy vertices
+            constexpr float crazy_max_v = 100000000.0f;
+            std::array<float, 3> bbox_max = { -crazy_max_v, -crazy_max_v, -crazy_max_v };
+            std::int32_t total_crazy = 0;
+
+            m_BBoxMin = { crazy_max_v, crazy_max_v, crazy_max_v };
+            for (std::int32_t i = 0; i < n_vertices; ++i)
             {
-                std::int32_t& ivert = facet.m_iVertex[j];
-                std::int32_t iremap = temp_vertices[ivert].m_RemapIndex;
-                if (temp_vertices[ivert].m_Index == -1)
+                const auto&                 pos = Vertices.Position(i);
+                const std::array<float, 3>  p   = { pos.m_X, pos.m_Y, pos.m_Z };
+
+                // Written so NaNs count as crazy too
+                if ((std::abs(p[0]) <= crazy_max_v && std::abs(p[1]) <= crazy_max_v && std::abs(p[2]) <= crazy_max_v) == false)
                 {
-                    ivert = iremap;
+                    ++total_crazy;
+                    continue;
                 }
-                else
+
+                for (std::int32_t a = 0; a < 3; ++a)
                 {
-                    ivert = temp_vertices[iremap].m_RemapIndex;
+                    bbox_max[a]  = std::max(bbox_max[a],  p[a]);
+                    m_BBoxMin[a] = std::min(m_BBoxMin[a], p[a]);
                 }
             }
-        }
 
-        RMESH_SANITY
+            if (total_crazy > 5000)
+                throw std::runtime_error("ERROR: We have too many vertices that are outside an acceptable range");
 
-        // Create new vertex array
-        std::vector<vertex> new_vertices(n_verts);
-        for (std::int32_t i = 0; i < static_cast<std::int32_t>(m_Vertex.size()); ++i)
-        {
-            const std::int32_t iremap = temp_vertices[i].m_RemapIndex;
-            if (temp_vertices[i].m_Index == -1)
+            //
+            // The cells are distributed along the axes proportionally to the extent of the geometry
+            // so flat, tall or long assets still get an even occupancy.
+            //
+            std::array<float, 3> extent;
+            for (std::int32_t a = 0; a < 3; ++a)
             {
-                new_vertices[iremap] = std::move(m_Vertex[i]);
+                // Handle degenerate bounds
+                if (bbox_max[a] - m_BBoxMin[a] < 1e-6f) { bbox_max[a] += 1.0f; m_BBoxMin[a] -= 1.0f; }
+                extent[a] = bbox_max[a] - m_BBoxMin[a];
             }
-        }
 
-        RMESH_SANITY
+            // Axes that would get less than one cell are collapsed and the cells given to the others
+            const double         target_cells = std::clamp<double>(n_vertices, 27.0, 1 << 24);
+            std::array<bool, 3>  active       = { true, true, true };
+            for (bool done = false; done == false; )
+            {
+                double       volume   = 1;
+                std::int32_t n_active = 0;
+                for (std::int32_t a = 0; a < 3; ++a) if (active[a]) { volume *= extent[a]; ++n_active; }
+                if (n_active == 0) break;
 
-        // Update count
-        TotalVerticesRemoved += static_cast<int>(m_Vertex.size() - n_verts);
-        m_Vertex = std::move(new_vertices);
+                const double scale = std::pow(target_cells / volume, 1.0 / n_active);
 
-        RMESH_SANITY
-    }
+                done = true;
+                for (std::int32_t a = 0; a < 3; ++a)
+                {
+                    if (active[a] == false) continue;
+                    if (extent[a] * scale < 1.0) { active[a] = false; done = false; }
+                }
 
-    RMESH_SANITY
+                if (done)
+                {
+                    for (std::int32_t a = 0; a < 3; ++a)
+                        if (active[a]) m_Dims[a] = static_cast<std::int32_t>(extent[a] * scale);
+                }
+            }
 
+            for (std::int32_t a = 0; a < 3; ++a)
+            {
+                const double max_dim = std::floor(extent[a] / MinCellSize);
+                m_Dims[a]  = static_cast<std::int32_t>(std::clamp<double>(m_Dims[a], 1.0, std::max(1.0, max_dim)));
+                m_Shift[a] = static_cast<float>(m_Dims[a]) / extent[a];
+            }
 
-    //
-    // Elliminate any digenerated facets
-    //
-    {
-        std::int32_t i;
-        std::int32_t nFacets = 0;
+            // Bucket the vertices by cell with a counting sort. Inside a cell they stay sorted by index.
+            const std::int32_t        n_cells = size();
+            std::vector<std::int32_t> vertex_cell(n_vertices);
 
-        for ( i = 0; i < m_Facet.size(); i++ )
-        {
-            xmath::fvec3 Normal = m_Vertex[ m_Facet[ i ].m_iVertex[ 1 ] ].m_Position - m_Vertex[ m_Facet[ i ].m_iVertex[ 0 ] ].m_Position.Cross(
-                m_Vertex[ m_Facet[ i ].m_iVertex[ 2 ] ].m_Position - m_Vertex[ m_Facet[ i ].m_iVertex[ 0 ] ].m_Position );
+            m_CellStart.assign(n_cells + 1, 0);
+            m_CellVertex.resize(n_vertices);
 
-            // Remove this facet if we're dumping out this Mesh.
-            if ( ( iMesh != -1 && m_Facet[ i ].m_iMesh == iMesh )
-                || Normal.Length() < 0.00001f )
-            {
-                // Skip Facet
-                //x_DebugMsg("Removing face %1d, (%1d,%1d,%1d)\n",i,m_pFacet[i].iVertex[0],m_pFacet[i].iVertex[1],m_pFacet[i].iVertex[2]);
-            }
-            else
+            for (std::int32_t i = 0; i < n_vertices; ++i)
             {
-                m_Facet[ nFacets ] = m_Facet[ i ];
-                nFacets++;
+                const auto& pos = Vertices.Position(i);
+                vertex_cell[i] = ComputeCell(0, pos.m_X) + m_Dims[0] * (ComputeCell(1, pos.m_Y) + m_Dims[1] * ComputeCell(2, pos.m_Z));
+                ++m_CellStart[vertex_cell[i] + 1];
             }
+
+            for (std::int32_t c = 0; c < n_cells; ++c)
+                m_CellStart[c + 1] += m_CellStart[c];
+
+            std::vector<std::int32_t> cursor(m_CellStart.begin(), m_CellStart.end() - 1);
+            for (std::int32_t i = 0; i < n_vertices; ++i)
+                m_CellVertex[cursor[vertex_cell[i]]++] = i;
         }
 
-        // Set the new count
-        TotalFacetsRemoved += static_cast<int>(m_Facet.size() - nFacets);
+        std::int32_t size( void ) const noexcept
+        {
+            return m_Dims[0] * m_Dims[1] * m_Dims[2];
+        }
 
-        if ( TotalFacetsRemoved )
-            m_Facet.resize( nFacets );
+        std::int32_t ComputeCell( std::int32_t a, float v ) const noexcept
+        {
+            return static_cast<std::int32_t>(std::clamp((v - m_BBoxMin[a]) * m_Shift[a], 0.0f, static_cast<float>(m_Dims[a] - 1)));
+        }
 
-        // No facets left!
-        if ( m_Facet.size() <= 0 )
-            throw(std::runtime_error( "geom has not facets" ));
-    }
+        // Calls Function( iCell ) for the cell h and all its neighbors, in x fastest order
+        template< typename T_FUNCTION >
+        void ForEachNeighbor( std::int32_t h, T_FUNCTION&& Function ) const
+        {
+            const std::int32_t x_cell = h % m_Dims[0];
+            const std::int32_t y_cell = (h / m_Dims[0]) % m_Dims[1];
+            const std::int32_t z_cell = h / (m_Dims[0] * m_Dims[1]);
+            const std::int32_t x_from = std::max(0, x_cell - 1);
+            const std::int32_t y_from = std::max(0, y_cell - 1);
+            const std::int32_t z_from = std::max(0, z_cell - 1);
+            const std::int32_t x_to   = std::min(m_Dims[0] - 1, x_cell + 1) + 1;
+            const std::int32_t y_to   = std::min(m_Dims[1] - 1, y_cell + 1) + 1;
+            const std::int32_t z_to   = std::min(m_Dims[2] - 1, z_cell + 1) + 1;
+
+            for (std::int32_t z = z_from; z < z_to; ++z)
+            for (std::int32_t y = y_from; y < y_to; ++y)
+            for (std::int32_t x = x_from; x < x_to; ++x)
+                Function( x + m_Dims[0] * (y + m_Dims[1] * z) );
+        }
 
-    RMESH_SANITY
+        std::array<std::int32_t, 3>     m_Dims      = { 1, 1, 1 };
+        std::array<float, 3>            m_BBoxMin;
+        std::array<float, 3>            m_Shift;
+        std::vector<std::int32_t>       m_CellStart;        // Where the vertices of each cell start in m_CellVertex (one extra at the end)
+        std::vector<std::int32_t>       m_CellVertex;       // Vertex indices sorted by cell
+    };
+}
 
-    //
-    // Elliminate any unuse vertices
-    //
-    REMOVE_VERTS_AGAIN :
+//--------------------------------------------------------------------------
+// Finds the vertices that are too close from each other and have the same properties.
+// Returns for every vertex the index of the vertex it collapses into (itself when it is kept).
+//--------------------------------------------------------------------------
+namespace details
+{
+    template< typename T_VIEW >
+    std::vector<std::int32_t> WeldVertices( const T_VIEW& Vertices, const float too_close_v, geom::clean_stats& Stats )
     {
-        std::int32_t     i, j;
+        if (Vertices.size() == 0)
+            throw std::runtime_error("geom has no vertices");
 
-        if ( m_Vertex.size() <= 0 )
-            throw(std::runtime_error( "geom has no vertices" ));
+        const std::int32_t        n_vertices = static_cast<std::int32_t>(Vertices.size());
+        std::vector<std::int32_t> root(n_vertices);
 
-        // Allocat the remap table
-        std::vector<std::int32_t> VRemap;
+        for (std::int32_t i = 0; i < n_vertices; ++i)
+            root[i] = i;
 
-        VRemap.resize( m_Vertex.size() );
+        const position_grid             grid( Vertices, too_close_v );
+        const auto&                     dims        = grid.m_Dims;
+        const std::int32_t              n_cells     = grid.size();
+        const details::weld_attributes  attributes( Vertices );
 
-        // Fill the remap table
-        for ( i = 0; i < m_Vertex.size(); i++ )
+        // Occupancy stats, to make sure no cell degenerates into a long list
+        Stats.m_WeldGrid = dims;
+        for (std::int32_t c = 0; c < n_cells; ++c)
         {
-            VRemap[ i ] = -1;
+            const std::int32_t n = grid.m_CellStart[c + 1] - grid.m_CellStart[c];
+            if (n) ++Stats.m_nWeldOccupiedCells;
+            Stats.m_WeldMaxCellVertices = std::max(Stats.m_WeldMaxCellVertices, n);
         }
 
-        // Mark all the used vertices
-        for ( facet& Face : m_Facet )
-        for ( std::int32_t j = 0; j < Face.m_nVertices; j++ )
-        {
-            if ( Face.m_iVertex[ j ] < 0 ||
-                Face.m_iVertex[ j ] >= m_Vertex.size() )
-                throw(std::runtime_error( std::format( "Found a facet that was indexing a vertex out of range! FaceID = {} VertexID = {}",
-                i, Face.m_iVertex[ j ] )));
+        // Vertices that are bitwise copies of a lower index are taken out of the search. They share its cell and
+        // its compares, so the serial scan always ends up merging them with it: either it absorbs them as soon as
+        // it is a key or whoever absorbs it first absorbs them too. Without this a pile of k copies records k^2 pairs.
+        const std::vector<std::int32_t> identical   = attributes.FindIdentical();
+        std::vector<std::int32_t>       cell_start( n_cells + 1 );
+        std::vector<std::int32_t>       cell_vertex;
 
-            VRemap[ Face.m_iVertex[ j ] ] = -2;
+        cell_vertex.reserve( grid.m_CellVertex.size() );
+        for (std::int32_t c = 0; c < n_cells; ++c)
+        {
+            cell_start[c] = static_cast<std::int32_t>(cell_vertex.size());
+            for (std::int32_t i = grid.m_CellStart[c]; i < grid.m_CellStart[c + 1]; ++i)
+            {
+                const std::int32_t v = grid.m_CellVertex[i];
+                if (identical[v] == v) cell_vertex.push_back(v);
+            }
         }
+        cell_start[n_cells] = static_cast<std::int32_t>(cell_vertex.size());
+
+        // Search for duplicates in the 27 neighbor cells. The vertex compares are the expensive part so they
+        // run in parallel over ranges of cells, each range recording the pairs that matched in the same
+        // order the serial scan visits them. The merges are then replayed serially over those pairs so
+        // the remap is the same for any number of threads.
+        struct weld_pair
+        {
+            std::int32_t m_iKey;
+            std::int32_t m_iVertex;
+        };
 
-        // Create the remap table
-        // and compact the vertices to the new location
-        for ( j = i = 0; i < m_Vertex.size(); i++ )
+        constexpr std::size_t               cells_per_chunk_v = 256;
+        std::vector<std::vector<weld_pair>> chunk_pairs( (n_cells + cells_per_chunk_v - 1) / cells_per_chunk_v );
+
+        details::ParallelFor( n_cells, cells_per_chunk_v, [&]( std::size_t iBegin, std::size_t iEnd )
         {
-            std::int32_t Value = VRemap[ i ];
+            auto& pairs = chunk_pairs[ iBegin / cells_per_chunk_v ];
+
+            for (std::int32_t h = static_cast<std::int32_t>(iBegin); h < static_cast<std::int32_t>(iEnd); ++h)
+            {
+                if (cell_start[h] == cell_start[h + 1])
+                    continue;
 
-            VRemap[ i ] = j;
-            m_Vertex[ j ] = m_Vertex[ i ];
+                for (std::int32_t ik = cell_start[h]; ik < cell_start[h + 1]; ++ik)
+                {
+                    const std::int32_t k = cell_vertex[ik];
+
+                    grid.ForEachNeighbor(h, [&](std::int32_t ihash)
+                    {
+                        // In the key's own cell only look at the vertices after it
+                        const std::int32_t start_node = (ihash == h) ? ik + 1 : cell_start[ihash];
+
+                        for (std::int32_t ij = start_node; ij < cell_start[ihash + 1]; ++ij)
+                        {
+                            const std::int32_t j = cell_vertex[ij];
+                            if (attributes.Compare(k, j, too_close_v))
+                                pairs.push_back({ k, j });
+                        }
+                    });
+                }
+            }
+        });
 
-            if ( Value == -2 ) j++;
+        // Replay the merges in scan order. Keys that were merged already are skipped and so are
+        // vertices that already belong to someone, exactly as the serial scan would do.
+        for (const auto& pairs : chunk_pairs)
+        {
+            for (const auto& pair : pairs)
+            {
+                if (root[pair.m_iKey] != pair.m_iKey || root[pair.m_iVertex] != pair.m_iVertex)
+                    continue;
+
+                root[pair.m_iVertex] = pair.m_iKey;
+            }
         }
 
-        // Set the final vertex count
-        TotalVerticesRemoved += static_cast<int>(m_Vertex.size() - j);
-        if ( TotalVerticesRemoved )
-            m_Vertex.resize( j );
+        // The copies follow the vertex they are identical to
+        for (std::int32_t i = 0; i < n_vertices; ++i)
+            root[i] = root[identical[i]];
 
-        // Remap all the faces to point to the new location of verts
-        for ( facet& Face : m_Facet )
-        for ( std::int32_t j = 0; j < Face.m_nVertices; j++ )
+        // A key can be merged into a later key after absorbing other vertices, point them all to the final one
+        for (auto& r : root)
         {
-            Face.m_iVertex[ j ] = VRemap[ Face.m_iVertex[ j ] ];
+            while (root[r] != r)
+                r = root[r];
         }
-    }
 
-    RMESH_SANITY
+        return root;
+    }
+}
 
+//--------------------------------------------------------------------------
 
-    //
-    // Nuke any facets that has the same vert indices and properties
-    //
+geom::clean_stats geom::CleanMesh( std::int32_t iMesh /* = -1 */ ) // Remove this Mesh
+{
+    return details::VisitVertices( *this, [&]( auto Vertices ) -> clean_stats
     {
-        struct fref
+    return details::VisitFacets( *this, [&]( auto Facets ) -> clean_stats
+    {
+        clean_stats Stats;
+        auto        Timer    = std::chrono::steady_clock::now();
+        auto        EndPhase = [&]( clean_stats::phase Phase )
         {
-            std::int32_t m_iFacet;
-            std::int32_t m_iNext;
+            const auto Now = std::chrono::steady_clock::now();
+            Stats.m_PhaseMS[ static_cast<int>(Phase) ] = std::chrono::duration<float, std::milli>( Now - Timer ).count();
+            Timer = Now;
         };
 
-        std::int32_t                i;
-        std::int32_t                nFacets;
-        std::vector<std::int32_t>   VNode;
-        std::vector<fref>           FRef;
-        std::int32_t                nRefs;
-        std::int32_t                iRef;
+        RMESH_SANITY
+
+        if ( Vertices.size() <= 0 )
+            throw(std::runtime_error( "geom has no vertices" ));
 
-        // Make sure that we have vertices
-        if ( m_Vertex.size() <= 0 )
-            throw(std::runtime_error( "geom has not vertices" ));
+        const std::int32_t nVertices = static_cast<std::int32_t>( Vertices.size() );
 
-        // Get how many ref we should have
-        nRefs = 0;
-        for ( i = 0; i < m_Facet.size(); i++ )
+        //
+        // Make sure that all normals are normalized and sort the weights from largest to smallest
+        //
+        details::ParallelFor( nVertices, 4096, [&]( std::size_t iBegin, std::size_t iEnd )
         {
-            nRefs += m_Facet[ i ].m_nVertices;
-        }
+            for ( std::int32_t i = static_cast<std::int32_t>(iBegin); i < static_cast<std::int32_t>(iEnd); i++ )
+            {
+                if( Vertices.nBinormals(i) != Vertices.nTangents(i) )
+                    throw(std::runtime_error("ERROR: The mesh has a different number of Binormals To Tangents"));
 
-        // Allocate hash, and refs
-        VNode.resize( m_Vertex.size() );
-        FRef.resize( nRefs );
+                if( Vertices.nNormals(i) < Vertices.nBinormals(i) )
+                    throw(std::runtime_error( "ERROR: We have more Binormals than Normals" ));
 
-        // Initalize the hash entries to null
-        for ( i = 0; i < m_Vertex.size(); i++ )
-        {
-            VNode[ i ] = -1;
-        }
+                for ( std::int32_t j = 0; j < Vertices.nNormals(i); j++ )
+                {
+                    auto& BTN = Vertices.BTN( i, j );
 
-        // Insert all the face references into the hash
-        iRef = 0;
-        for ( i = 0; i < m_Facet.size(); i++ )
-        for ( std::int32_t j = 0; j < m_Facet[ i ].m_nVertices; j++ )
-        {
-            assert( iRef < nRefs );
-            FRef[ iRef ].m_iFacet = i;
-            FRef[ iRef ].m_iNext = VNode[ m_Facet[ i ].m_iVertex[ j ] ];
-            VNode[ m_Facet[ i ].m_iVertex[ j ] ] = iRef;
-            iRef++;
-        }
+                    BTN.m_Normal.NormalizeSafe();
+                    if( j < Vertices.nBinormals(i) )
+                    {
+                        BTN.m_Binormal.NormalizeSafe();
+                        BTN.m_Tangent.NormalizeSafe();
+                    }
+                }
+
+                const std::int32_t nWeights = Vertices.nWeights(i);
+                if( nWeights > 1 )
+                {
+                    details::weight_block W;
+                    for ( std::int32_t j = 0; j < nWeights; j++ ) W[j] = Vertices.Weight( i, j );
+                    details::SortWeights( W, nWeights );
+                    for ( std::int32_t j = 0; j < nWeights; j++ ) Vertices.Weight( i, j ) = W[j];
+                }
+            }
+        });
+
+        EndPhase( clean_stats::phase::NORMALIZE_AND_SORT_WEIGHTS );
+        RMESH_SANITY
+
+        //
+        // Collapse vertices that are too close from each other and have the same properties.
+        // Nothing moves yet, the facets are pointed to the kept vertex and the vertices are
+        // compacted only once at the end together with the unused ones.
+        //
+        constexpr float                 too_close_v = 0.0001f; // Defines how close is close...
+        const std::vector<std::int32_t> WeldRoot    = details::WeldVertices( Vertices, too_close_v, Stats );
+
+        for ( std::int32_t i = 0; i < nVertices; i++ )
+            if ( WeldRoot[i] != i ) Stats.m_nWeldedVertices++;
+
+        EndPhase( clean_stats::phase::WELD );
+        RMESH_SANITY
 
-        // Find duplicate facets
-        for ( i = 0; i < m_Vertex.size(); i++ )
-        for ( std::int32_t j = VNode[ i ]; j != -1; j = FRef[ j ].m_iNext )
+        //
+        // Remap the facets to the welded vertices and elliminate the ones from the mesh we are
+        // dumping and any digenerated ones
+        //
         {
-            facet& A = m_Facet[ FRef[ j ].m_iFacet ];
+            std::int32_t nFacets = 0;
 
-            // This facet has been removed
-            if ( A.m_nVertices < 0 )
-                continue;
-
-            for ( std::int32_t k = FRef[ j ].m_iNext; k != -1; k = FRef[ k ].m_iNext )
+            for ( std::int32_t i = 0; i < static_cast<std::int32_t>( Facets.size() ); i++ )
             {
-                facet& B = m_Facet[ FRef[ k ].m_iFacet ];
-
-                // This facet has been removed
-                if ( B.m_nVertices < 0 )
+                // Remove this facet if we're dumping out this Mesh.
+                if ( iMesh != -1 && Facets.iMesh( i ) == iMesh )
+                {
+                    Stats.m_nMeshFacets++;
                     continue;
+                }
 
-                // Check whether the two facets are the same
-                if ( CompareFaces( A, B ) )
+                for ( std::int32_t j = 0; j < Facets.nVertices( i ); j++ )
                 {
-                    // Mark for removal
-                    B.m_nVertices = 0;
+                    const auto iVertex = Facets.iVertex( i, j );
+                    if ( iVertex < 0 || iVertex >= nVertices )
+                        throw(std::runtime_error( std::format( "Found a facet that was indexing a vertex out of range! FaceID = {} VertexID = {}",
+                        i, iVertex )));
+
+                    Facets.setVertex( i, j, WeldRoot[ iVertex ] );
                 }
-            }
-        }
 
-        // Remove any unwanted facets
-        nFacets = 0;
-        for ( i = 0; i < m_Facet.size(); i++ )
-        {
-            if ( m_Facet[ i ].m_nVertices == 0 )
-            {
-                // Skip Facet
-            }
-            else
-            {
-                m_Facet[ nFacets ] = m_Facet[ i ];
-                nFacets++;
-            }
-        }
+                const auto&        P0     = Vertices.Position( Facets.iVertex( i, 0 ) );
+                const xmath::fvec3 Normal = ( Vertices.Position( Facets.iVertex( i, 1 ) ) - P0 ).Cross( Vertices.Position( Facets.iVertex( i, 2 ) ) - P0 );
 
-        // Set the new count
-        const std::int32_t nFacesRemoved = static_cast<int>(m_Facet.size() - nFacets);
-        TotalFacetsRemoved += nFacesRemoved;
-        if ( TotalFacetsRemoved )
-            m_Facet.resize( nFacets );
+                if ( Normal.Length() < 0.00001f )
+                {
+                    Stats.m_nDegeneratedFacets++;
+                    continue;
+                }
 
-        // No facets left!
-        if ( m_Facet.size() <= 0 )
-            throw(std::runtime_error( "geom has not facets" ));
+                Facets.Move( nFacets++, i );
+            }
 
-        if ( nFacesRemoved > 0 )
-            goto REMOVE_VERTS_AGAIN;
-    }
+            Facets.resize( nFacets );
 
+            // No facets left!
+            if ( Facets.size() <= 0 )
+                throw(std::runtime_error( "geom has not facets" ));
+        }
 
-    RMESH_SANITY
+        RMESH_SANITY
 
-    //
-    // Remove materials that are not been use
-    //
-    if( m_MaterialInstance.size() > 0 )
-    {
-        struct mat
+        //
+        // Nuke any facets that has the same vert indices and properties. Facets are canonicalized by
+        // their smallest rotation (so the winding is kept) and inserted into an open addressing table
+        // together with their mesh and material. Each table entry keeps the lowest facet index with
+        // that key so the result does not depend on how the threads interleave.
+        //
         {
-            bool   m_Used;
-            std::int32_t     m_ReIndex;
-        };
+            const std::int32_t nFacets = static_cast<std::int32_t>( Facets.size() );
 
-        std::int32_t         i;
-        std::vector<mat>   Used;
-        
-        Used.resize( m_MaterialInstance.size());
+            std::vector<std::uint64_t>  Hash     ( nFacets );
+            std::vector<std::uint8_t>   Rotation ( nFacets );
+            std::vector<std::uint8_t>   Duplicate( nFacets, 0 );
 
-        for ( mat& Mat : Used )
-        {
-            Mat.m_ReIndex = -1;
-            Mat.m_Used    = false;
-        }
-        
-        // Go throw the facets and mark all the used materials
-        for( i=0; i<m_Facet.size(); i++ )
-        {
-            const facet& Facet = m_Facet[i];
-             
-            if( Facet.m_iMaterialInstance < 0 ||
-                Facet.m_iMaterialInstance > m_MaterialInstance.size() )
-                throw(std::runtime_error( std::format("Found a face from mesh [{}] which was using an unknow material FaceID={} MaterialID ={}", 
-                    m_Mesh[ Facet.m_iMesh ].m_Name.c_str(),
-                    i, Facet.m_iMaterialInstance )));
+            std::size_t TableSize = 16;
+            while( TableSize < 2 * static_cast<std::size_t>(nFacets) ) TableSize *= 2;
+            const std::size_t TableMask = TableSize - 1;
 
-            Used[ Facet.m_iMaterialInstance ].m_Used = true;
-        }
+            std::vector<std::atomic<std::int32_t>> Table( TableSize );
+            for( auto& Entry : Table ) Entry.store( -1, std::memory_order_relaxed );
 
-        // Collapse all the material in order
-        std::int32_t     nMaterials      = 0;
-        bool   bAnyCollapse    = false;
-        for( i=0; i<m_MaterialInstance.size(); i++ )
-        {
-            if( Used[i].m_Used == false )
-                continue;
+            auto isSameFacet = [&]( std::int32_t iA, std::int32_t iB )
+            {
+                if( Hash[iA]                        != Hash[iB]                        ) return false;
+                if( Facets.iMesh(iA)                != Facets.iMesh(iB)                ) return false;
+                if( Facets.nVertices(iA)            != Facets.nVertices(iB)            ) return false;
+                if( Facets.iMaterialInstance(iA)    != Facets.iMaterialInstance(iB)    ) return false;
+
+                const auto n = Facets.nVertices(iA);
+                for( std::int32_t i = 0; i < n; i++ )
+                {
+                    if( Facets.iVertex( iA, (i + Rotation[iA]) % n ) != Facets.iVertex( iB, (i + Rotation[iB]) % n ) )
+                        return false;
+                }
+                return true;
+            };
 
-            if ( i == nMaterials )
+            // Canonicalize, hash and insert
+            details::ParallelFor( nFacets, 4096, [&]( std::size_t iBegin, std::size_t iEnd )
             {
-                Used[nMaterials].m_ReIndex  = i;
-            }
-            else
+                for( std::int32_t iFacet = static_cast<std::int32_t>(iBegin); iFacet < static_cast<std::int32_t>(iEnd); iFacet++ )
+                {
+                    const auto n = Facets.nVertices( iFacet );
+
+                    // Smallest rotation, comparing all of them handles facets that repeat an index
+                    std::int32_t Best = 0;
+                    for( std::int32_t r = 1; r < n; r++ )
+                    {
+                        for( std::int32_t i = 0; i < n; i++ )
+                        {
+                            const auto a = Facets.iVertex( iFacet, (r    + i) % n );
+                            const auto b = Facets.iVertex( iFacet, (Best + i) % n );
+                            if( a != b ) { if( a < b ) Best = r; break; }
+                        }
+                    }
+
+                    std::uint64_t H = 0xcbf29ce484222325ull;
+                    auto Mix = [&]( std::int32_t V ) { H = ( H ^ static_cast<std::uint32_t>(V) ) * 0x100000001b3ull; };
+                    Mix( Facets.iMesh( iFacet ) );
+                    Mix( Facets.iMaterialInstance( iFacet ) );
+                    Mix( n );
+                    for( std::int32_t i = 0; i < n; i++ ) Mix( Facets.iVertex( iFacet, (Best + i) % n ) );
+
+                    Hash[iFacet]     = H ^ ( H >> 29 );
+                    Rotation[iFacet] = static_cast<std::uint8_t>( Best );
+                }
+            });
+
+            details::ParallelFor( nFacets, 4096, [&]( std::size_t iBegin, std::size_t iEnd )
             {
-                bAnyCollapse = true;
-                m_MaterialInstance[ nMaterials ] = m_MaterialInstance[ i ];
-                Used[i].m_ReIndex                = nMaterials;
-            }
+                for( std::int32_t iFacet = static_cast<std::int32_t>(iBegin); iFacet < static_cast<std::int32_t>(iEnd); iFacet++ )
+                {
+                    for( std::size_t iSlot = Hash[iFacet] & TableMask; ; iSlot = (iSlot + 1) & TableMask )
+                    {
+                        std::int32_t Current = Table[iSlot].load();
 
-            nMaterials++;
-        }
+                        // Claim an empty slot, if someone beats us to it look at what they put there
+                        if( Current == -1 )
+                        {
+                            if( Table[iSlot].compare_exchange_strong( Current, iFacet ) ) break;
+                        }
 
-        // Update the material indices for the facets
-        if ( bAnyCollapse )
-        {
-            for( i=0; i<m_Facet.size(); i++ )
+                        if( isSameFacet( Current, iFacet ) )
+                        {
+                            while( iFacet < Current && Table[iSlot].compare_exchange_weak( Current, iFacet ) == false ) {}
+                            break;
+                        }
+                    }
+                }
+            });
+
+            // Every facet that is not the one left in the table is a duplicate
+            details::ParallelFor( nFacets, 4096, [&]( std::size_t iBegin, std::size_t iEnd )
             {
-                if( Used[ m_Facet[i].m_iMaterialInstance ].m_ReIndex < 0 ||
-                    Used[ m_Facet[i].m_iMaterialInstance ].m_ReIndex >= nMaterials )
-                    throw(std::runtime_error( "Error while cleaning the materials in the rawgeom2" ));
+                for( std::int32_t iFacet = static_cast<std::int32_t>(iBegin); iFacet < static_cast<std::int32_t>(iEnd); iFacet++ )
+                {
+                    for( std::size_t iSlot = Hash[iFacet] & TableMask; ; iSlot = (iSlot + 1) & TableMask )
+                    {
+                        const std::int32_t Current = Table[iSlot].load( std::memory_order_relaxed );
+                        if( isSameFacet( Current, iFacet ) )
+                        {
+                            Duplicate[iFacet] = Current != iFacet;
+                            break;
+                        }
+                    }
+                }
+            });
 
-                m_Facet[i].m_iMaterialInstance = Used[ m_Facet[i].m_iMaterialInstance ].m_ReIndex;
+            // Remove any unwanted facets
+            std::int32_t nKept = 0;
+            for( std::int32_t i = 0; i < nFacets; i++ )
+            {
+                if( Duplicate[i] == false ) Facets.Move( nKept++, i );
             }
 
-            // Set the new material count
-            TotalMaterialsRemoved += static_cast<int>(m_MaterialInstance.size() - nMaterials);
-            m_MaterialInstance.resize(nMaterials);
-        }
-
-        // Sort material parameters
-        for ( material_instance& Material : m_MaterialInstance )
-        {
-            std::sort( Material.m_Params.begin(), Material.m_Params.end());
+            // Set the new count
+            Stats.m_nDuplicatedFacets = nFacets - nKept;
+            Facets.resize( nKept );
         }
-    }
 
-    RMESH_SANITY
+        EndPhase( clean_stats::phase::FACETS );
+        RMESH_SANITY
 
-    //
-    // Remove unwanted meshes
-    //
-    {
-        std::int32_t i;
-        std::vector<std::int32_t> SMesh;
-        
-        SMesh.resize(m_Mesh.size());
-        std::memset( SMesh.data(), 0, SMesh.size() * sizeof(SMesh[0]));
-        
-        for( i=0; i<m_Facet.size(); i++ )
+        //
+        // Compact the vertices that are still used. This covers both the welded ones and the ones
+        // that lost all their facets, so it only needs to happen once.
+        //
         {
-            SMesh[ m_Facet[i].m_iMesh ] = 1;
-        }
+            std::vector<std::int32_t> VRemap( nVertices, -1 );
+            std::vector<std::int32_t> Keep;
 
-        std::int32_t nSubs = 0;
-        for( i=0; i<m_Mesh.size(); i++ )
-        {
-            if( SMesh[ i ] == 1 )
+            // Mark all the used vertices
+            for ( std::size_t i = 0; i < Facets.size(); i++ )
+            for ( std::int32_t j = 0; j < Facets.nVertices( i ); j++ )
             {
-                SMesh[i] = nSubs;
-                m_Mesh[nSubs++] = m_Mesh[i];
+                VRemap[ Facets.iVertex( i, j ) ] = -2;
             }
-            else
+
+            // Create the remap table
+            Keep.reserve( nVertices - Stats.m_nWeldedVertices );
+            for ( std::int32_t i = 0; i < nVertices; i++ )
             {
-                SMesh[i] = -1;
+                if ( VRemap[ i ] == -2 )
+                {
+                    VRemap[ i ] = static_cast<std::int32_t>( Keep.size() );
+                    Keep.push_back( i );
+                }
             }
-        }
 
-        // Set the new count
-        if( m_Mesh.size() != nSubs )
-            m_Mesh.resize( nSubs );
-        
-        for( i=0; i<m_Facet.size(); i++ )
-        {
-            assert( SMesh[ m_Facet[i].m_iMesh ] >= 0 );
-            m_Facet[i].m_iMesh = SMesh[ m_Facet[i].m_iMesh ];
-        }
-    }
+            // Compact the vertices to the new location
+            Stats.m_nUnusedVertices = nVertices - Stats.m_nWeldedVertices - static_cast<std::int32_t>( Keep.size() );
+            Vertices.Compact( Keep );
 
-    //
-    // Sort the meshes so that they are in alphabetical order
-    //    
-    {
-        // Create a vector of indices and sort them based on mesh names
-        std::vector<std::int32_t> indices(m_Mesh.size());
-        for (std::int32_t i = 0; i < static_cast<std::int32_t>(m_Mesh.size()); ++i)
-            indices[i] = i;
-
-        std::sort(indices.begin(), indices.end(),
-            [this](std::int32_t a, std::int32_t b) 
+            // Remap all the faces to point to the new location of verts
+            for ( std::size_t i = 0; i < Facets.size(); i++ )
+            for ( std::int32_t j = 0; j < Facets.nVertices( i ); j++ )
             {
-                return m_Mesh[a].m_Name < m_Mesh[b].m_Name;
-            });
+                Facets.setVertex( i, j, VRemap[ Facets.iVertex( i, j ) ] );
+            }
+        }
 
-        // Create remap table: old index -> new index
-        std::vector<std::int32_t> remap(m_Mesh.size());
-        for (std::int32_t new_i = 0; new_i < static_cast<std::int32_t>(m_Mesh.size()); ++new_i)
-            remap[indices[new_i]] = new_i;
+        // The facets now point to the welded vertices
+        m_bFacetPlanesDirty = true;
+        m_Skin.clear();
 
-        // Create a temporary copy of meshes in sorted order
-        std::vector<mesh> sorted_meshes(m_Mesh.size());
-        for (std::int32_t i = 0; i < static_cast<std::int32_t>(m_Mesh.size()); ++i)
-            sorted_meshes[i] = m_Mesh[indices[i]];
+        EndPhase( clean_stats::phase::VERTICES );
+        RMESH_SANITY
 
-        // Copy back to m_Mesh
-        m_Mesh = std::move(sorted_meshes);
+        //
+        // Remove materials and meshes that are not been use and sort the meshes so that they are in
+        // alphabetical order. Both remaps are applied to the facets in a single pass.
+        //
+        {
+            std::vector<std::int32_t> MaterialRemap( m_MaterialInstance.size(), -1 );
+            std::vector<std::int32_t> MeshRemap    ( m_Mesh.size(), -1 );
 
-        // Remap facet mesh indices
-        for (auto& f : m_Facet)
-            f.m_iMesh = remap[f.m_iMesh];
-    }
+            // Go throw the facets and mark all the used materials and meshes
+            for( std::int32_t i=0; i<Facets.size(); i++ )
+            {
+                const auto iFacetMesh     = Facets.iMesh(i);
+                const auto iFacetMaterial = Facets.iMaterialInstance(i);
 
-    //
-    // Stats
-    //
-    printf( "INFO: Total Facets Removed: %d\n",    TotalFacetsRemoved );
-    printf( "INFO: Total Verts  Removed: %d\n",    TotalVerticesRemoved );
-    printf( "INFO: Total Materials Removed: %d\n", TotalMaterialsRemoved );
-}
+                if( m_MaterialInstance.size() > 0 )
+                {
+                    if( iFacetMaterial < 0 ||
+                        iFacetMaterial >= m_MaterialInstance.size() )
+                        throw(std::runtime_error( std::format("Found a face from mesh [{}] which was using an unknow material FaceID={} MaterialID ={}", 
+                            m_Mesh[ iFacetMesh ].m_Name.c_str(),
+                            i, iFacetMaterial )));
 
-//--------------------------------------------------------------------------
-/*
-void CalculateTangentArray( 
-    const std::int32_t           vertexCount, 
-    const xmath::fvec3*    vertex, 
-    const xmath::fvec3*    normal,
-    const xmath::fvec2*     texcoord, 
-    const std::int32_t           triangleCount, 
-    const std::int32_t[3]*       triangle, 
-    Vector4D*           tangent )
-{
-    Vector3D *tan1 = new Vector3D[ vertexCount * 2 ];
-    Vector3D *tan2 = tan1 + vertexCount;
-    ZeroMemory( tan1, vertexCount * sizeof(Vector3D)* 2 );
+                    MaterialRemap[ iFacetMaterial ] = -2;
+                }
 
-    for ( long a = 0; a < triangleCount; a++ )
-    {
-        long i1 = triangle->index[ 0 ];
-        long i2 = triangle->index[ 1 ];
-        long i3 = triangle->index[ 2 ];
+                MeshRemap[ iFacetMesh ] = -2;
+            }
 
-        const Point3D& v1 = vertex[ i1 ];
-        const Point3D& v2 = vertex[ i2 ];
-        const Point3D& v3 = vertex[ i3 ];
+            // Collapse all the materials in order
+            std::int32_t nMaterials = 0;
+            for( std::int32_t i=0; i<m_MaterialInstance.size(); i++ )
+            {
+                if( MaterialRemap[i] != -2 )
+                    continue;
 
-        const Point2D& w1 = texcoord[ i1 ];
-        const Point2D& w2 = texcoord[ i2 ];
-        const Point2D& w3 = texcoord[ i3 ];
+                if( i != nMaterials ) m_MaterialInstance[ nMaterials ] = std::move( m_MaterialInstance[ i ] );
+                MaterialRemap[i] = nMaterials++;
+            }
 
-        float x1 = v2.x - v1.x;
-        float x2 = v3.x - v1.x;
-        float y1 = v2.y - v1.y;
-        float y2 = v3.y - v1.y;
-        float z1 = v2.z - v1.z;
-        float z2 = v3.z - v1.z;
+            Stats.m_nMaterialsRemoved = static_cast<int>(m_MaterialInstance.size() - nMaterials);
+            m_MaterialInstance.resize( nMaterials );
 
-        float s1 = w2.x - w1.x;
-        float s2 = w3.x - w1.x;
-        float t1 = w2.y - w1.y;
-        float t2 = w3.y - w1.y;
+            // Sort material parameters
+            for ( material_instance& Material : m_MaterialInstance )
+            {
+                std::sort( Material.m_Params.begin(), Material.m_Params.end());
+            }
 
-        float r = 1.0F / ( s1 * t2 - s2 * t1 );
-        Vector3D sdir( ( t2 * x1 - t1 * x2 ) * r, ( t2 * y1 - t1 * y2 ) * r,
-            ( t2 * z1 - t1 * z2 ) * r );
-        Vector3D tdir( ( s1 * x2 - s2 * x1 ) * r, ( s1 * y2 - s2 * y1 ) * r,
-            ( s1 * z2 - s2 * z1 ) * r );
+            // Sort the used meshes by name
+            std::vector<std::int32_t> SortedMeshes;
+            for( std::int32_t i=0; i<m_Mesh.size(); i++ )
+            {
+                if( MeshRemap[i] == -2 ) SortedMeshes.push_back(i);
+            }
 
-        tan1[ i1 ] += sdir;
-        tan1[ i2 ] += sdir;
-        tan1[ i3 ] += sdir;
+            std::stable_sort( SortedMeshes.begin(), SortedMeshes.end(), [this]( std::int32_t a, std::int32_t b )
+            {
+                return m_Mesh[a].m_Name < m_Mesh[b].m_Name;
+            });
 
-        tan2[ i1 ] += tdir;
-        tan2[ i2 ] += tdir;
-        tan2[ i3 ] += tdir;
+            std::vector<mesh> NewMeshes( SortedMeshes.size() );
+            for( std::int32_t i=0; i<SortedMeshes.size(); i++ )
+            {
+                MeshRemap[ SortedMeshes[i] ] = i;
+                NewMeshes[i]                 = std::move( m_Mesh[ SortedMeshes[i] ] );
+            }
 
-        triangle++;
-    }
+            Stats.m_nMeshesRemoved = static_cast<int>(m_Mesh.size() - NewMeshes.size());
+            m_Mesh = std::move( NewMeshes );
+            InvalidateMeshIndex();
 
-    for ( long a = 0; a < vertexCount; a++ )
-    {
-        const Vector3D& n = normal[ a ];
-        const Vector3D& t = tan1[ a ];
+            // Update the material and mesh indices for the facets
+            for( std::size_t i = 0; i < Facets.size(); i++ )
+            {
+                if( nMaterials ) Facets.setMaterialInstance( i, MaterialRemap[ Facets.iMaterialInstance(i) ] );
 
-        // Gram-Schmidt orthogonalize
-        tangent[ a ] = ( t - n * Dot( n, t ) ).Normalize( );
+                assert( MeshRemap[ Facets.iMesh(i) ] >= 0 );
+                Facets.setMesh( i, MeshRemap[ Facets.iMesh(i) ] );
+            }
+        }
 
-        // Calculate handedness
-        tangent[ a ].w = ( Dot( Cross( n, t ), tan2[ a ] ) < 0.0F ) ? -1.0F : 1.0F;
-    }
+        EndPhase( clean_stats::phase::MATERIALS_AND_MESHES );
+        RMESH_SANITY
 
-    delete[ ] tan1;
+        return Stats;
+    });
+    });
 }
-*/
 
 //--------------------------------------------------------------------------
 
 void geom::SanityCheck( void ) const
 {
+    const std::size_t nVertices = isStreamLayout()   ? m_Streams.size()   : m_Vertex.size();
+    const std::size_t nFacets   = isTriangleLayout() ? m_Triangles.size() : m_Facet.size();
+
     //
     // Check that we have a valid number of materials
     //
@@ -1542,16 +4094,16 @@ void geom::SanityCheck( void ) const
     if( m_MaterialInstance.size() > 1000 )
         throw(std::runtime_error( "The rawgeom2 has more than 1000 materials right now that is a sign of a problem" ));
     
-    if( m_Vertex.size() < 0 )
+    if( nVertices < 0 )
         throw(std::runtime_error( "THe rawgeom2 has a negative number of vertices!" ));
 
-    if( m_Vertex.size() > 100000000 )
+    if( nVertices > 100000000 )
         throw(std::runtime_error( "The rawgeom2 seems to have more that 100 million vertices that is consider bad" ));
 
-    if( m_Facet.size() < 0 )
+    if( nFacets < 0 )
         throw(std::runtime_error( "We have a negative number of facets" ));
 
-    if( m_Facet.size() > 100000000 )
+    if( nFacets > 100000000 )
         throw(std::runtime_error( "THe rawgeom2 has more thatn 100 million facets that is consider worng" ));
 
     if( m_Bone.size() < 0 )
@@ -1572,11 +4124,13 @@ void geom::SanityCheck( void ) const
     //
     // Check the facets.
     //
+    details::VisitFacets( *this, [&]( auto Facets )
     {
+        facet        Facet;
         std::int32_t i;
-        for( i=0; i<m_Facet.size(); i++ )
+        for( i=0; i<Facets.size(); i++ )
         {
-            const facet& Facet = m_Facet[i];
+            Facets.getFacet( i, Facet );
 
             if( Facet.m_nVertices < 0 )
                 throw(std::runtime_error( std::format( "I found a facet that had a negative number of indices to vertices Face#:{}", i )));
@@ -1604,274 +4158,584 @@ void geom::SanityCheck( void ) const
                 if( Facet.m_iVertex[j] < 0 )
                     throw(std::runtime_error(std::format("I found a facet with a negative index to vertices. Facet#:{}",i)));
 
-                if( Facet.m_iVertex[j] >= m_Vertex.size() )
+                if( Facet.m_iVertex[j] >= nVertices )
                     throw(std::runtime_error(std::format("I found a facet with a index to a non-exiting vertex. Facet#:{}",i)));
             }
         }
-    }
+    });
 
     //
     // Check the vertices.
     //
+    details::VisitVertices( *this, [&]( auto Vertices )
+    {
+    details::VisitFacets( *this, [&]( auto Facets )
     {
         std::int32_t i,j;
-        for( i=0; i<m_Facet.size(); i++ )
+        for( i=0; i<Facets.size(); i++ )
         {
-            const facet& Facet = m_Facet[i];
-            for( j=0; j<Facet.m_nVertices; j++ )
+            for( j=0; j<Facets.nVertices(i); j++ )
             {
-                const vertex& V = m_Vertex[ Facet.m_iVertex[j] ];
+                const auto  iV       = Facets.iVertex(i, j);
+                const auto& Position = Vertices.Position(iV);
 
-                if( xmath::isValid( V.m_Position.m_X ) == false ||
-                    xmath::isValid( V.m_Position.m_Y ) == false ||
-                    xmath::isValid( V.m_Position.m_Z ) == false )
+                if( xmath::isValid( Position.m_X ) == false ||
+                    xmath::isValid( Position.m_Y ) == false ||
+                    xmath::isValid( Position.m_Z ) == false )
                     throw(std::runtime_error(std::format("Just got a infinete vertex position: Vertex#:{}",j)));
 
-                if( V.m_nWeights < 0 )
+                if( Vertices.nWeights(iV) < 0 )
                     throw(std::runtime_error(std::format("We have a negative count of weights for one of the vertices. V#:{}",j)));
 
-                if( V.m_nWeights >= vertex_max_weights_v )
+                if( Vertices.nWeights(iV) >= vertex_max_weights_v )
                     throw(std::runtime_error(std::format("Found a vertex with way too many weights. V#:{}",j)));
 
-                if( V.m_nWeights > m_Bone.size() )
+                if( Vertices.nWeights(iV) > m_Bone.size() )
                     throw(std::runtime_error(std::format("Found a vertex pointing to a non-exiting bone: V#:{}",j)));
 
-                if( V.m_nNormals < 0 )
+                if( Vertices.nNormals(iV) < 0 )
                     throw(std::runtime_error(std::format("Found a vertex with a negative number of Normals. V#:{}",j)));
 
-                if( V.m_nNormals >= vertex_max_normals_v )
+                if( Vertices.nNormals(iV) >= vertex_max_normals_v )
                     throw(std::runtime_error(std::format("Found a vertex with way too many normals. V3:{}", j)));
 
-                if( V.m_nColors < 0 )
+                if( Vertices.nColors(iV) < 0 )
                     throw(std::runtime_error(std::format("I found a vertex with a negative number of colors. V#:{}", j)));
 
-                if( V.m_nColors >= vertex_max_colors_v )
+                if( Vertices.nColors(iV) >= vertex_max_colors_v )
                     throw(std::runtime_error(std::format("I found a vertex with way too many colors. V#:{}", j)));
 
-                if( V.m_nUVs < 0 )
+                if( Vertices.nUVs(iV) < 0 )
                     throw(std::runtime_error(std::format("I found a vertex with a negative count for UVs. V#:{}",j)));
 
-                if( V.m_nUVs > vertex_max_uv_v )
+                if( Vertices.nUVs(iV) > vertex_max_uv_v )
                     throw(std::runtime_error(std::format("I found a vertex with way too many UVs. V#:{}", j)));
 
-                //if( V.nUVs != m_pMaterial[ Facet.iMaterial ].GetUVChanelCount() )
-                //    throw(std::runtime_error( xfs("I found a vertex that didn't have the right number of UVs for the material been used. V#:%d, F#:%d",j,i));
+                //if( V.nUVs != m_pMaterial[ Facet.iMaterial ].GetUVChanelCount() )
+                //    throw(std::runtime_error( xfs("I found a vertex that didn't have the right number of UVs for the material been used. V#:%d, F#:%d",j,i));
+
+            }
+        }
+    });
+    });
+}
+
+//--------------------------------------------------------------------------
+
+void geom::CleanWeights( std::int32_t MaxNumWeights, float MinWeightValue )
+{
+    m_Skin.clear();
+
+    details::VisitVertices( *this, [&]( auto Vertices )
+    {
+        if( Vertices.size() == 0 ) return;
+
+        // Vertices without weights end up with one
+        Vertices.AllocateChannels( 0, 0, 0, 1 );
+
+        details::ParallelFor( Vertices.size(), 4096, [&]( std::size_t iBegin, std::size_t iEnd )
+        {
+            details::weight_block W;
+            for( std::size_t i = iBegin; i < iEnd; ++i )
+            {
+                const std::int32_t nWeights = Vertices.nWeights(i);
+                for( std::int32_t j = 0; j < nWeights; ++j ) W[j] = Vertices.Weight( i, j );
+
+                const std::int32_t nNewWeights = details::CleanVertexWeights( W, nWeights, MaxNumWeights, MinWeightValue );
+                for( std::int32_t j = 0; j < nNewWeights; ++j )
+                {
+                    assert( W[j].m_iBone >= 0 );
+                    assert( W[j].m_iBone < m_Bone.size() );
+                    Vertices.Weight( i, j ) = W[j];
+                }
+
+                if( nNewWeights != nWeights )
+                {
+                    auto Counts = Vertices.Counts(i);
+                    Counts.m_nWeights = static_cast<std::uint8_t>( nNewWeights );
+                    Vertices.setCounts( i, Counts );
+                }
+            }
+        });
+    });
+}
+
+//--------------------------------------------------------------------------
+// The influences of a vertex are its largest weights (same order as CleanWeights), normalized and
+// quantized with the largest remainder method: every weight is rounded down and the units still
+// missing to reach the unorm max go to the weights that lost the most, so the sum is exact.
+//--------------------------------------------------------------------------
+geom::skin_stats geom::BuildSkinStream( const skin_stream::format& Format )
+{
+    if( Format.m_nInfluences != 4 && Format.m_nInfluences != 8 )
+        throw(std::runtime_error(std::format("A skin stream can have 4 or 8 influences per vertex, not {}", Format.m_nInfluences)));
+
+    const std::int32_t  MaxBone   = Format.m_BoneFormat   == skin_stream::bone_format::UINT8    ? 0xff : 0xffff;
+    const std::int32_t  MaxWeight = Format.m_WeightFormat == skin_stream::weight_format::UNORM8 ? 0xff : 0xffff;
+    const std::int32_t  nSlots    = Format.m_nInfluences;
+
+    m_Skin.clear();
+    m_Skin.m_Format = Format;
+
+    std::vector<skin_stats> ChunkStats;
+
+    details::VisitVertices( *this, [&]( auto Vertices )
+    {
+        const std::size_t nVertices = Vertices.size();
+
+        m_Skin.m_Bones.resize  ( nVertices * nSlots * m_Skin.getBoneSize() );
+        m_Skin.m_Weights.resize( nVertices * nSlots * m_Skin.getWeightSize() );
+        ChunkStats.resize( (nVertices + 4095) / 4096 );
+
+        details::ParallelFor( nVertices, 4096, [&]( std::size_t iBegin, std::size_t iEnd )
+        {
+            auto&                               Stats = ChunkStats[ iBegin / 4096 ];
+            details::weight_block               W;
+            std::array<std::int32_t, 8>         Quantized;
+            std::array<float, 8>                Remainder;
+
+            for( std::size_t i = iBegin; i < iEnd; ++i )
+            {
+                std::int32_t nWeights = Vertices.nWeights(i);
+                for( std::int32_t j = 0; j < nWeights; ++j ) W[j] = Vertices.Weight( i, j );
+
+                // No weights, fully attached to the root like CleanWeights does
+                if( nWeights == 0 )
+                {
+                    W[0].m_iBone  = 0;
+                    W[0].m_Weight = 1;
+                    nWeights      = 1;
+                }
+
+                details::SortWeights( W, nWeights );
+
+                float Total = 0;
+                for( std::int32_t j = 0; j < nWeights; ++j ) Total += W[j].m_Weight;
+
+                const std::int32_t nUsed = std::min( nWeights, nSlots );
+                float              Kept  = 0;
+                for( std::int32_t j = 0; j < nUsed; ++j ) Kept += W[j].m_Weight;
+
+                if( !(Kept > 0) || !(Total > 0) )
+                    throw(std::runtime_error(std::format("Vertex {} has weights that do not add up to a positive value", i)));
+
+                if( nUsed < nWeights )
+                {
+                    Stats.m_nTruncatedVertices++;
+                    Stats.m_MaxDroppedWeight = std::max( Stats.m_MaxDroppedWeight, 1 - Kept / Total );
+                }
+
+                // Round down and hand out what is missing by largest remainder
+                std::int32_t Sum = 0;
+                for( std::int32_t j = 0; j < nSlots; ++j )
+                {
+                    const float Scaled = j < nUsed ? std::max( 0.0f, W[j].m_Weight ) / Kept * MaxWeight : 0;
+                    Quantized[j] = std::min( MaxWeight, static_cast<std::int32_t>( Scaled ) );
+                    Remainder[j] = j < nUsed ? Scaled - Quantized[j] : -1;
+                    Sum         += Quantized[j];
+                }
+
+                for( ; Sum < MaxWeight; ++Sum )
+                {
+                    const auto iBest = std::max_element( Remainder.begin(), Remainder.begin() + nSlots ) - Remainder.begin();
+                    Quantized[iBest]++;
+                    Remainder[iBest] -= 1;
+                }
+
+                for( std::int32_t j = 0; j < nSlots; ++j )
+                {
+                    const std::int32_t iBone = j < nUsed ? W[j].m_iBone : 0;
+                    if( iBone < 0 || iBone > MaxBone )
+                        throw(std::runtime_error(std::format("Vertex {} uses bone {} which does not fit the skin stream bone format", i, iBone)));
+
+                    const float Error = std::abs( Quantized[j] / float(MaxWeight) - ( j < nUsed ? W[j].m_Weight / Total : 0 ) );
+                    if( Error > Stats.m_MaxWeightError )
+                    {
+                        Stats.m_MaxWeightError  = Error;
+                        Stats.m_iMaxErrorVertex = static_cast<std::int32_t>(i);
+                    }
+
+                    const std::size_t Index = i * nSlots + j;
+                    if( MaxBone == 0xff ) m_Skin.m_Bones[Index] = static_cast<std::uint8_t>( iBone );
+                    else
+                    {
+                        const auto Bone = static_cast<std::uint16_t>( iBone );
+                        std::memcpy( &m_Skin.m_Bones[ Index * 2 ], &Bone, 2 );
+                    }
+
+                    if( MaxWeight == 0xff ) m_Skin.m_Weights[Index] = static_cast<std::uint8_t>( Quantized[j] );
+                    else
+                    {
+                        const auto Weight = static_cast<std::uint16_t>( Quantized[j] );
+                        std::memcpy( &m_Skin.m_Weights[ Index * 2 ], &Weight, 2 );
+                    }
+                }
+            }
+        });
+    });
+
+    skin_stats Stats;
+    for( const auto& C : ChunkStats )
+    {
+        Stats.m_nTruncatedVertices += C.m_nTruncatedVertices;
+        Stats.m_MaxDroppedWeight    = std::max( Stats.m_MaxDroppedWeight, C.m_MaxDroppedWeight );
+        if( C.m_MaxWeightError > Stats.m_MaxWeightError )
+        {
+            Stats.m_MaxWeightError  = C.m_MaxWeightError;
+            Stats.m_iMaxErrorVertex = C.m_iMaxErrorVertex;
+        }
+    }
+
+    return Stats;
+}
+
+//--------------------------------------------------------------------------
+
+void geom::CollapseMeshes( std::string_view MeshName )
+{
+    details::VisitFacets( *this, [&]( auto Facets )
+    {
+        for( std::size_t i = 0; i < Facets.size(); i++ )
+            Facets.setMesh( i, 0 );
+    });
+
+    int MaxBones = -100;
+    for( auto& Mesh : m_Mesh )
+    {
+        MaxBones = std::max( MaxBones, Mesh.m_nBones );
+    }
+    
+    m_Mesh.resize(1);
+    m_Mesh[0].m_Name    = MeshName;
+    m_Mesh[0].m_nBones  = MaxBones;
+    InvalidateMeshIndex();
+}
+
+//--------------------------------------------------------------------------
+
+void geom::ComputeMeshBBox( std::int32_t iMesh, xmath::fbbox& BBox ) const
+{
+    details::simd_bbox Box;
+
+    details::VisitVertices( *this, [&]( auto Vertices )
+    {
+    details::VisitFacets( *this, [&]( auto Facets )
+    {
+        for( std::size_t i = 0; i < Facets.size(); ++i )
+        {
+            if( Facets.iMesh(i) != iMesh ) continue;
+            for( std::int32_t j = 0, n = Facets.nVertices(i); j < n; ++j )
+                Box.Add( Vertices.Position( Facets.iVertex(i, j) ) );
+        }
+    });
+    });
+
+    Box.Write( BBox );
+}
+
+//--------------------------------------------------------------------------
+// All the mesh boxes in one pass over the facets. Every chunk of facets accumulates into its own
+// row of per mesh boxes, the rows are then folded together mesh by mesh. The chunks are kept
+// large so the rows stay small even for geoms with thousands of meshes.
+//--------------------------------------------------------------------------
+void geom::ComputeMeshBBoxes( std::vector<xmath::fbbox>& MeshBBoxes, xmath::fbbox& BBox ) const
+{
+    const std::size_t                   nMeshes = m_Mesh.size();
+    std::vector<details::simd_bbox>     Boxes( nMeshes );
+
+    details::VisitVertices( *this, [&]( auto Vertices )
+    {
+    details::VisitFacets( *this, [&]( auto Facets )
+    {
+        const std::size_t nFacets  = Facets.size();
+        const std::size_t nWorkers = 4 * std::max( 1u, std::thread::hardware_concurrency() );
+        const std::size_t Grain    = std::max<std::size_t>( 4096, (nFacets + nWorkers - 1) / nWorkers );
+        const std::size_t nChunks  = (nFacets + Grain - 1) / Grain;
+
+        Boxes.resize( std::max<std::size_t>( 1, nChunks ) * nMeshes );
+
+        details::ParallelFor( nFacets, Grain, [&]( std::size_t iBegin, std::size_t iEnd )
+        {
+            details::simd_bbox* const pRow = Boxes.data() + (iBegin / Grain) * nMeshes;
+            for( std::size_t i = iBegin; i < iEnd; ++i )
+            {
+                const std::int32_t iMesh = Facets.iMesh(i);
+                if( iMesh < 0 || static_cast<std::size_t>(iMesh) >= nMeshes )
+                    throw(std::runtime_error(std::format("Facet {} references mesh {} but the geom only has {} meshes", i, iMesh, nMeshes)));
 
+                auto& Box = pRow[ iMesh ];
+                for( std::int32_t j = 0, n = Facets.nVertices(i); j < n; ++j )
+                    Box.Add( Vertices.Position( Facets.iVertex(i, j) ) );
             }
-        }
+        });
+
+        if( nChunks > 1 ) details::ParallelFor( nMeshes, 256, [&]( std::size_t iBegin, std::size_t iEnd )
+        {
+            for( std::size_t iMesh = iBegin; iMesh < iEnd; ++iMesh )
+                for( std::size_t iChunk = 1; iChunk < nChunks; ++iChunk )
+                    Boxes[ iMesh ].Add( Boxes[ iChunk * nMeshes + iMesh ] );
+        });
+    });
+    });
+
+    details::simd_bbox Total;
+    MeshBBoxes.resize( nMeshes );
+    for( std::size_t iMesh = 0; iMesh < nMeshes; ++iMesh )
+    {
+        Total.Add( Boxes[ iMesh ] );
+        Boxes[ iMesh ].Write( MeshBBoxes[ iMesh ] );
     }
+    Total.Write( BBox );
 }
 
 //--------------------------------------------------------------------------
-
-void geom::CleanWeights( std::int32_t MaxNumWeights, float MinWeightValue )
+// Facet planes. The positions of a block of facets are gathered into SoA buffers so the planes
+// can be computed four at a time with SSE, the blocks run in parallel. Facets with more than
+// three vertices use their first three, the same as the importers always did.
+//--------------------------------------------------------------------------
+namespace details
 {
-    std::int32_t i,j,k;
-
-    //
-    // Sort weights from largest to smallest
-    //
-    for( i=0; i<m_Vertex.size(); i++ )
+    template< typename T_VERTICES, typename T_FACETS >
+    void ComputeFacetPlanes( const T_VERTICES& Vertices, const T_FACETS& Facets, std::span<const std::uint32_t> iFacets, std::span<xmath::fplane> Planes )
     {
-        for( j=0; j<m_Vertex[i].m_nWeights; j++ )
+        constexpr std::size_t block_v = 256;
+
+        ParallelFor( Planes.size(), block_v, [&]( std::size_t iBegin, std::size_t iEnd )
         {
-            std::int32_t BestW = j;
-            for( k=j+1; k<m_Vertex[i].m_nWeights; k++ )
+            alignas(16) std::array<std::array<float, block_v>, 3> X, Y, Z;
+            alignas(16) std::array<float, block_v>                NX, NY, NZ, D;
+
+            // Gather, padding the last group of four with zeros
+            const std::size_t n        = iEnd - iBegin;
+            const std::size_t nPadded  = ( n + 3 ) & ~std::size_t(3);
+            for( std::size_t i = 0; i < nPadded; ++i )
             {
-                if( m_Vertex[i].m_Weight[k].m_Weight > m_Vertex[i].m_Weight[BestW].m_Weight )
-                    BestW = k;
+                for( std::int32_t k = 0; k < 3; ++k )
+                {
+                    if( i < n )
+                    {
+                        const std::size_t iFacet = iFacets.empty() ? iBegin + i : iFacets[ iBegin + i ];
+                        const auto&       P      = Vertices.Position( Facets.iVertex( iFacet, k ) );
+                        X[k][i] = P.m_X;
+                        Y[k][i] = P.m_Y;
+                        Z[k][i] = P.m_Z;
+                    }
+                    else
+                    {
+                        X[k][i] = Y[k][i] = Z[k][i] = 0;
+                    }
+                }
             }
 
-            weight TW = m_Vertex[i].m_Weight[j];
-            m_Vertex[i].m_Weight[j] = m_Vertex[i].m_Weight[BestW];
-            m_Vertex[i].m_Weight[BestW] = TW;
+            const __m128 Epsilon = _mm_set1_ps( 1e-20f );
+            const __m128 One     = _mm_set1_ps( 1.0f );
+            for( std::size_t i = 0; i < nPadded; i += 4 )
+            {
+                const __m128 X0 = _mm_load_ps( &X[0][i] ), Y0 = _mm_load_ps( &Y[0][i] ), Z0 = _mm_load_ps( &Z[0][i] );
+                const __m128 AX = _mm_sub_ps( _mm_load_ps( &X[1][i] ), X0 );
+                const __m128 AY = _mm_sub_ps( _mm_load_ps( &Y[1][i] ), Y0 );
+                const __m128 AZ = _mm_sub_ps( _mm_load_ps( &Z[1][i] ), Z0 );
+                const __m128 BX = _mm_sub_ps( _mm_load_ps( &X[2][i] ), X0 );
+                const __m128 BY = _mm_sub_ps( _mm_load_ps( &Y[2][i] ), Y0 );
+                const __m128 BZ = _mm_sub_ps( _mm_load_ps( &Z[2][i] ), Z0 );
+
+                // Cross product and normalize, degenerated facets get a zero normal
+                __m128 CX = _mm_sub_ps( _mm_mul_ps( AY, BZ ), _mm_mul_ps( AZ, BY ) );
+                __m128 CY = _mm_sub_ps( _mm_mul_ps( AZ, BX ), _mm_mul_ps( AX, BZ ) );
+                __m128 CZ = _mm_sub_ps( _mm_mul_ps( AX, BY ), _mm_mul_ps( AY, BX ) );
+
+                const __m128 LengthSq = _mm_add_ps( _mm_add_ps( _mm_mul_ps( CX, CX ), _mm_mul_ps( CY, CY ) ), _mm_mul_ps( CZ, CZ ) );
+                const __m128 Valid    = _mm_cmpgt_ps( LengthSq, Epsilon );
+                const __m128 InvLen   = _mm_and_ps( Valid, _mm_div_ps( One, _mm_sqrt_ps( _mm_max_ps( LengthSq, Epsilon ) ) ) );
+
+                CX = _mm_mul_ps( CX, InvLen );
+                CY = _mm_mul_ps( CY, InvLen );
+                CZ = _mm_mul_ps( CZ, InvLen );
+
+                const __m128 Dot = _mm_add_ps( _mm_add_ps( _mm_mul_ps( CX, X0 ), _mm_mul_ps( CY, Y0 ) ), _mm_mul_ps( CZ, Z0 ) );
+
+                _mm_store_ps( &NX[i], CX );
+                _mm_store_ps( &NY[i], CY );
+                _mm_store_ps( &NZ[i], CZ );
+                _mm_store_ps( &D[i],  _mm_sub_ps( _mm_setzero_ps(), Dot ) );
+            }
 
-            assert(  m_Vertex[i].m_Weight[j].m_iBone >= 0 );
-            assert( m_Vertex[i].m_Weight[j].m_iBone < m_Bone.size() );
-        }
+            for( std::size_t i = 0; i < n; ++i )
+            {
+                auto& Plane = Planes[ iBegin + i ];
+                Plane.m_Normal.m_X = NX[i];
+                Plane.m_Normal.m_Y = NY[i];
+                Plane.m_Normal.m_Z = NZ[i];
+                Plane.m_D          = D[i];
+            }
+        });
     }
+}
 
-    //
-    // Cull any extra weights
-    //
-    for( i=0; i<m_Vertex.size(); i++ )
-        if( m_Vertex[i].m_nWeights > MaxNumWeights )
-        {
-            m_Vertex[i].m_nWeights = MaxNumWeights;
-
-            // Normalize weights
-            float TotalW=0.0f;
-            for( j=0; j<m_Vertex[i].m_nWeights; j++ )
-                TotalW += m_Vertex[i].m_Weight[j].m_Weight;
-
-            for( j=0; j<m_Vertex[i].m_nWeights; j++ )
-                m_Vertex[i].m_Weight[j].m_Weight /= TotalW;
-        }
+//--------------------------------------------------------------------------
 
-    //
-    // Throw out all weights below MinWeightValue
-    //
-    for( i=0; i<m_Vertex.size(); i++ )
+void geom::ComputeFacetPlanes( std::span<xmath::fplane> Planes, std::int32_t iMesh ) const
+{
+    details::VisitVertices( *this, [&]( auto Vertices )
     {
-        if ( m_Vertex[i].m_nWeights == 0 )
-        {
-            m_Vertex[ i ].m_Weight[ 0 ].m_iBone = 0;
-            m_Vertex[ i ].m_Weight[ 0 ].m_Weight = 1;
-            m_Vertex[i].m_nWeights = 1;
-            continue;
-        }
-
-       // Keep weights above MinWeight
-        std::int32_t nWeights = 0;
-        for( j=0; j<m_Vertex[i].m_nWeights; j++ )
+    details::VisitFacets( *this, [&]( auto Facets )
+    {
+        std::vector<std::uint32_t> iFacets;
+        if( iMesh != -1 )
         {
-            if( m_Vertex[i].m_Weight[j].m_Weight >= MinWeightValue )
-            {
-                m_Vertex[i].m_Weight[nWeights] = m_Vertex[i].m_Weight[j];
-                nWeights++;
-            }
+            for( std::size_t i = 0; i < Facets.size(); ++i )
+                if( Facets.iMesh(i) == iMesh ) iFacets.push_back( static_cast<std::uint32_t>(i) );
         }
-        
-        nWeights = std::max(1,nWeights);
-        m_Vertex[i].m_nWeights = nWeights;
-
-        // Normalize weights
-        float TotalW=0.0f;
-        for( j=0; j<m_Vertex[i].m_nWeights; j++ )
-            TotalW += m_Vertex[i].m_Weight[j].m_Weight;
-        
-        for( j=0; j<m_Vertex[i].m_nWeights; j++ )
-            m_Vertex[i].m_Weight[j].m_Weight /= TotalW;
 
+        const std::size_t nPlanes = iMesh == -1 ? Facets.size() : iFacets.size();
+        if( Planes.size() != nPlanes )
+            throw(std::runtime_error( std::format( "Got room for {} planes but there are {} facets", Planes.size(), nPlanes ) ));
 
-        for ( j = 0; j < m_Vertex[ i ].m_nWeights; j++ )
-        {
-            assert( m_Vertex[ i ].m_Weight[ j ].m_iBone >= 0 );
-            assert( m_Vertex[ i ].m_Weight[ j ].m_iBone < m_Bone.size() );
-        }
-    }
+        details::ComputeFacetPlanes( Vertices, Facets, iFacets, Planes );
+    });
+    });
 }
 
 //--------------------------------------------------------------------------
 
-void geom::CollapseMeshes( std::string_view MeshName )
+void geom::UpdateFacetPlanes( void )
 {
-    for( auto& Facet : m_Facet )
-    {
-        Facet.m_iMesh = 0;
-    }
+    if( m_bFacetPlanesDirty == false ) return;
 
-    int MaxBones = -100;
-    for( auto& Mesh : m_Mesh )
+    // The triangle layout does not store planes, so there is nothing to keep up to date
+    if( isTriangleLayout() == false && m_Facet.empty() == false )
     {
-        MaxBones = std::max( MaxBones, Mesh.m_nBones );
+        std::vector<xmath::fplane> Planes( m_Facet.size() );
+        ComputeFacetPlanes( Planes );
+        for( std::size_t i = 0; i < m_Facet.size(); ++i ) m_Facet[i].m_Plane = Planes[i];
     }
-    
-    m_Mesh.resize(1);
-    m_Mesh[0].m_Name    = MeshName;
-    m_Mesh[0].m_nBones  = MaxBones;
+
+    m_bFacetPlanesDirty = false;
 }
 
 //--------------------------------------------------------------------------
 
-void geom::ComputeMeshBBox( std::int32_t iMesh, xmath::fbbox& BBox )
+void geom::InvalidateFacetPlanes( void ) noexcept
 {
-    std::int32_t i,j;
+    m_bFacetPlanesDirty = true;
+}
 
-    BBox.setupZero();
+//--------------------------------------------------------------------------
 
-    for( i=0; i<m_Facet.size(); i++ )
-    {
-        if( m_Facet[i].m_iMesh == iMesh )
-        {
-            for( j=0; j<m_Facet[i].m_nVertices; j++ )
-                BBox += m_Vertex[ m_Facet[i].m_iVertex[j] ].m_Position;
-        }
-    }
+bool geom::areFacetPlanesDirty( void ) const noexcept
+{
+    return m_bFacetPlanesDirty;
 }
 
 //--------------------------------------------------------------------------
 
-// Computes bone bboxes and the number of bones used by each Mesh
+// Computes bone bboxes and the number of bones used by each Mesh.
+// One parallel pass over the vertices grows per chunk bone boxes and records the highest bone each
+// vertex uses, a second parallel pass over the facets only has to read that per vertex value.
+// The chunk results are merged at the end, chunks are kept large so the partial arrays stay small.
 void geom::ComputeBoneInfo( void )
 {
-    std::int32_t i,j,k ;
+    const std::size_t nBones   = m_Bone.size();
+    const std::size_t nMeshes  = m_Mesh.size();
+    const std::size_t nWorkers = 4 * std::max( 1u, std::thread::hardware_concurrency() );
 
-    //=====================================================================
-    // Compute bone bboxes
-    //=====================================================================
+    auto ChunkGrain = [&]( std::size_t Count )
+    {
+        return std::max<std::size_t>( 4096, (Count + nWorkers - 1) / nWorkers );
+    };
 
-    // Clear all bone bboxes
-    for (i = 0 ; i < m_Bone.size() ; i++)
-        m_Bone[i].m_BBox.setupZero() ;
+    std::vector<details::simd_bbox>     BoneBoxes;
+    std::vector<std::int32_t>           MeshMaxBone;
 
-    // Loop through all the verts and add to bone bboxes
-    for (i = 0 ; i < m_Vertex.size() ; i++)
+    details::VisitVertices( *this, [&]( auto Vertices )
     {
-        // Lookup vert
-        vertex& Vertex = m_Vertex[i] ;
+        //=====================================================================
+        // Compute bone bboxes and the max bone of every vertex
+        //=====================================================================
+        const std::size_t           nVertices = Vertices.size();
+        const std::size_t           Grain     = ChunkGrain( nVertices );
+        const std::size_t           nChunks   = (nVertices + Grain - 1) / Grain;
+        std::vector<std::int32_t>   VertexMaxBone( nVertices );
 
-        // Loop through all weights in vertex
-        for (std::int32_t j = 0 ; j < Vertex.m_nWeights ; j++)
+        BoneBoxes.resize( std::max<std::size_t>( 1, nChunks ) * nBones );
+
+        details::ParallelFor( nVertices, Grain, [&]( std::size_t iBegin, std::size_t iEnd )
         {
-            // Lookup bone that vert is attached to
-            std::int32_t iBone = Vertex.m_Weight[j].m_iBone ;
-            assert(iBone >= 0) ;
-            assert(iBone < m_Bone.size() ) ;
+            details::simd_bbox* const pRow = BoneBoxes.data() + (iBegin / Grain) * nBones;
+            for( std::size_t i = iBegin; i < iEnd; ++i )
+            {
+                std::int32_t MaxBone = 0;
+                for( std::int32_t j = 0, n = Vertices.nWeights(i); j < n; ++j )
+                {
+                    // Lookup bone that vert is attached to
+                    const std::int32_t iBone = Vertices.Weight(i,j).m_iBone;
+                    assert( iBone >= 0 );
+                    assert( iBone < nBones );
 
-            // Add to bone bbox
-            m_Bone[iBone].m_BBox += Vertex.m_Position ;
-        }
-    }
+                    pRow[ iBone ].Add( Vertices.Position(i) );
+                    MaxBone = std::max( MaxBone, iBone );
+                }
+                VertexMaxBone[i] = MaxBone;
+            }
+        });
 
-    // If a bone has no geometry attached, then set bounds to the bone position
-    for (i = 0 ; i < m_Bone.size() ; i++)
-    {
-        // Lookup bone
-        bone& Bone = m_Bone[i] ;
+        if( nChunks > 1 ) details::ParallelFor( nBones, 64, [&]( std::size_t iBegin, std::size_t iEnd )
+        {
+            for( std::size_t iBone = iBegin; iBone < iEnd; ++iBone )
+                for( std::size_t iChunk = 1; iChunk < nChunks; ++iChunk )
+                    BoneBoxes[ iBone ].Add( BoneBoxes[ iChunk * nBones + iBone ] );
+        });
+
+        //=====================================================================
+        // Compute # of bones used by each sub-mesh
+        // Bones are arranged in LOD order, so we can just use the (MaxBoneUsed+1)
+        //=====================================================================
+        details::VisitFacets( *this, [&]( auto Facets )
+        {
+            const std::size_t nFacets      = Facets.size();
+            const std::size_t FacetGrain   = ChunkGrain( nFacets );
+            const std::size_t nFacetChunks = (nFacets + FacetGrain - 1) / FacetGrain;
 
-        // If bbox is empty, just use the bone position
-        if (Bone.m_BBox.m_Min.m_X > Bone.m_BBox.m_Max.m_X )
-            Bone.m_BBox += Bone.m_Position ;
+            MeshMaxBone.assign( std::max<std::size_t>( 1, nFacetChunks ) * nMeshes, 0 );
 
-        // Inflate slightly do get rid of any degenerate (flat) sides
-        Bone.m_BBox.Inflate( xmath::fvec3(0.1f, 0.1f, 0.1f) ) ;
-    }
+            details::ParallelFor( nFacets, FacetGrain, [&]( std::size_t iBegin, std::size_t iEnd )
+            {
+                std::int32_t* const pRow = MeshMaxBone.data() + (iBegin / FacetGrain) * nMeshes;
+                for( std::size_t i = iBegin; i < iEnd; ++i )
+                {
+                    const std::int32_t iMesh = Facets.iMesh(i);
+                    assert( iMesh >= 0 );
+                    assert( iMesh < nMeshes );
 
-    //=====================================================================
-    // Compute # of bones used by each sub-mesh
-    // Bones are arranged in LOD order, so we can just use the (MaxBoneUsed+1)
-    //=====================================================================
-    
-    // Clear values
-    for (i = 0 ; i < m_Mesh.size(); i++)
-        m_Mesh[i].m_nBones = 0 ;
+                    std::int32_t& MaxBone = pRow[ iMesh ];
+                    for( std::int32_t j = 0, n = Facets.nVertices(i); j < n; ++j )
+                        MaxBone = std::max( MaxBone, VertexMaxBone[ Facets.iVertex(i, j) ] );
+                }
+            });
+
+            for( std::size_t iChunk = 1; iChunk < nFacetChunks; ++iChunk )
+                for( std::size_t iMesh = 0; iMesh < nMeshes; ++iMesh )
+                    MeshMaxBone[ iMesh ] = std::max( MeshMaxBone[ iMesh ], MeshMaxBone[ iChunk * nMeshes + iMesh ] );
+        });
+    });
 
-    // Loop through all faces
-    for (i = 0 ; i < m_Facet.size() ; i++)
+    for( std::size_t i = 0; i < nBones; ++i )
     {
-        // Lookup face and the mesh it's part of
-        facet&      Face = m_Facet[i] ;
-        mesh&   Mesh = m_Mesh[Face.m_iMesh] ;
+        // Lookup bone
+        bone& Bone = m_Bone[i];
+        BoneBoxes[i].Write( Bone.m_BBox );
 
-        // Loop through all verts in each face
-        for (j = 0 ; j < Face.m_nVertices ; j++)
-        {
-            // Lookup vert
-            vertex& Vert = m_Vertex[Face.m_iVertex[j]] ;
+        // If bbox is empty, just use the bone position
+        if( Bone.m_BBox.m_Min.m_X > Bone.m_BBox.m_Max.m_X )
+            Bone.m_BBox += Bone.m_Position;
 
-            // Loop through all weights in vert
-            for (k = 0 ; k < Vert.m_nWeights ; k++)
-            {
-                // Update mesh bone count
-                Mesh.m_nBones = std::max( Mesh.m_nBones, Vert.m_Weight[k].m_iBone) ;
-            }
-        }
+        // Inflate slightly do get rid of any degenerate (flat) sides
+        Bone.m_BBox.Inflate( xmath::fvec3(0.1f, 0.1f, 0.1f) );
     }
 
     // We want the actual number of bones used so fix up
-    for (i = 0 ; i < m_Mesh.size() ; i++)
-        m_Mesh[i].m_nBones++ ;
+    for( std::size_t i = 0; i < nMeshes; ++i )
+        m_Mesh[i].m_nBones = MeshMaxBone[i] + 1;
 }
 
 //--------------------------------------------------------------------------
@@ -1922,47 +4786,53 @@ bool geom::IsolateMesh( std::int32_t iMesh, geom& NewMesh,
     //  These are done before the material construction, but the facet iMaterial
     //  member will be touched up in the next step.
     //
-    std::int32_t     i;
-    std::int32_t     nFacets = 0;
-
-    for (i=0;i<m_Facet.size();i++)
+    details::VisitVertices( *this, [&]( auto Vertices )
     {
-        if (m_Facet[i].m_iMesh == iMesh)
-            nFacets++;
-    }
+    details::VisitFacets( *this, [&]( auto Facets )
+    {
+        std::int32_t     i;
+        std::int32_t     nFacets = 0;
+
+        for (i=0;i<Facets.size();i++)
+        {
+            if (Facets.iMesh(i) == iMesh)
+                nFacets++;
+        }
 
-    NewMesh.m_Vertex.resize( nFacets * 3 );
-    NewMesh.m_Facet.resize( nFacets );
+        NewMesh.m_Vertex.resize( nFacets * 3 );
+        NewMesh.m_Facet.resize( nFacets );
 
-    geom::vertex*    pVert     = &NewMesh.m_Vertex[0];
-    std::int32_t                 iVert     = 0;
-    geom::facet*     pFacet    = &NewMesh.m_Facet[0];
+        geom::vertex*    pVert     = NewMesh.m_Vertex.data();
+        std::int32_t                 iVert     = 0;
+        geom::facet*     pFacet    = NewMesh.m_Facet.data();
     
-    for (i=0;i<m_Facet.size();i++)
-    {
-        if (m_Facet[i].m_iMesh == iMesh)
+        for (i=0;i<Facets.size();i++)
         {
-            *pFacet = m_Facet[i];
+            if (Facets.iMesh(i) == iMesh)
+            {
+                Facets.getFacet( i, *pFacet );
 
-            pFacet->m_iVertex[0] = iVert+0;
-            pFacet->m_iVertex[1] = iVert+1;
-            pFacet->m_iVertex[2] = iVert+2;
-            iVert+=3;       
+                pFacet->m_iVertex[0] = iVert+0;
+                pFacet->m_iVertex[1] = iVert+1;
+                pFacet->m_iVertex[2] = iVert+2;
+                iVert+=3;       
 
-            pFacet->m_iMesh = 0;
+                pFacet->m_iMesh = 0;
         
-            *pVert = m_Vertex[ m_Facet[i].m_iVertex[0] ];
-            pVert++;
+                Vertices.getVertex( Facets.iVertex(i, 0), *pVert );
+                pVert++;
 
-            *pVert = m_Vertex[ m_Facet[i].m_iVertex[1] ];
-            pVert++;
+                Vertices.getVertex( Facets.iVertex(i, 1), *pVert );
+                pVert++;
 
-            *pVert = m_Vertex[ m_Facet[i].m_iVertex[2] ];
-            pVert++;
+                Vertices.getVertex( Facets.iVertex(i, 2), *pVert );
+                pVert++;
 
-            pFacet++;
+                pFacet++;
+            }
         }
-    }
+    });
+    });
 
     //
     // Clear the mesh
@@ -1978,196 +4848,143 @@ bool geom::IsolateMesh( std::int32_t iMesh, geom& NewMesh,
 
 bool geom::IsolateMesh( std::string_view MeshName, geom& NewMesh )
 {
-    std::int32_t  i;
-
     if (MeshName.empty())
         return false;
 
-    for( i=0;i<m_Mesh.size();i++ )
-    {
-        if( m_Mesh[i].m_Name == MeshName )
-        {
-            return IsolateMesh( i, NewMesh );
-        }
-    }
+    const int iMesh = findMeshByName( MeshName );
+    if( iMesh == -1 )
+        return false;
 
-    return false;
+    return IsolateMesh( iMesh, NewMesh );
 }
 
 //--------------------------------------------------------------------------
 
 bool geom::isBoneUsed( std::int32_t iBone )
 {
-    std::int32_t i,j;
-
-    for( i=0; i<m_Vertex.size(); i++ )
+    return details::VisitVertices( *this, [&]( auto Vertices )
     {
-        for( j=0; j<m_Vertex[i].m_nWeights; j++ )
-        if( m_Vertex[i].m_Weight[j].m_iBone == iBone )
-            return true;
-    }
+        for( std::size_t i = 0; i < Vertices.size(); ++i )
+        {
+            for( std::int32_t j = 0; j < Vertices.nWeights(i); ++j )
+                if( Vertices.Weight( i, j ).m_iBone == iBone )
+                    return true;
+        }
 
-    return false;
+        return false;
+    });
 }
 
 //--------------------------------------------------------------------------
 
-int geom::findMeshByName(std::string_view MeshName )
+int geom::findMeshByName(std::string_view MeshName ) const
 {
-    for ( auto& E : m_Mesh )
-    {
-        if ( E.m_Name == MeshName ) return static_cast<int>(&E - m_Mesh.data());
-    }
-    return -1;
+    return m_MeshNameIndex.find( m_Mesh, MeshName, &mesh::m_Name );
 }
 
 //--------------------------------------------------------------------------
 
-int geom::findMeshByPath(std::string_view MeshScenePath)
+int geom::findMeshByPath(std::string_view MeshScenePath) const
 {
-    for (auto& E : m_Mesh)
-    {
-        if (E.m_ScenePath == MeshScenePath) return static_cast<int>(&E - m_Mesh.data());
-    }
-    return -1;
+    return m_MeshPathIndex.find( m_Mesh, MeshScenePath, &mesh::m_ScenePath );
 }
 
 //--------------------------------------------------------------------------
 
-void geom::CollapseNormals( xmath::radian ThresholdAngle )
+void geom::InvalidateMeshIndex( void ) noexcept
 {
-    float     TargetAngle = xmath::Cos( ThresholdAngle );
-
-    struct hash
-    {
-        std::int32_t        m_iNext;
-    };
-
-    struct tempv
-    {
-        xmath::fvec3        m_NewNormal;
-        std::int32_t        m_Index;          // Inde to the original vertex
-        std::int32_t        m_iNext;          // next node in the has
-    };
-
-    if( m_Vertex.size() <= 0 )
-        throw(std::runtime_error( "geom has no vertices" ));
+    m_MeshNameIndex.Invalidate();
+    m_MeshPathIndex.Invalidate();
+}
 
-    std::int32_t    i;
-    std::int32_t    HashSize  = static_cast<int>(xmath::Max( 20u, m_Vertex.size()*10 ));
-    float           MaxX, MinX, Shift;
+//--------------------------------------------------------------------------
 
-    // Allocate memory
-    std::vector<hash>       Hash;
-    std::vector<tempv>      TempV;
-    
-    Hash.resize( HashSize );
-    TempV.resize( m_Vertex.size() );
-    
-    // Initialize the hash with terminators
-    for( i=0; i<HashSize; i++) 
-    {
-        Hash[i].m_iNext = -1;
-    }
+void geom::CollapseNormals( xmath::radian ThresholdAngle, bool bAllNormalSets )
+{
+    const float     TargetAngle     = xmath::Cos( ThresholdAngle );
+    constexpr float same_position_v = 0.001f;
 
-    // Fill the nodes for each of the dimensions
-    MaxX = m_Vertex[0].m_Position.m_X;
-    MinX = MaxX;
-    for( i=0; i<m_Vertex.size(); i++)
-    {
-        TempV[i].m_Index         =  i;
-        TempV[i].m_iNext         = -1;
-        TempV[i].m_NewNormal.setup(0,0,0);
-       
-        MaxX = std::max( MaxX, m_Vertex[i].m_Position.m_X );
-        MinX = std::min( MinX, m_Vertex[i].m_Position.m_X );
-    }
+    // The streams only have the normal channel if some vertex had normals, make sure it is there
+    if( isStreamLayout() ) m_Streams.AllocateChannels( 0, 0, 1, 0 );
 
-    // Hash all the vertices into the hash table
-    Shift = HashSize/(MaxX-MinX+1);
-    for( i=0; i<m_Vertex.size(); i++)
+    details::VisitVertices( *this, [&]( auto Vertices )
     {
-        std::int32_t OffSet = (std::int32_t)(( m_Vertex[i].m_Position.m_X - MinX ) * Shift);
-
-        assert(OffSet >= 0 );
-        assert(OffSet < HashSize );
+        if( Vertices.size() <= 0 )
+            throw(std::runtime_error( "geom has no vertices" ));
 
-        TempV[i].m_iNext  = Hash[ OffSet ].m_iNext;
-        Hash[ OffSet ].m_iNext = i;
-    }
+        const std::int32_t nVertices = static_cast<std::int32_t>( Vertices.size() );
 
-    // Loop through all hash entries, and begin the collapse process
-    for( i=0; i<HashSize; i++ )
-    {
-        for( std::int32_t k = Hash[i].m_iNext; k != -1; k = TempV[k].m_iNext )
+        // The first set is always done (for every vertex), the rest only for the vertices that have it
+        std::int32_t nSets = 1;
+        if( bAllNormalSets )
         {
-            std::int32_t         j;
-            xmath::fvec3    SrcN = m_Vertex[ TempV[k].m_Index ].m_BTN[0].m_Normal;
-            xmath::fvec3    SrcP = m_Vertex[ TempV[k].m_Index ].m_Position;
-            xmath::fvec3    ResultN = SrcN;
-            
-            for( j = Hash[i].m_iNext; j != -1; j = TempV[j].m_iNext )
-            {                
-                if (j==k)
-                    continue;
-                
-                xmath::fvec3 D = m_Vertex[ TempV[j].m_Index ].m_Position - SrcP;
-
-                //  If the verts don't share the same position, continue
-                if( D.Length() > 0.001f )
-                    continue;
+            for( std::int32_t i = 0; i < nVertices; i++ )
+                nSets = std::max( nSets, Vertices.nNormals(i) );
+        }
 
-                //
-                //  Check the normals to see if the 2nd vert's norm is within the
-                //  allowable threshold
-                //
-                xmath::fvec3 N = m_Vertex[ TempV[j].m_Index ].m_BTN[0].m_Normal;
+        // Vertices that share a position always end up in neighboring cells
+        const details::position_grid    Grid( Vertices, same_position_v );
+        std::vector<xmath::fvec3>       NewNormal( nVertices );
 
-                float      T = SrcN.Dot( N );
-                if ( T >= TargetAngle )
-                {
-                    // Merge in this normal
-                    ResultN += N;
-                }
-            }
+        for( std::int32_t iSet = 0; iSet < nSets; iSet++ )
+        {
+            auto hasSet = [&]( std::int32_t iVertex )
+            {
+                return iSet == 0 || Vertices.nNormals(iVertex) > iSet;
+            };
 
-            // Search in the hash on the right
-            if( (i+1)< HashSize )
+            // Every vertex only writes its own new normal so the cells can be done in any order
+            details::ParallelFor( Grid.size(), 256, [&]( std::size_t iBegin, std::size_t iEnd )
             {
-                for( j = Hash[i+1].m_iNext; j != -1; j = TempV[j].m_iNext )
-                {                
-                    xmath::fvec3 D = m_Vertex[ TempV[j].m_Index ].m_Position - SrcP;
+                for( std::int32_t h = static_cast<std::int32_t>(iBegin); h < static_cast<std::int32_t>(iEnd); h++ )
+                {
+                    for( std::int32_t ik = Grid.m_CellStart[h]; ik < Grid.m_CellStart[h + 1]; ik++ )
+                    {
+                        const std::int32_t k = Grid.m_CellVertex[ik];
+                        if( hasSet(k) == false ) continue;
 
-                    //  If the verts don't share the same position, continue
-                    if (D.Length() > 0.001f)
-                        continue;
+                        const xmath::fvec3  SrcN    = Vertices.BTN( k, iSet ).m_Normal;
+                        const xmath::fvec3  SrcP    = Vertices.Position( k );
+                        xmath::fvec3        ResultN = SrcN;
 
-                    //
-                    //  Check the normals to see if the 2nd vert's norm is within the
-                    //  allowable threshold
-                    //
-                    xmath::fvec3 N = m_Vertex[ TempV[j].m_Index ].m_BTN[0].m_Normal;
+                        Grid.ForEachNeighbor( h, [&]( std::int32_t iCell )
+                        {
+                            for( std::int32_t ij = Grid.m_CellStart[iCell]; ij < Grid.m_CellStart[iCell + 1]; ij++ )
+                            {
+                                const std::int32_t j = Grid.m_CellVertex[ij];
+                                if( j == k || hasSet(j) == false )
+                                    continue;
+
+                                //  If the verts don't share the same position, continue
+                                if( ( Vertices.Position( j ) - SrcP ).Length() > same_position_v )
+                                    continue;
+
+                                //
+                                //  Check the normals to see if the 2nd vert's norm is within the
+                                //  allowable threshold
+                                //
+                                const xmath::fvec3 N = Vertices.BTN( j, iSet ).m_Normal;
+                                if( SrcN.Dot( N ) >= TargetAngle )
+                                {
+                                    // Merge in this normal
+                                    ResultN += N;
+                                }
+                            }
+                        });
 
-                    float     T = SrcN.Dot( N );
-                    if ( T >= TargetAngle )
-                    {
-                        // Merge in this normal
-                        ResultN += N;
+                        // Renormalize the resultant normal
+                        ResultN.Normalize();
+                        NewNormal[k] = ResultN;
                     }
                 }
-            }
-            
-            // Renormalize the resultant normal
-            ResultN.Normalize();
+            });
 
-            TempV[k].m_NewNormal = ResultN;
+            for( std::int32_t i = 0; i < nVertices; i++ )
+            {
+                if( hasSet(i) ) Vertices.BTN( i, iSet ).m_Normal = NewNormal[i];
+            }
         }
-    }
-
-    for (i=0;i<m_Vertex.size();i++)
-    {
-        m_Vertex[ TempV[i].m_Index ].m_BTN[0].m_Normal = TempV[i].m_NewNormal;
-    }
+    });
 }
 
 //--------------------------------------------------------------------------
@@ -2223,24 +5040,91 @@ void geom::DeleteBone( std::int32_t iBone )
 
     // free current allocations
     m_Bone = std::move(NewBone);
+    m_BoneIndex.Invalidate();
 }
 
 //--------------------------------------------------------------------------
 
 std::int32_t geom::getBoneIDFromName( std::string_view BoneName ) const
 {
-    std::int32_t i;
-    for( i=0; i<m_Bone.size(); i++ )
-    if( xstrtool::CompareI( BoneName, m_Bone[i].m_Name) == 0 )
-        return i;
-    return -1;
+    return m_BoneIndex.find( m_Bone, BoneName );
+}
+
+//--------------------------------------------------------------------------
+
+void geom::InvalidateBoneIndex( void ) noexcept
+{
+    m_BoneIndex.Invalidate();
+}
+
+//--------------------------------------------------------------------------
+
+namespace details
+{
+    //--------------------------------------------------------------------------
+    // ApplyNewSkeleton helpers. The remap gives for every bone of the geom the bone of the new
+    // skeleton with the same name, or the one of its closest ancestor that has a match. It is
+    // resolved once per bone so the vertices only do a table lookup.
+    //--------------------------------------------------------------------------
+    template< typename T_FIND >
+    std::vector<std::int32_t> ComputeBoneRemap( const std::vector<geom::bone>& Bones, T_FIND&& FindInSkeleton )
+    {
+        const std::int32_t          nBones = static_cast<std::int32_t>( Bones.size() );
+        std::vector<std::int32_t>   Remap( nBones );
+
+        for( std::int32_t iBone = 0; iBone < nBones; ++iBone )
+        {
+            std::int32_t iNew = -1;
+
+            // Bounded by the bone count in case the parents have a cycle
+            for( std::int32_t iCur = iBone, nSteps = 0; iNew == -1 && iCur != -1 && nSteps < nBones; ++nSteps )
+            {
+                iNew = FindInSkeleton( Bones[iCur].m_Name );
+                iCur = Bones[iCur].m_iParent;
+            }
+
+            if( iNew == -1 )
+            {
+                iNew = 0;
+                printf( "WARNING: Unable to remap Bone %s to new bone\n", Bones[iBone].m_Name.c_str() );
+            }
+
+            Remap[iBone] = iNew;
+        }
+
+        return Remap;
+    }
+
+    //--------------------------------------------------------------------------
+
+    inline void RemapWeights( geom& Geom, std::span<const std::int32_t> Remap )
+    {
+        VisitVertices( Geom, [&]( auto Vertices )
+        {
+            ParallelFor( Vertices.size(), 4096, [&]( std::size_t iBegin, std::size_t iEnd )
+            {
+                for( std::size_t i = iBegin; i < iEnd; ++i )
+                    for( std::int32_t j = 0, n = Vertices.nWeights(i); j < n; ++j )
+                    {
+                        auto& Weight = Vertices.Weight(i, j);
+                        assert( Weight.m_iBone >= 0 && Weight.m_iBone < static_cast<std::int32_t>( Remap.size() ) );
+                        Weight.m_iBone = Remap[ Weight.m_iBone ];
+                    }
+            });
+        });
+    }
 }
 
 //--------------------------------------------------------------------------
 
 void geom::ApplyNewSkeleton( const anim& Skel )
 {
-    std::int32_t i,j;
+    if( Skel.m_Bone.empty() )
+        throw(std::runtime_error( "The new skeleton has no bones" ));
+
+    m_Skin.clear();
+
+    std::int32_t i;
 
     // Transform all verts into local space of current skeleton
     if(/* DISABLES CODE */ (0))
@@ -2262,48 +5146,12 @@ void geom::ApplyNewSkeleton( const anim& Skel )
     }
 
     // Remap bone indices
-    for(i = 0; i < m_Vertex.size(); i++)
+    const std::vector<std::int32_t> Remap = details::ComputeBoneRemap( m_Bone, [&]( std::string_view Name )
     {
-        geom::vertex* pVertex = &m_Vertex[i];
-        for(std::int32_t iWeight = 0; iWeight < pVertex->m_nWeights; iWeight++)
-        {
-            geom::weight* pWeight = &pVertex->m_Weight[iWeight];
-
-            std::int32_t oldBoneId = pWeight->m_iBone;
-            std::int32_t newBoneId = -1;
-            std::int32_t curBoneId = oldBoneId;
-            while( (newBoneId==-1) && (curBoneId!=-1) )
-            {
-                const auto& curBoneName = m_Bone[curBoneId].m_Name;
-
-                // Look for matching bone in Skel
-                for( j=0; j<Skel.m_Bone.size(); j++ )
-                    if( xstrtool::CompareI( curBoneName, Skel.m_Bone[j].m_Name ) == 0 )
-                        break;
-
-                if( j != Skel.m_Bone.size() )
-                {
-                    newBoneId = j;
-                    break;
-                }
-
-                // Move up hierarchy to parent
-                curBoneId = m_Bone[curBoneId].m_iParent;
-            }
-
-            if ( newBoneId == -1 )
-            {
-                newBoneId = 0;
-                printf( "WARNING: Unable to remap Bone Vertex[%d] to new bone", i );
-            }
+        return Skel.GetBoneIDFromName( Name );
+    });
 
-            //assert( m_pBone[pWeight->iBone].Position.Difference( Skel.GetBone(newBoneId).BindTranslation ) < 0.0001f );
-            //assert( m_pBone[pWeight->iBone].Rotation.Difference( Skel.GetBone(newBoneId).BindRotation ) < 0.0001f );
-            //x_DebugMsg("For old bone of %d, found new bone %d\n", pWeight->iBone, newBoneId);
-            pWeight->m_iBone = newBoneId;
-            //x_DebugMsg("%s -> %s\n",m_pBone[oldBoneId].Name,Skel.m_pBone[newBoneId].Name);
-        }
-    }
+    details::RemapWeights( *this, Remap );
 
     //
     // Copy new bone information in
@@ -2320,6 +5168,7 @@ void geom::ApplyNewSkeleton( const anim& Skel )
         m_Bone[count].m_Rotation    =   Skel.m_Bone[count].m_BindRotation;
         m_Bone[count].m_Scale       =   Skel.m_Bone[count].m_BindScale;
     }
+    m_BoneIndex.Invalidate();
 
     // Transform all verts into model space of new skeleton
     if ( /* DISABLES CODE */ (0) )
@@ -2343,71 +5192,55 @@ void geom::ApplyNewSkeleton( const anim& Skel )
 
 void geom::ApplyNewSkeleton( const geom& Skel )
 {
-    std::int32_t i;
+    if( Skel.m_Bone.empty() )
+        throw(std::runtime_error( "The new skeleton has no bones" ));
 
-    // Transform all verts into local space of current skeleton
-    for(i = 0; i < m_Vertex.size(); i++)
+    m_Skin.clear();
+
+    const std::vector<std::int32_t> Remap = details::ComputeBoneRemap( m_Bone, [&]( std::string_view Name )
     {
-        std::int32_t         iBone   = m_Vertex[i].m_Weight[0].m_iBone;
-        xmath::fvec3    P       = m_Vertex[i].m_Position;
-        xmath::fmat4    BM;
-        
+        return Skel.getBoneIDFromName( Name );
+    });
+
+    // The vertices go from model space to the local space of their first bone and back to model space
+    // with the matching bone of the new skeleton. Both steps are folded into one matrix per old bone.
+    auto BindMatrix = []( const bone& Bone )
+    {
+        xmath::fmat4 BM;
         BM.setupIdentity();
-        BM.Scale    ( m_Bone[iBone].m_Scale );
-        BM.Rotate   ( m_Bone[iBone].m_Rotation );
-        BM.Translate( m_Bone[iBone].m_Position );
-        BM = BM.InverseSRT();
-        m_Vertex[i].m_Position = BM * P;
-    }
+        BM.Scale    ( Bone.m_Scale );
+        BM.Rotate   ( Bone.m_Rotation );
+        BM.Translate( Bone.m_Position );
+        return BM;
+    };
 
-    for( std::int32_t iVertex = 0; iVertex < m_Vertex.size(); iVertex++ )
+    std::vector<xmath::fmat4> Retarget( m_Bone.size() );
+    details::ParallelFor( m_Bone.size(), 64, [&]( std::size_t iBegin, std::size_t iEnd )
     {
-        vertex* pVertex = &m_Vertex[iVertex];
-        for(std::int32_t iWeight = 0; iWeight < pVertex->m_nWeights; iWeight++)
+        for( std::size_t iBone = iBegin; iBone < iEnd; ++iBone )
+            Retarget[iBone] = BindMatrix( Skel.m_Bone[ Remap[iBone] ] ) * BindMatrix( m_Bone[iBone] ).InverseSRT();
+    });
+
+    details::VisitVertices( *this, [&]( auto Vertices )
+    {
+        details::ParallelFor( Vertices.size(), 4096, [&]( std::size_t iBegin, std::size_t iEnd )
         {
-            weight*     pWeight     = &pVertex->m_Weight[iWeight];
-            std::int32_t         oldBoneId   = pWeight->m_iBone;
-            const auto&          oldBoneName = m_Bone[oldBoneId].m_Name;
-            std::int32_t         newBoneId   = -1;
-            std::int32_t         curBoneId   = oldBoneId;
-            std::string_view     curBoneName = oldBoneName;
-            
-            while(newBoneId == -1)
+            for( std::size_t i = iBegin; i < iEnd; ++i )
             {
-                //x_DebugMsg("Looking in new skeleton for name '%s'\n", curBoneName);
-                newBoneId = Skel.getBoneIDFromName(curBoneName);
-                curBoneId = m_Bone[curBoneId].m_iParent;
-                assert((newBoneId !=-1) || (curBoneId != -1));
-                curBoneName = m_Bone[curBoneId].m_Name;
+                const std::int32_t iBone = Vertices.nWeights(i) ? Vertices.Weight(i, 0).m_iBone : 0;
+                Vertices.Position(i) = Retarget[iBone] * Vertices.Position(i);
             }
-            //x_DebugMsg("For old bone of %d, found new bone %d\n", pWeight->iBone, newBoneId);
-            pWeight->m_iBone = newBoneId;
-        }
-    }
+        });
+    });
 
-    // Copy new bone information in
-    m_Bone.resize( Skel.m_Bone.size() );
+    details::RemapWeights( *this, Remap );
 
-    for(std::int32_t count = 0; count < m_Bone.size(); count++)
-    {
-        const bone& Bone = Skel.m_Bone[count];
-        m_Bone[count] = Bone;
-    }
+    // Copy new bone information in
+    m_Bone = Skel.m_Bone;
+    m_BoneIndex.Invalidate();
 
-    // Transform all verts into local space of current skeleton
-    for(i = 0; i < m_Vertex.size(); i++)
-    {
-        std::int32_t         iBone   = m_Vertex[i].m_Weight[0].m_iBone;
-        xmath::fvec3    P       = m_Vertex[i].m_Position;
-        xmath::fmat4    BM;
-        
-        BM.setupIdentity();
-        BM.Scale    ( m_Bone[iBone].m_Scale );
-        BM.Rotate   ( m_Bone[iBone].m_Rotation );
-        BM.Translate( m_Bone[iBone].m_Position );
-        
-        m_Vertex[i].m_Position = BM * P;
-    }
+    // All the positions moved
+    m_bFacetPlanesDirty = true;
 }
 
 } // namespace xraw3d
\ No newline at end of file
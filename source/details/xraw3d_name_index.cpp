@@ -0,0 +1,90 @@
+namespace xraw3d::details {
+
+//--------------------------------------------------------------------------
+
+std::size_t folded_hash::operator()( std::string_view Name ) const noexcept
+{
+    // FNV-1a over the lower case characters
+    std::uint64_t Hash = 14695981039346656037ull;
+    for( const unsigned char C : Name )
+    {
+        Hash ^= static_cast<unsigned char>( ( C >= 'A' && C <= 'Z' ) ? C + ('a' - 'A') : C );
+        Hash *= 1099511628211ull;
+    }
+    return static_cast<std::size_t>( Hash );
+}
+
+//--------------------------------------------------------------------------
+
+bool folded_equal::operator()( std::string_view A, std::string_view B ) const noexcept
+{
+    if( A.size() != B.size() ) return false;
+
+    for( std::size_t i = 0; i < A.size(); ++i )
+    {
+        const unsigned char a = A[i];
+        const unsigned char b = B[i];
+        if( a == b ) continue;
+        if( ( a | 0x20 ) != ( b | 0x20 ) || ( a | 0x20 ) < 'a' || ( a | 0x20 ) > 'z' ) return false;
+    }
+    return true;
+}
+
+//--------------------------------------------------------------------------
+
+template< bool T_CASE_SENSITIVE_V >
+void basic_name_index<T_CASE_SENSITIVE_V>::Invalidate( void ) noexcept
+{
+    std::scoped_lock Lock( m_Lock );
+    m_bValid = false;
+}
+
+//--------------------------------------------------------------------------
+
+template< bool T_CASE_SENSITIVE_V >
+template< typename T_ITEM >
+void basic_name_index<T_CASE_SENSITIVE_V>::Build( const std::vector<T_ITEM>& Items, std::string T_ITEM::* pKey ) const
+{
+    m_Map.clear();
+    m_Map.reserve( Items.size() );
+
+    // try_emplace keeps the first item of a name, the same one the linear scan finds
+    for( std::size_t i = 0; i < Items.size(); ++i )
+        m_Map.try_emplace( Items[i].*pKey, static_cast<std::int32_t>(i) );
+
+    m_pData  = Items.data();
+    m_Size   = Items.size();
+    m_bValid = true;
+}
+
+//--------------------------------------------------------------------------
+
+template< bool T_CASE_SENSITIVE_V >
+template< typename T_ITEM >
+std::int32_t basic_name_index<T_CASE_SENSITIVE_V>::find( const std::vector<T_ITEM>& Items, std::string_view Name, std::string T_ITEM::* pKey ) const
+{
+    std::scoped_lock Lock( m_Lock );
+
+    const bool bRebuild = m_bValid == false || m_pData != Items.data() || m_Size != Items.size();
+    if( bRebuild ) Build( Items, pKey );
+
+    const auto It = m_Map.find( Name );
+    if( It != m_Map.end() && equal{}( Name, Items[ It->second ].*pKey ) ) return It->second;
+    if( It == m_Map.end() && bRebuild ) return -1;
+
+    // The vector is public so items could have been renamed since the map was built, a stale hit or a
+    // miss on an old map falls back to the linear scan and the map is rebuilt when it was out of date
+    for( std::size_t i = 0; i < Items.size(); ++i )
+    {
+        if( equal{}( Name, Items[i].*pKey ) )
+        {
+            Build( Items, pKey );
+            return static_cast<std::int32_t>(i);
+        }
+    }
+
+    if( It != m_Map.end() ) Build( Items, pKey );
+    return -1;
+}
+
+} // namespace xraw3d::details
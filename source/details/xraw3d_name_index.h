@@ -0,0 +1,96 @@
+#ifndef XRAW3D_NAME_INDEX_H
+#define XRAW3D_NAME_INDEX_H
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace xraw3d::details
+{
+    // ASCII case folding, hashes and compares a std::string key against a std::string_view without copies
+    struct folded_hash
+    {
+        using is_transparent = void;
+        std::size_t             operator()                  ( std::string_view              Name 
+                                                            ) const noexcept;
+    };
+
+    struct folded_equal
+    {
+        using is_transparent = void;
+        bool                    operator()                  ( std::string_view              A
+                                                            , std::string_view              B
+                                                            ) const noexcept;
+    };
+
+    // Same as above but case sensitive
+    struct exact_hash
+    {
+        using is_transparent = void;
+        std::size_t             operator()                  ( std::string_view              Name 
+                                                            ) const noexcept { return std::hash<std::string_view>{}( Name ); }
+    };
+
+    struct exact_equal
+    {
+        using is_transparent = void;
+        bool                    operator()                  ( std::string_view              A
+                                                            , std::string_view              B
+                                                            ) const noexcept { return A == B; }
+    };
+
+    // Name to index lookup for a vector of named items (the bones of geom and anim, the meshes of geom),
+    // giving the same answer as a linear scan: the first item with a matching key or -1. The key is m_Name
+    // unless another std::string member is given, an index object should always be used with the same key.
+    // It is built on first use and rebuilt when the vector was resized or reallocated, or when a lookup
+    // finds it out of date. A hit that no longer matches its item and a miss on a map that was not just
+    // built both fall back to a linear scan, so items renamed in place are still found. Code that renames
+    // items in place should still call Invalidate to keep misses cheap. Copies start empty.
+    template< bool T_CASE_SENSITIVE_V >
+    class basic_name_index
+    {
+    public:
+
+                                basic_name_index            ( void ) = default;
+                                basic_name_index            ( const basic_name_index& 
+                                                            ) noexcept {}
+        basic_name_index&       operator =                  ( const basic_name_index& 
+                                                            ) noexcept { Invalidate(); return *this; }
+
+        template< typename T_ITEM >
+        std::int32_t            find                        ( const std::vector<T_ITEM>&    Items
+                                                            , std::string_view              Name
+                                                            , std::string T_ITEM::*         pKey = &T_ITEM::m_Name
+                                                            ) const;
+        void                    Invalidate                  ( void 
+                                                            ) noexcept;
+
+    protected:
+
+        using hash  = std::conditional_t< T_CASE_SENSITIVE_V, exact_hash,  folded_hash  >;
+        using equal = std::conditional_t< T_CASE_SENSITIVE_V, exact_equal, folded_equal >;
+        using map   = std::unordered_map<std::string, std::int32_t, hash, equal>;
+
+        template< typename T_ITEM >
+        void                    Build                       ( const std::vector<T_ITEM>&    Items 
+                                                            , std::string T_ITEM::*         pKey
+                                                            ) const;
+
+    protected:
+
+        mutable std::mutex                                  m_Lock;
+        mutable map                                         m_Map;
+        mutable const void*                                 m_pData     = nullptr;  // Items.data() when m_Map was built
+        mutable std::size_t                                 m_Size      = 0;        // Items.size() when m_Map was built
+        mutable bool                                        m_bValid    = false;
+    };
+
+    using name_index        = basic_name_index<false>;      // Case insensitive, same as CompareI
+    using exact_name_index  = basic_name_index<true>;       // Case sensitive, same as operator ==
+}
+
+#endif
@@ -0,0 +1,178 @@
+#ifndef XRAW3D_PARALLEL_H
+#define XRAW3D_PARALLEL_H
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//--------------------------------------------------------------------------
+// Worker threads shared by every ParallelFor, created on first use and kept until the program exits
+// so the passes of CleanMesh and the loaders do not pay for starting threads each time. The thread
+// that posts a job always works on it too, so a job finishes even when every worker is busy and a
+// ParallelFor can be called from inside another one.
+//--------------------------------------------------------------------------
+namespace xraw3d::details
+{
+    class thread_pool
+    {
+    public:
+
+        static thread_pool&     get                         ( void
+                                                            ) { static thread_pool Pool; return Pool; }
+        std::size_t             size                        ( void                                  // Workers plus the calling thread
+                                                            ) const noexcept { return m_Threads.size() + 1; }
+
+        // Calls Worker() in the calling thread and in up to nHelpers workers, returns when all of them are done
+        template< typename T_WORKER >
+        void                    Run                         ( T_WORKER&                     Worker
+                                                            , std::size_t                   nHelpers
+                                                            );
+
+                               ~thread_pool                 ( void
+                                                            ) noexcept;
+
+    protected:
+
+        struct job
+        {
+            void                                            (*m_pRun)( void* );
+            void*                                           m_pWorker;
+            std::size_t                                     m_nMaxWorkers;
+            std::size_t                                     m_nWorkers      = 0;    // That joined, guarded by m_Lock
+            std::size_t                                     m_nRunning      = 0;    // Still inside m_pRun, guarded by m_Lock
+        };
+
+                                thread_pool                 ( void
+                                                            );
+        void                    WorkerLoop                  ( void
+                                                            ) noexcept;
+
+        std::mutex                                          m_Lock;
+        std::condition_variable                             m_Wake;                 // There is a job or we are quitting
+        std::condition_variable                             m_Done;                 // A worker left a job
+        std::deque<job*>                                    m_Jobs;                 // Jobs that still take workers
+        bool                                                m_bQuit = false;
+        std::vector<std::thread>                            m_Threads;
+    };
+
+    //--------------------------------------------------------------------------
+
+    inline thread_pool::thread_pool( void )
+    {
+        const std::size_t nThreads = std::max( 1u, std::thread::hardware_concurrency() ) - 1;
+        m_Threads.reserve( nThreads );
+        for( std::size_t i = 0; i < nThreads; ++i ) m_Threads.emplace_back( [this]{ WorkerLoop(); } );
+    }
+
+    //--------------------------------------------------------------------------
+
+    inline thread_pool::~thread_pool( void ) noexcept
+    {
+        {
+            std::scoped_lock Lock( m_Lock );
+            m_bQuit = true;
+        }
+        m_Wake.notify_all();
+        for( auto& Thread : m_Threads ) Thread.join();
+    }
+
+    //--------------------------------------------------------------------------
+
+    inline void thread_pool::WorkerLoop( void ) noexcept
+    {
+        std::unique_lock Lock( m_Lock );
+        for(;;)
+        {
+            m_Wake.wait( Lock, [&]{ return m_bQuit || m_Jobs.empty() == false; } );
+            if( m_bQuit ) return;
+
+            // The job stops taking workers once it has as many as it asked for
+            job& Job = *m_Jobs.front();
+            if( ++Job.m_nWorkers == Job.m_nMaxWorkers ) m_Jobs.pop_front();
+            ++Job.m_nRunning;
+
+            Lock.unlock();
+            Job.m_pRun( Job.m_pWorker );
+            Lock.lock();
+
+            // The job lives in the stack of the thread that posted it, it can not be touched after this
+            if( --Job.m_nRunning == 0 ) m_Done.notify_all();
+        }
+    }
+
+    //--------------------------------------------------------------------------
+
+    template< typename T_WORKER >
+    void thread_pool::Run( T_WORKER& Worker, std::size_t nHelpers )
+    {
+        job Job{ []( void* pWorker ) { (*static_cast<T_WORKER*>( pWorker ))(); }, &Worker, std::min( nHelpers, m_Threads.size() ) };
+
+        if( Job.m_nMaxWorkers )
+        {
+            {
+                std::scoped_lock Lock( m_Lock );
+                m_Jobs.push_back( &Job );
+            }
+            if( Job.m_nMaxWorkers == 1 ) m_Wake.notify_one();
+            else                         m_Wake.notify_all();
+        }
+
+        Worker();
+
+        if( Job.m_nMaxWorkers )
+        {
+            std::unique_lock Lock( m_Lock );
+            if( const auto It = std::find( m_Jobs.begin(), m_Jobs.end(), &Job ); It != m_Jobs.end() ) m_Jobs.erase( It );
+            m_Done.wait( Lock, [&]{ return Job.m_nRunning == 0; } );
+        }
+    }
+}
+
+//--------------------------------------------------------------------------
+// Runs Function( iBegin, iEnd ) over [0,Count) in chunks of Grain items using all the hardware threads
+// (the ones of thread_pool plus the caller). Chunks are handed out dynamically to balance the work, so
+// the order in which they run is undefined; callers that need deterministic results must write per
+// chunk (iBegin/Grain) and merge in order.
+// The first exception thrown by any chunk is re-thrown in the calling thread.
+//--------------------------------------------------------------------------
+namespace xraw3d::details
+{
+    template< typename T_FUNCTION >
+    void ParallelFor( std::size_t Count, std::size_t Grain, T_FUNCTION&& Function )
+    {
+        if( Count == 0 ) return;
+
+        const std::size_t nChunks  = ( Count + Grain - 1 ) / Grain;
+
+        std::atomic<std::size_t>    iNextChunk{ 0 };
+        std::exception_ptr          Exception;
+        std::atomic<bool>           bFailed{ false };
+
+        auto Worker = [&]
+        {
+            for( std::size_t iChunk; bFailed == false && (iChunk = iNextChunk++) < nChunks; )
+            {
+                try
+                {
+                    Function( iChunk * Grain, std::min( Count, (iChunk + 1) * Grain ) );
+                }
+                catch(...)
+                {
+                    if( bFailed.exchange(true) == false ) Exception = std::current_exception();
+                }
+            }
+        };
+
+        thread_pool::get().Run( Worker, nChunks - 1 );
+
+        if( Exception ) std::rethrow_exception( Exception );
+    }
+}
+
+#endif
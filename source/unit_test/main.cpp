@@ -1,7 +1,459 @@
 #include "source/xraw3d.h"
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//--------------------------------------------------------------------------
+// Chunk file tests. Every test throws on the first thing that does not match and main reports
+// which ones failed. The geom used is big enough that its larger chunks span several codec blocks.
+//--------------------------------------------------------------------------
+namespace xraw3d::unit_test
+{
+    constexpr int grid_size_v = 128;        // Vertices per side of the grid of every mesh
+
+    //--------------------------------------------------------------------------
+
+    inline void Check( bool bCondition, std::string_view What )
+    {
+        if( bCondition == false ) throw(std::runtime_error( std::string( What ) ));
+    }
+
+    //--------------------------------------------------------------------------
+
+    inline std::wstring getTempFile( std::wstring_view Name )
+    {
+        return ( std::filesystem::temp_directory_path() / Name ).wstring();
+    }
+
+    //--------------------------------------------------------------------------
+
+    inline xmath::fvec3 Normalize( float X, float Y, float Z )
+    {
+        const float L = std::sqrt( X * X + Y * Y + Z * Z );
+        return xmath::fvec3( X / L, Y / L, Z / L );
+    }
+
+    //--------------------------------------------------------------------------
+    // Three meshes, each a grid with its own UVs, colors, normals and two weights. The facets of the
+    // meshes are interleaved one row at a time so every mesh ends up in several runs of facets.
+    // "Head" uses quads and the others triangles, so the file needs the facet count chunk.
+    //--------------------------------------------------------------------------
+    inline geom MakeGeom( void )
+    {
+        geom Geom;
+
+        Geom.m_Bone.resize( 3 );
+        for( int i = 0; i < 3; ++i )
+        {
+            auto& Bone = Geom.m_Bone[i];
+            Bone.m_Name         = std::format( "Bone{}", i );
+            Bone.m_iParent      = i - 1;
+            Bone.m_nChildren    = i < 2 ? 1 : 0;
+            Bone.m_Scale        = xmath::fvec3( 1, 1, 1 );
+            Bone.m_Rotation.setupIdentity();
+            Bone.m_Position     = xmath::fvec3( 0, static_cast<float>(i), 0 );
+            Bone.m_BBox         = xmath::fbbox();
+        }
+
+        Geom.m_MaterialInstance.resize( 2 );
+        for( int i = 0; i < 2; ++i )
+        {
+            auto& Material = Geom.m_MaterialInstance[i];
+            Material.m_Name             = std::format( "Material{}", i );
+            Material.m_MaterialShader   = "Lit";
+            Material.m_Technique        = "Default";
+            Material.m_Params.push_back( { geom::material_instance::params_type::F1, "Roughness", std::format( "0.{}", i + 1 ) } );
+        }
+
+        const std::array<std::string_view, 3> Names{ "Body", "Head", "Legs" };
+        for( auto Name : Names )
+            Geom.m_Mesh.push_back( { std::format( "Root/{}", Name ), std::string( Name ), 0 } );
+
+        const std::int32_t nPerMesh = grid_size_v * grid_size_v;
+        Geom.m_Vertex.resize( Names.size() * nPerMesh );
+        for( std::size_t iMesh = 0; iMesh < Names.size(); ++iMesh )
+        {
+            for( int y = 0; y < grid_size_v; ++y )
+            for( int x = 0; x < grid_size_v; ++x )
+            {
+                auto& V = Geom.m_Vertex[ iMesh * nPerMesh + y * grid_size_v + x ];
+                V = geom::vertex{};
+
+                const float fx = static_cast<float>(x) / ( grid_size_v - 1 );
+                const float fy = static_cast<float>(y) / ( grid_size_v - 1 );
+
+                V.m_Position    = xmath::fvec3( fx * 10, static_cast<float>(iMesh) * 0.5f + std::sin( fx * 6 ) * std::cos( fy * 4 ), fy * 10 );
+
+                V.m_nUVs        = 1;
+                V.m_UV[0]       = xmath::fvec2( fx, fy );
+
+                V.m_nColors     = 1;
+                V.m_Color[0].m_R = static_cast<std::uint8_t>( x * 2 );
+                V.m_Color[0].m_G = static_cast<std::uint8_t>( y * 2 );
+                V.m_Color[0].m_B = static_cast<std::uint8_t>( iMesh * 80 );
+                V.m_Color[0].m_A = 255;
+
+                V.m_nNormals    = 1;
+                V.m_nTangents   = 1;
+                V.m_nBinormals  = 1;
+                V.m_BTN[0].m_Normal     = Normalize( -std::cos( fx * 6 ), 1, std::sin( fy * 4 ) );
+                V.m_BTN[0].m_Tangent    = Normalize( 1, std::cos( fx * 6 ), 0.25f );
+                V.m_BTN[0].m_Binormal   = Normalize( 0.1f, -std::sin( fy * 4 ), 1 );
+
+                V.m_nWeights    = 2;
+                V.m_Weight[0]   = { static_cast<std::int32_t>( iMesh ),             1 - fy * 0.5f };
+                V.m_Weight[1]   = { static_cast<std::int32_t>( ( iMesh + 1 ) % 3 ), fy * 0.5f     };
+            }
+        }
+
+        for( int y = 0; y < grid_size_v - 1; ++y )
+        {
+            for( std::size_t iMesh = 0; iMesh < Names.size(); ++iMesh )
+            {
+                const std::int32_t  iBase = static_cast<std::int32_t>( iMesh * nPerMesh );
+                const bool          bQuad = Names[iMesh] == "Head";
+
+                for( int x = 0; x < grid_size_v - 1; ++x )
+                {
+                    const std::int32_t i0 = iBase + y * grid_size_v + x;
+                    const std::int32_t i1 = i0 + 1;
+                    const std::int32_t i2 = i0 + grid_size_v + 1;
+                    const std::int32_t i3 = i0 + grid_size_v;
+
+                    geom::facet Facet{};
+                    Facet.m_iMesh               = static_cast<std::int32_t>( iMesh );
+                    Facet.m_iMaterialInstance   = ( x / 16 ) & 1;
+
+                    if( bQuad )
+                    {
+                        Facet.m_nVertices = 4;
+                        Facet.m_iVertex   = { i0, i1, i2, i3 };
+                        Geom.m_Facet.push_back( Facet );
+                    }
+                    else
+                    {
+                        Facet.m_nVertices = 3;
+                        Facet.m_iVertex   = { i0, i1, i2 };
+                        Geom.m_Facet.push_back( Facet );
+                        Facet.m_iVertex   = { i0, i2, i3 };
+                        Geom.m_Facet.push_back( Facet );
+                    }
+                }
+            }
+        }
+
+        return Geom;
+    }
+
+    //--------------------------------------------------------------------------
+    // BTNTolerance is only there for the octahedral normals of the LOSSY compression,
+    // everything else must come back bit exact
+    //--------------------------------------------------------------------------
+    inline void CheckVertex( const geom::vertex& A, const geom::vertex& B, float BTNTolerance )
+    {
+        auto Same = []( const xmath::fvec3& U, const xmath::fvec3& V, float Tolerance )
+        {
+            return std::abs( U.m_X - V.m_X ) <= Tolerance
+                && std::abs( U.m_Y - V.m_Y ) <= Tolerance
+                && std::abs( U.m_Z - V.m_Z ) <= Tolerance;
+        };
+
+        Check( Same( A.m_Position, B.m_Position, 0 ), "Vertex position mismatch" );
+        Check( A.m_iFrame == B.m_iFrame, "Vertex frame mismatch" );
+
+        Check( A.m_nUVs == B.m_nUVs, "Vertex UV count mismatch" );
+        for( int i = 0; i < A.m_nUVs; ++i )
+            Check( A.m_UV[i].m_X == B.m_UV[i].m_X && A.m_UV[i].m_Y == B.m_UV[i].m_Y, "Vertex UV mismatch" );
+
+        Check( A.m_nColors == B.m_nColors, "Vertex color count mismatch" );
+        for( int i = 0; i < A.m_nColors; ++i )
+            Check( A.m_Color[i].m_R == B.m_Color[i].m_R && A.m_Color[i].m_G == B.m_Color[i].m_G
+                && A.m_Color[i].m_B == B.m_Color[i].m_B && A.m_Color[i].m_A == B.m_Color[i].m_A, "Vertex color mismatch" );
+
+        Check( A.m_nWeights == B.m_nWeights, "Vertex weight count mismatch" );
+        for( int i = 0; i < A.m_nWeights; ++i )
+            Check( A.m_Weight[i].m_iBone == B.m_Weight[i].m_iBone && A.m_Weight[i].m_Weight == B.m_Weight[i].m_Weight, "Vertex weight mismatch" );
+
+        Check( A.m_nNormals == B.m_nNormals && A.m_nTangents == B.m_nTangents && A.m_nBinormals == B.m_nBinormals, "Vertex BTN count mismatch" );
+        for( int i = 0; i < A.m_nNormals; ++i )
+            Check( Same( A.m_BTN[i].m_Normal,   B.m_BTN[i].m_Normal,   BTNTolerance )
+                && Same( A.m_BTN[i].m_Tangent,  B.m_BTN[i].m_Tangent,  BTNTolerance )
+                && Same( A.m_BTN[i].m_Binormal, B.m_BTN[i].m_Binormal, BTNTolerance ), "Vertex BTN mismatch" );
+    }
+
+    //--------------------------------------------------------------------------
+
+    inline void CheckGeom( const geom& A, const geom& B, float BTNTolerance )
+    {
+        Check( A.m_Bone.size() == B.m_Bone.size(), "Bone count mismatch" );
+        for( std::size_t i = 0; i < A.m_Bone.size(); ++i )
+            Check( A.m_Bone[i].m_Name == B.m_Bone[i].m_Name && A.m_Bone[i].m_iParent == B.m_Bone[i].m_iParent, "Bone mismatch" );
+
+        Check( A.m_MaterialInstance.size() == B.m_MaterialInstance.size(), "Material instance count mismatch" );
+        for( std::size_t i = 0; i < A.m_MaterialInstance.size(); ++i )
+        {
+            const auto& MA = A.m_MaterialInstance[i];
+            const auto& MB = B.m_MaterialInstance[i];
+            Check( MA.m_Name == MB.m_Name && MA.m_MaterialShader == MB.m_MaterialShader && MA.m_Technique == MB.m_Technique, "Material instance mismatch" );
+            Check( MA.m_Params.size() == MB.m_Params.size(), "Material param count mismatch" );
+            for( std::size_t k = 0; k < MA.m_Params.size(); ++k )
+                Check( MA.m_Params[k].m_Type == MB.m_Params[k].m_Type && MA.m_Params[k].m_Name == MB.m_Params[k].m_Name && MA.m_Params[k].m_Value == MB.m_Params[k].m_Value, "Material param mismatch" );
+        }
+
+        Check( A.m_Mesh.size() == B.m_Mesh.size(), "Mesh count mismatch" );
+        for( std::size_t i = 0; i < A.m_Mesh.size(); ++i )
+            Check( A.m_Mesh[i].m_Name == B.m_Mesh[i].m_Name && A.m_Mesh[i].m_ScenePath == B.m_Mesh[i].m_ScenePath, "Mesh mismatch" );
+
+        Check( A.m_Vertex.size() == B.m_Vertex.size(), "Vertex count mismatch" );
+        for( std::size_t i = 0; i < A.m_Vertex.size(); ++i )
+            CheckVertex( A.m_Vertex[i], B.m_Vertex[i], BTNTolerance );
+
+        Check( A.m_Facet.size() == B.m_Facet.size(), "Facet count mismatch" );
+        for( std::size_t i = 0; i < A.m_Facet.size(); ++i )
+        {
+            const auto& FA = A.m_Facet[i];
+            const auto& FB = B.m_Facet[i];
+            Check( FA.m_iMesh == FB.m_iMesh && FA.m_iMaterialInstance == FB.m_iMaterialInstance && FA.m_nVertices == FB.m_nVertices, "Facet mismatch" );
+            for( int k = 0; k < FA.m_nVertices; ++k )
+                Check( FA.m_iVertex[k] == FB.m_iVertex[k], "Facet index mismatch" );
+        }
+    }
+
+    //--------------------------------------------------------------------------
+
+    inline void TestGeomRoundTrip( geom::compression Compression, float BTNTolerance )
+    {
+        geom                Source   = MakeGeom();
+        const std::wstring  FileName = getTempFile( L"xraw3d_unit_test_geom.xr3d" );
+
+        Source.SerializeChunked( false, FileName, geom::vertex_layout::VERTICES, geom::facet_layout::FACETS, Compression );
+
+        geom Loaded;
+        Loaded.SerializeChunked( true, FileName );
+        CheckGeom( Source, Loaded, BTNTolerance );
+
+        // The stream layout must hold the same vertices
+        geom Streams;
+        Streams.SerializeChunked( true, FileName, geom::vertex_layout::STREAMS );
+        Check( Streams.isStreamLayout() && Streams.m_Streams.size() == Source.m_Vertex.size(), "Stream layout vertex count mismatch" );
+        Streams.ConvertToVertices();
+        CheckGeom( Source, Streams, BTNTolerance );
+
+        std::filesystem::remove( FileName );
+    }
+
+    //--------------------------------------------------------------------------
+    // Loads two of the three meshes, the facets come back mesh by mesh in file order and point to
+    // the vertices the selected meshes use, which must hold the same values as in the source geom
+    //--------------------------------------------------------------------------
+    inline void TestPartialLoad( geom::compression Compression )
+    {
+        geom                Source   = MakeGeom();
+        const std::wstring  FileName = getTempFile( L"xraw3d_unit_test_partial.xr3d" );
+
+        Source.SerializeChunked( false, FileName, geom::vertex_layout::VERTICES, geom::facet_layout::FACETS, Compression );
+
+        const std::array<std::string_view, 3> Names{ "Legs", "Head", "Missing" };
+
+        geom Loaded;
+        Check( Loaded.LoadChunkedMeshes( FileName, Names ) == 2, "Partial load found the wrong number of meshes" );
+        Check( Loaded.m_Mesh.size() == 2 && Loaded.m_Mesh[0].m_Name == "Head" && Loaded.m_Mesh[1].m_Name == "Legs", "Partial load picked the wrong meshes" );
+        Check( Loaded.m_Bone.size() == Source.m_Bone.size() && Loaded.m_MaterialInstance.size() == Source.m_MaterialInstance.size(), "Partial load must keep all the bones and materials" );
+        Check( Loaded.m_Vertex.size() == 2 * grid_size_v * grid_size_v, "Partial load kept the wrong number of vertices" );
+
+        const float BTNTolerance = Compression == geom::compression::LOSSY ? 2e-3f : 0;
+
+        std::size_t iLoaded = 0;
+        for( std::int32_t iSource : { 1, 2 } )
+        {
+            for( const auto& Facet : Source.m_Facet )
+            {
+                if( Facet.m_iMesh != iSource ) continue;
+
+                Check( iLoaded < Loaded.m_Facet.size(), "Partial load is missing facets" );
+                const auto& Other = Loaded.m_Facet[ iLoaded++ ];
+
+                Check( Other.m_iMesh == iSource - 1 && Other.m_iMaterialInstance == Facet.m_iMaterialInstance && Other.m_nVertices == Facet.m_nVertices, "Partial load facet mismatch" );
+                for( int k = 0; k < Facet.m_nVertices; ++k )
+                    CheckVertex( Source.m_Vertex[ Facet.m_iVertex[k] ], Loaded.m_Vertex[ Other.m_iVertex[k] ], BTNTolerance );
+            }
+        }
+        Check( iLoaded == Loaded.m_Facet.size(), "Partial load has extra facets" );
+
+        std::filesystem::remove( FileName );
+    }
+
+    //--------------------------------------------------------------------------
+
+    inline void TestAnimRoundTrip( bool bCompress )
+    {
+        anim Source;
+        Source.m_Name       = "Walk";
+        Source.m_FPS        = 30;
+        Source.m_nFrames    = 40;
+
+        Source.m_Bone.resize( 4 );
+        for( int i = 0; i < 4; ++i )
+        {
+            auto& Bone = Source.m_Bone[i];
+            Bone                    = anim::bone{};
+            Bone.m_Name             = std::format( "Bone{}", i );
+            Bone.m_iParent          = i - 1;
+            Bone.m_nChildren        = i < 3 ? 1 : 0;
+            Bone.m_BindTranslation  = xmath::fvec3( 0, static_cast<float>(i), 0 );
+            Bone.m_BindScale        = xmath::fvec3( 1, 1, 1 );
+            Bone.m_BindRotation.setupIdentity();
+            Bone.m_bRotationKeys    = true;
+            Bone.m_bIsMasked        = i == 3;
+        }
+
+        Source.m_KeyFrame.resize( Source.m_nFrames * Source.m_Bone.size() );
+        for( std::size_t i = 0; i < Source.m_KeyFrame.size(); ++i )
+        {
+            const float T = static_cast<float>(i) * 0.05f;
+            auto& Key = Source.m_KeyFrame[i];
+            Key.m_Scale         = xmath::fvec3( 1, 1, 1 );
+            Key.m_Position      = xmath::fvec3( std::sin( T ), 0, T );
+            Key.m_Rotation.m_X  = 0;
+            Key.m_Rotation.m_Y  = std::sin( T * 0.5f );
+            Key.m_Rotation.m_Z  = 0;
+            Key.m_Rotation.m_W  = std::cos( T * 0.5f );
+        }
+
+        const std::wstring FileName = getTempFile( L"xraw3d_unit_test_anim.xr3d" );
+        Source.SerializeChunked( false, FileName, bCompress );
+
+        anim Loaded;
+        Loaded.SerializeChunked( true, FileName );
+
+        Check( Loaded.m_Name == Source.m_Name && Loaded.m_FPS == Source.m_FPS && Loaded.m_nFrames == Source.m_nFrames, "Anim info mismatch" );
+        Check( Loaded.m_Bone.size() == Source.m_Bone.size(), "Anim bone count mismatch" );
+        for( std::size_t i = 0; i < Source.m_Bone.size(); ++i )
+        {
+            const auto& A = Source.m_Bone[i];
+            const auto& B = Loaded.m_Bone[i];
+            Check( A.m_Name == B.m_Name && A.m_iParent == B.m_iParent && A.m_bRotationKeys == B.m_bRotationKeys && A.m_bIsMasked == B.m_bIsMasked, "Anim bone mismatch" );
+        }
+
+        Check( Loaded.m_KeyFrame.size() == Source.m_KeyFrame.size(), "Anim key count mismatch" );
+        for( std::size_t i = 0; i < Source.m_KeyFrame.size(); ++i )
+        {
+            const auto& A = Source.m_KeyFrame[i];
+            const auto& B = Loaded.m_KeyFrame[i];
+            Check( A.m_Position.m_X == B.m_Position.m_X && A.m_Position.m_Y == B.m_Position.m_Y && A.m_Position.m_Z == B.m_Position.m_Z
+                && A.m_Rotation.m_X == B.m_Rotation.m_X && A.m_Rotation.m_Y == B.m_Rotation.m_Y && A.m_Rotation.m_Z == B.m_Rotation.m_Z && A.m_Rotation.m_W == B.m_Rotation.m_W
+                && A.m_Scale.m_X    == B.m_Scale.m_X    && A.m_Scale.m_Y    == B.m_Scale.m_Y    && A.m_Scale.m_Z    == B.m_Scale.m_Z, "Anim key mismatch" );
+        }
+
+        std::filesystem::remove( FileName );
+    }
+
+    //--------------------------------------------------------------------------
+    // A file cut short and a file with a table of contents entry that points past its end must both
+    // throw when opened, for the full load and for the partial one
+    //--------------------------------------------------------------------------
+    inline void TestCorruptedFile( void )
+    {
+        geom                Source   = MakeGeom();
+        const std::wstring  FileName = getTempFile( L"xraw3d_unit_test_corrupted.xr3d" );
+
+        Source.SerializeChunked( false, FileName, geom::vertex_layout::VERTICES, geom::facet_layout::FACETS, geom::compression::LOSSLESS );
+
+        std::vector<char> Bytes;
+        {
+            std::ifstream File( std::filesystem::path( FileName ), std::ios::binary );
+            Bytes.assign( std::istreambuf_iterator<char>( File ), std::istreambuf_iterator<char>() );
+        }
+        Check( Bytes.size() > sizeof(details::chunk_file_header) + sizeof(details::chunk_entry), "The chunk file is too small" );
+
+        auto Write = [&]( std::span<const char> Data )
+        {
+            std::ofstream File( std::filesystem::path( FileName ), std::ios::binary | std::ios::trunc );
+            File.write( Data.data(), static_cast<std::streamsize>( Data.size() ) );
+        };
+
+        auto Throws = [&]( const std::function<void()>& Function )
+        {
+            try
+            {
+                Function();
+            }
+            catch( const std::exception& )
+            {
+                return true;
+            }
+            return false;
+        };
+
+        const std::array<std::string_view, 1> Names{ "Head" };
+
+        Write( std::span<const char>{ Bytes }.first( Bytes.size() / 2 ) );
+        Check( Throws( [&]{ geom G; G.SerializeChunked( true, FileName ); } ),  "Loading a truncated file did not throw" );
+        Check( Throws( [&]{ geom G; G.LoadChunkedMeshes( FileName, Names ); } ), "Partially loading a truncated file did not throw" );
+
+        std::vector<char>       Corrupted = Bytes;
+        details::chunk_entry    Entry;
+        std::memcpy( &Entry, Corrupted.data() + sizeof(details::chunk_file_header), sizeof(Entry) );
+        Entry.m_Offset = Corrupted.size();
+        Entry.m_Size   = std::max<std::uint64_t>( Entry.m_Size, 1 );
+        std::memcpy( Corrupted.data() + sizeof(details::chunk_file_header), &Entry, sizeof(Entry) );
+
+        Write( Corrupted );
+        Check( Throws( [&]{ geom G; G.SerializeChunked( true, FileName ); } ),  "Loading a corrupted file did not throw" );
+        Check( Throws( [&]{ geom G; G.LoadChunkedMeshes( FileName, Names ); } ), "Partially loading a corrupted file did not throw" );
+
+        std::filesystem::remove( FileName );
+    }
+}
+
+//--------------------------------------------------------------------------
+
 int main()
 {
+    using namespace xraw3d;
+
+    struct test
+    {
+        const char*             m_pName;
+        std::function<void()>   m_Function;
+    };
+
+    const test Tests[] =
+    { { "Geom round trip raw",                  []{ unit_test::TestGeomRoundTrip( geom::compression::NONE,     0     ); } }
+    , { "Geom round trip entropy and delta",    []{ unit_test::TestGeomRoundTrip( geom::compression::LOSSLESS, 0     ); } }
+    , { "Geom round trip lossy octahedral",     []{ unit_test::TestGeomRoundTrip( geom::compression::LOSSY,    2e-3f ); } }
+    , { "Geom partial load raw",                []{ unit_test::TestPartialLoad( geom::compression::NONE );               } }
+    , { "Geom partial load compressed",         []{ unit_test::TestPartialLoad( geom::compression::LOSSLESS );           } }
+    , { "Anim round trip raw",                  []{ unit_test::TestAnimRoundTrip( false );                               } }
+    , { "Anim round trip delta",                []{ unit_test::TestAnimRoundTrip( true );                                } }
+    , { "Truncated and corrupted files throw",  []{ unit_test::TestCorruptedFile();                                      } }
+    };
+
+    int nFailed = 0;
+    for( const auto& Test : Tests )
+    {
+        try
+        {
+            Test.m_Function();
+            std::printf( "[ OK ] %s\n", Test.m_pName );
+        }
+        catch( const std::exception& Error )
+        {
+            std::printf( "[FAIL] %s: %s\n", Test.m_pName, Error.what() );
+            ++nFailed;
+        }
+    }
 
-    return 1;
-}
\ No newline at end of file
+    return nFailed ? 1 : 0;
+}
@@ -5,6 +5,10 @@
 #include "dependencies/xstrtool/source/xstrtool.h"
 #include "dependencies/MikkTSpace/mikktspace.c"
 
+#include "details/xraw3d_parallel.h"
+#include "details/xraw3d_name_index.cpp"
+#include "details/xraw3d_chunk_codec.cpp"
+#include "details/xraw3d_chunk_file.cpp"
 #include "details/xraw3d_anim.cpp"
 #include "details/xraw3d_geom.cpp"
 #include "details/xraw3d_assimp_import.cpp"
@@ -7,6 +7,9 @@
 #include "dependencies/xbitmap/source/xcolor.h"
 #include "dependencies/xtextfile/source/xtextfile.h"
 
+#include "details/xraw3d_name_index.h"
+#include "details/xraw3d_chunk_codec.h"
+#include "details/xraw3d_chunk_file.h"
 #include "xraw3d_anim.h"
 #include "xraw3d_geom.h"
 #include "xraw3d_assimp_import.h"
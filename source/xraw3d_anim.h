@@ -92,6 +92,13 @@ namespace xraw3d
                                                         , std::wstring_view             FileName
                                                         , xtextfile::file_type          Type      = xtextfile::file_type::BINARY
                                                         );
+        // Chunked binary container (see details::chunk_file_header) with the key frames stored as one raw
+        // array, so loading is one memcpy with no per key parsing. Serialize reads these files too.
+        // bCompress stores the keys delta and rANS coded (lossless), reading finds out on its own.
+        void                    SerializeChunked        ( bool                          isRead
+                                                        , std::wstring_view             FileName
+                                                        , bool                          bCompress = false   // Only used when writing
+                                                        );
         void                    Save                    (std::wstring_view              FileName
                                                         ) const;
         void                    CleanUp                 ( void 
@@ -120,6 +127,8 @@ namespace xraw3d
                                                         ) const ;
         std::int32_t            GetBoneIDFromName       ( std::string_view   BoneName 
                                                         ) const;
+        void                    InvalidateBoneIndex     ( void              // Only needed after renaming bones in place
+                                                        ) noexcept;
         void                    ComputeBoneKeys         ( std::span<xmath::fquat>   Q
                                                         , std::span<xmath::fvec3>   S
                                                         , std::span<xmath::fvec3>   T
@@ -178,6 +187,7 @@ namespace xraw3d
         std::vector<super_event>        m_SuperEvent            {};
         std::vector<prop>               m_Prop                  {};
         std::vector<prop_frame>         m_PropFrame             {};
+        details::name_index             m_BoneIndex             {};                  // GetBoneIDFromName lookup, built on demand
     };
 
 } // namespace xraw3d
@@ -62,13 +62,223 @@ namespace xraw3d
             std::array<btn,           vertex_max_normals_v> m_BTN;
         };
 
+        // Per-vertex attribute counts as stored by vertex_streams. All the counts are bounded
+        // by the vertex_max_*_v constants so a byte each is enough.
+        struct vertex_counts
+        {
+            std::uint8_t                                    m_nWeights      = 0;
+            std::uint8_t                                    m_nNormals      = 0;
+            std::uint8_t                                    m_nTangents     = 0;
+            std::uint8_t                                    m_nBinormals    = 0;
+            std::uint8_t                                    m_nUVs          = 0;
+            std::uint8_t                                    m_nColors       = 0;
+        };
+
+        // Structure-of-arrays alternative to m_Vertex. Every attribute lives in its own stream
+        // and only the channels that at least one vertex uses are allocated, so a vertex with
+        // one UV set, one BTN and 4 weights costs ~100 bytes instead of the full vertex struct.
+        // Channel streams are indexed as [channel][vertex]; values past a vertex count are zero.
+        struct vertex_streams
+        {
+            std::size_t             size                    ( void ) const noexcept { return m_Position.size(); }
+            bool                    empty                   ( void ) const noexcept { return m_Position.empty(); }
+            void                    clear                   ( void ) noexcept;
+            void                    resize                  ( std::size_t                   nVertices
+                                                            );
+            void                    AllocateChannels        ( std::int32_t                  nUVs
+                                                            , std::int32_t                  nColors
+                                                            , std::int32_t                  nBTNs
+                                                            , std::int32_t                  nWeights
+                                                            );
+            void                    getVertex               ( std::size_t                   Index
+                                                            , vertex&                       Vertex
+                                                            ) const;
+            void                    setVertex               ( std::size_t                   Index
+                                                            , const vertex&                 Vertex
+                                                            );
+            void                    Compact                 ( std::span<const std::int32_t> Keep
+                                                            );
+            std::size_t             getMemoryUsage          ( void 
+                                                            ) const noexcept;
+
+            std::vector<xmath::fvec3>                       m_Position;
+            std::vector<vertex_counts>                      m_Count;
+            std::vector<std::int32_t>                       m_iFrame;       // Empty when all the vertices use frame 0
+            std::vector<std::vector<xmath::fvec2>>          m_UV;
+            std::vector<std::vector<xcolori>>               m_Color;
+            std::vector<std::vector<btn>>                   m_BTN;
+            std::vector<std::vector<weight>>                m_Weight;
+        };
+
+        enum class vertex_layout : std::uint8_t
+        { VERTICES                                          // m_Vertex
+        , STREAMS                                           // m_Streams
+        };
+
+        // Quantized skin weights for export and CPU skinning, built from the full precision weights by
+        // BuildSkinStream. Every vertex gets m_nInfluences slots stored as [vertex][influence], largest
+        // weight first and unused slots with a zero weight. The weights of a vertex add up to exactly the
+        // unorm max so they sum to 1 once dequantized. It is a snapshot, edits to the weights clear it.
+        struct skin_stream
+        {
+            enum class bone_format : std::uint8_t
+            { UINT8
+            , UINT16
+            };
+
+            enum class weight_format : std::uint8_t
+            { UNORM8
+            , UNORM16
+            };
+
+            struct format
+            {
+                std::int32_t                                m_nInfluences   = 4;            // 4 or 8
+                bone_format                                 m_BoneFormat    = bone_format::UINT8;
+                weight_format                               m_WeightFormat  = weight_format::UNORM8;
+            };
+
+            std::size_t             size                    ( void ) const noexcept { return m_Format.m_nInfluences ? m_Weights.size() / ( m_Format.m_nInfluences * getWeightSize() ) : 0; }
+            bool                    empty                   ( void ) const noexcept { return m_Weights.empty(); }
+            void                    clear                   ( void ) noexcept;
+            std::int32_t            getBoneSize             ( void ) const noexcept { return m_Format.m_BoneFormat   == bone_format::UINT8    ? 1 : 2; }
+            std::int32_t            getWeightSize           ( void ) const noexcept { return m_Format.m_WeightFormat == weight_format::UNORM8 ? 1 : 2; }
+            std::int32_t            iBone                   ( std::size_t                   iVertex
+                                                            , std::int32_t                  iInfluence
+                                                            ) const noexcept;
+            float                   Weight                  ( std::size_t                   iVertex
+                                                            , std::int32_t                  iInfluence
+                                                            ) const noexcept;
+            std::size_t             getMemoryUsage          ( void 
+                                                            ) const noexcept;
+
+            format                                          m_Format;
+            std::vector<std::uint8_t>                       m_Bones;        // getBoneSize() bytes per influence, native endian
+            std::vector<std::uint8_t>                       m_Weights;      // getWeightSize() bytes per influence, native endian
+        };
+
+        // What BuildSkinStream lost. Weights are compared after normalizing the full set of the vertex.
+        struct skin_stats
+        {
+            std::int32_t                                    m_nTruncatedVertices    = 0;    // Had more weights than influences
+            float                                           m_MaxDroppedWeight      = 0;    // Largest weight sum a vertex lost to truncation
+            float                                           m_MaxWeightError        = 0;    // Largest error of a single quantized weight
+            std::int32_t                                    m_iMaxErrorVertex       = -1;   // Vertex with m_MaxWeightError
+        };
+
+        // What CleanMesh removed and how long each of its phases took
+        struct clean_stats
+        {
+            enum class phase : std::uint8_t
+            { NORMALIZE_AND_SORT_WEIGHTS
+            , WELD
+            , FACETS                                        // Mesh, degenerated and duplicated facets
+            , VERTICES                                      // Compaction of the welded and unused vertices
+            , MATERIALS_AND_MESHES
+            , ENUM_COUNT
+            };
+
+            std::int32_t            getFacetsRemoved        ( void ) const noexcept { return m_nMeshFacets + m_nDegeneratedFacets + m_nDuplicatedFacets; }
+            std::int32_t            getVerticesRemoved      ( void ) const noexcept { return m_nWeldedVertices + m_nUnusedVertices; }
+            float                   getTotalMS              ( void ) const noexcept { float T = 0; for( auto MS : m_PhaseMS ) T += MS; return T; }
+
+            std::int32_t                                    m_nWeldedVertices       = 0;
+            std::int32_t                                    m_nUnusedVertices       = 0;
+            std::int32_t                                    m_nMeshFacets           = 0;    // Facets of the mesh asked to be removed
+            std::int32_t                                    m_nDegeneratedFacets    = 0;
+            std::int32_t                                    m_nDuplicatedFacets     = 0;
+            std::int32_t                                    m_nMaterialsRemoved     = 0;
+            std::int32_t                                    m_nMeshesRemoved        = 0;
+
+            std::array<std::int32_t, 3>                     m_WeldGrid              = {};   // Cells per axis of the weld grid
+            std::int32_t                                    m_nWeldOccupiedCells    = 0;
+            std::int32_t                                    m_WeldMaxCellVertices   = 0;
+
+            std::array<float, static_cast<int>(phase::ENUM_COUNT)> m_PhaseMS        = {};   // Wall time of each phase in milliseconds
+        };
+
+        enum class tangent_mode : std::uint8_t
+        { MIKKTSPACE                                        // Exact, what the bakers expect
+        , FAST                                              // Per triangle accumulation, for previews and iteration builds
+        };
+
+        // Result of BenchmarkTangents, the deviation is the angle between the tangents of both modes
+        struct tangent_benchmark
+        {
+            float                                           m_MikkMS                = 0;
+            float                                           m_FastMS                = 0;
+            float                                           m_AverageDeviation      = 0;    // Radians
+            float                                           m_MaxDeviation          = 0;    // Radians
+            std::int32_t                                    m_nCompared             = 0;    // Vertex tangents compared (all sets)
+        };
+
+        enum class facet_order : std::uint8_t
+        { MESH_MATERIAL                                     // Same order SortFacetsByMaterial uses
+        , MESH_MATERIAL_BONE                                // Same order SortFacetsByMeshMaterialBone uses
+        };
+
         struct facet
         {
             std::int32_t                                    m_iMesh;
             std::int32_t                                    m_nVertices;
             std::array<std::int32_t,facet_max_vertices_v>   m_iVertex;
             std::int32_t                                    m_iMaterialInstance;
-            xmath::fplane                                   m_Plane;
+            xmath::fplane                                   m_Plane{};          // Only valid after UpdateFacetPlanes (see areFacetPlanesDirty)
+        };
+
+        // Triangle only alternative to m_Facet. The vertex indices live in a flat buffer, three per
+        // triangle, and the mesh and material of each triangle are kept in 16 bits while every value
+        // fits, so a triangle costs 16 bytes instead of the full facet struct. Planes are not stored.
+        struct triangle_list
+        {
+            // Per triangle index, stored narrow until a value does not fit and then promoted to 32 bits
+            struct ids
+            {
+                static constexpr std::uint16_t  narrow_none_v = 0xffff;         // Narrow encoding for -1
+
+                std::size_t         size                    ( void ) const noexcept { return m_Wide.empty() ? m_Narrow.size() : m_Wide.size(); }
+                std::int32_t        get                     ( std::size_t i ) const noexcept { return m_Wide.empty() ? ( m_Narrow[i] == narrow_none_v ? -1 : m_Narrow[i] ) : m_Wide[i]; }
+                void                set                     ( std::size_t                   Index
+                                                            , std::int32_t                  Value
+                                                            );
+                void                resize                  ( std::size_t                   Count
+                                                            );
+                void                clear                   ( void 
+                                                            ) noexcept;
+
+                std::vector<std::uint16_t>                  m_Narrow;
+                std::vector<std::int32_t>                   m_Wide;         // Only used once a value did not fit in m_Narrow
+            };
+
+            std::size_t             size                    ( void ) const noexcept { return m_Index.size() / 3; }
+            bool                    empty                   ( void ) const noexcept { return m_Index.empty(); }
+            void                    clear                   ( void ) noexcept;
+            void                    resize                  ( std::size_t                   nTriangles
+                                                            );
+            void                    getFacet                ( std::size_t                   Index
+                                                            , facet&                        Facet
+                                                            ) const;
+            void                    setFacet                ( std::size_t                   Index
+                                                            , const facet&                  Facet
+                                                            );
+            std::size_t             getMemoryUsage          ( void 
+                                                            ) const noexcept;
+
+            std::vector<std::uint32_t>                      m_Index;
+            ids                                             m_iMesh;
+            ids                                             m_iMaterialInstance;
+        };
+
+        enum class facet_layout : std::uint8_t
+        { FACETS                                            // m_Facet
+        , TRIANGLES                                         // m_Triangles
+        };
+
+        // How SerializeChunked stores the arrays, reading finds out on its own
+        enum class compression : std::uint8_t
+        { NONE                                              // Raw arrays, loading is a memcpy each
+        , LOSSLESS                                          // Delta, zigzag and rANS coded (details::chunk_encoding), bit exact
+        , LOSSY                                             // LOSSLESS with the normals, tangents and binormals stored octahedral in 2 x 16 bits
         };
 
         // Material refers to a material instance not a material-shader/type
@@ -144,24 +354,75 @@ namespace xraw3d
 
         void                    Serialize                   ( bool                          isRead
                                                             , std::wstring_view             FileName
-                                                            , xtextfile::file_type          Type      = xtextfile::file_type::BINARY
+                                                            , xtextfile::file_type          Type        = xtextfile::file_type::BINARY
+                                                            , vertex_layout                 Layout      = vertex_layout::VERTICES   // Only used when reading
+                                                            , facet_layout                  FacetLayout = facet_layout::FACETS      // Only used when reading
+                                                            );
+        // Chunked binary container (see details::chunk_file_header), the arrays are stored raw so loading maps
+        // the file and copies each one with a single memcpy. Serialize reads these files too, its text path stays
+        // for debugging. Unlike Serialize it also keeps the vertex frames, mesh paths and mesh bone counts.
+        // Compressed files trade that memcpy for a decode that runs on all the cores.
+        void                    SerializeChunked            ( bool                          isRead
+                                                            , std::wstring_view             FileName
+                                                            , vertex_layout                 Layout      = vertex_layout::VERTICES   // Only used when reading
+                                                            , facet_layout                  FacetLayout = facet_layout::FACETS      // Only used when reading
+                                                            , compression                   Compression = compression::NONE         // Only used when writing
+                                                            );
+        // Partial loads of a chunk file through its table of contents, only the byte ranges they need are read.
+        // Compressed chunks are coded in independent blocks of about 256KB and only the blocks holding those ranges get decoded.
+        // LoadChunkedMeshes keeps all the bones and material instances, plus the named meshes (in file order) with
+        // only the vertices their facets use. It returns how many of the names were found.
+        void                    LoadChunkedHierarchy        ( std::wstring_view             FileName
+                                                            );
+        void                    LoadChunkedMaterials        ( std::wstring_view             FileName
+                                                            );
+        std::int32_t            LoadChunkedMeshes           ( std::wstring_view                     FileName
+                                                            , std::span<const std::string_view>     MeshNames
+                                                            , vertex_layout                         Layout      = vertex_layout::VERTICES
+                                                            , facet_layout                          FacetLayout = facet_layout::FACETS
+                                                            );
+        void                    ConvertToStreams            ( void
+                                                            );
+        void                    ConvertToVertices           ( void
+                                                            );
+        bool                    isStreamLayout              ( void
+                                                            ) const noexcept;
+        void                    ConvertToTriangles          ( void
                                                             );
+        void                    ConvertToFacets             ( void
+                                                            );
+        bool                    isTriangleLayout            ( void
+                                                            ) const noexcept;
         void                    Kill                        ( void 
                                                             );
         void                    SanityCheck                 ( void
                                                             ) const;
         void                    ComputeTangentsAndBinormalsMikk(int uvSet = 0
                                                             );
-        void                    CleanMesh                   ( std::int32_t                  iSubMesh = -1 
+        void                    ComputeTangentsAndBinormalsMikk(std::span<const int>    UVSets      // UVSets[i] goes into m_BTN[i]
+                                                            );
+        void                    ComputeTangentsAndBinormalsFast(std::span<const int>    UVSets      // UVSets[i] goes into m_BTN[i]
+                                                            );
+        void                    ComputeTangentsAndBinormals ( tangent_mode                  Mode
+                                                            , std::span<const int>          UVSets
+                                                            );
+        tangent_benchmark       BenchmarkTangents           ( std::span<const int>          UVSets
+                                                            ) const;
+        clean_stats             CleanMesh                   ( std::int32_t                  iSubMesh = -1 
                                                             );  
         void                    CleanWeights                ( std::int32_t                  MaxNumWeights
                                                             , float                         MinWeightValue 
                                                             );
+        // Fills m_Skin from the current weights, throws when a bone does not fit the bone format.
+        // Call it with {} for 4 influences with 8 bit bones and weights.
+        skin_stats              BuildSkinStream             ( const skin_stream::format&    Format
+                                                            );
         void                    ForceAddColorIfNone         ( void 
                                                             );
         void                    CollapseMeshes              ( std::string_view              MeshName 
                                                             );
         void                    CollapseNormals             ( xmath::radian                 ThresholdAngle = xmath::radian(xmath::DegToRad(20.0f))
+                                                            , bool                          bAllNormalSets = false     // Otherwise only m_BTN[0]
                                                             );
         xmath::fbbox            getBBox                     ( void 
                                                             ) const;
@@ -170,9 +431,28 @@ namespace xraw3d
 
         void                    ComputeMeshBBox             ( std::int32_t                  iMesh
                                                             , xmath::fbbox&                 BBox 
-                                                            );
+                                                            ) const;
+        // Box of every mesh (indexed like m_Mesh) plus the box of all of them in a single pass,
+        // prefer it over calling ComputeMeshBBox for each mesh
+        void                    ComputeMeshBBoxes           ( std::vector<xmath::fbbox>&    MeshBBoxes
+                                                            , xmath::fbbox&                 BBox
+                                                            ) const;
         void                    ComputeBoneInfo             ( void 
                                                             );
+
+        // Facet planes are lazy, edits that move positions only mark them dirty. ComputeFacetPlanes works
+        // on either facet layout and writes one plane per facet, or per facet of iMesh (in facet order)
+        // Text Serialize reads keep the planes stored in the file, the chunk file reads and the importers
+        // leave them dirty, so call UpdateFacetPlanes before reading m_Facet[i].m_Plane.
+        void                    ComputeFacetPlanes          ( std::span<xmath::fplane>      Planes
+                                                            , std::int32_t                  iMesh = -1
+                                                            ) const;
+        void                    UpdateFacetPlanes           ( void
+                                                            );
+        void                    InvalidateFacetPlanes       ( void
+                                                            ) noexcept;
+        bool                    areFacetPlanesDirty         ( void
+                                                            ) const noexcept;
         bool                    IsolateMesh                 ( std::int32_t                  iSubmesh
                                                             , geom&                         NewMesh
                                                             , bool                          RemoveFromRawMesh = false 
@@ -184,6 +464,8 @@ namespace xraw3d
                                                             );
         std::int32_t            getBoneIDFromName           ( std::string_view              BoneName 
                                                             ) const;
+        void                    InvalidateBoneIndex         ( void                                  // Only needed after renaming bones in place
+                                                            ) noexcept;
         void                    DeleteBone                  ( std::int32_t                  iBone 
                                                             );
         void                    DeleteBone                  ( std::string_view              BoneName 
@@ -196,6 +478,18 @@ namespace xraw3d
                                                             );
         void                    SortFacetsByMeshMaterialBone( void 
                                                             );
+
+        // An order lists for each new position the index of the facet that goes there. When Base is given the
+        // facets are visited in that order, which stays as the tie breaker, so orders can be composed without
+        // moving the facets; ex: ApplyFacetOrder( getFacetOrder( facet_order::MESH_MATERIAL, CacheOrder ) )
+        std::vector<std::uint32_t> getFacetOrder            ( facet_order                   Order
+                                                            , std::span<const std::uint32_t> Base = {}
+                                                            ) const;
+        std::vector<std::uint32_t> getFacetOrder            ( std::span<const std::uint64_t> Keys         // One per facet, sorted ascending
+                                                            , std::span<const std::uint32_t> Base = {}
+                                                            ) const;
+        void                    ApplyFacetOrder             ( std::span<const std::uint32_t> Order
+                                                            );
         static bool             TempVCompare                ( const geom::vertex&           A
                                                             , const geom::vertex&           B
                                                             , const float                   PositionEpsilon
@@ -204,9 +498,11 @@ namespace xraw3d
                                                             , const geom::facet&            B 
                                                             );
         int                     findMeshByName              ( std::string_view MeshName 
-                                                            );
+                                                            ) const;
         int                     findMeshByPath              (std::string_view MeshScenePath
-                                                            );
+                                                            ) const;
+        void                    InvalidateMeshIndex         ( void                                  // Only needed after renaming meshes in place
+                                                            ) noexcept;
 
     public:
 
@@ -215,6 +511,13 @@ namespace xraw3d
         std::vector<facet>                 m_Facet;
         std::vector<material_instance>     m_MaterialInstance;
         std::vector<mesh>                  m_Mesh;
+        vertex_streams                     m_Streams;       // Used instead of m_Vertex in the STREAMS layout
+        triangle_list                      m_Triangles;     // Used instead of m_Facet in the TRIANGLES layout
+        details::name_index                m_BoneIndex;     // getBoneIDFromName lookup, built on demand
+        details::exact_name_index          m_MeshNameIndex; // findMeshByName lookup, built on demand
+        details::exact_name_index          m_MeshPathIndex; // findMeshByPath lookup, built on demand
+        skin_stream                        m_Skin;          // Optional quantized copy of the weights, see BuildSkinStream
+        bool                               m_bFacetPlanesDirty = true;      // m_Facet[i].m_Plane is stale until UpdateFacetPlanes
     };
 
 } // xraw3d
\ No newline at end of file